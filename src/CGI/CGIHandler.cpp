@@ -6,6 +6,8 @@
 #include <fcntl.h>
 #include <sstream>
 #include <signal.h>
+#include <arpa/inet.h>
+#include "../Log/Logger.hpp"
 
 static std::string itos_long(long v) {
     std::ostringstream ss; ss << v; return ss.str();
@@ -35,15 +37,15 @@ std::vector<std::string> CGIHandler::buildEnv(const std::string &scriptPath) con
     env.push_back(std::string("SCRIPT_NAME=") + request.getPath());
     
     // Safely extract QUERY_STRING from CGI environment
-    const std::map<std::string, std::string> &cgiEnv = request.getCGIEnv();
-    std::map<std::string, std::string>::const_iterator qsIt = cgiEnv.find("QUERY_STRING");
-    std::string queryString = (qsIt != cgiEnv.end()) ? qsIt->second : std::string();
+    const Request::StringMap &cgiEnv = request.getCGIEnv();
+    Request::StringMap::const_iterator qsIt = cgiEnv.find("QUERY_STRING");
+    std::string queryString = (qsIt != cgiEnv.end()) ? std::string(qsIt->second.data(), qsIt->second.size()) : std::string();
     env.push_back(std::string("QUERY_STRING=") + queryString);
 
     // Content headers
-    const std::string &ct = request.getHeader("content-type");
+    const std::string ct = request.getHeader("content-type");
     if (ct != "content-type" && !ct.empty()) env.push_back(std::string("CONTENT_TYPE=") + ct);
-    const std::string &cl = request.getHeader("content-length");
+    const std::string cl = request.getHeader("content-length");
     if (cl != "content-length" && !cl.empty()) env.push_back(std::string("CONTENT_LENGTH=") + cl);
 
     // Host/port
@@ -51,11 +53,21 @@ std::vector<std::string> CGIHandler::buildEnv(const std::string &scriptPath) con
     int port = server.ports.empty() ? 80 : server.ports[0];
     env.push_back(std::string("SERVER_PORT=") + itos_long(port));
 
+    // Peer address captured at accept time
+    sockaddr_in peer = request.getClientAddr();
+    if (peer.sin_family == AF_INET) {
+        char ip[INET_ADDRSTRLEN];
+        if (inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip))) {
+            env.push_back(std::string("REMOTE_ADDR=") + ip);
+            env.push_back(std::string("REMOTE_PORT=") + itos_long(ntohs(peer.sin_port)));
+        }
+    }
+
     // HTTP_ headers (uppercase, hyphens to underscores)
-    const std::map<std::string, std::string> &hdrs = request.getAllHeaders();
-    for (std::map<std::string, std::string>::const_iterator it = hdrs.begin(); it != hdrs.end(); ++it) {
-        std::string key = it->first;
-        std::string val = it->second;
+    const Request::StringMap &hdrs = request.getAllHeaders();
+    for (Request::StringMap::const_iterator it = hdrs.begin(); it != hdrs.end(); ++it) {
+        std::string key(it->first.data(), it->first.size());
+        std::string val(it->second.data(), it->second.size());
         if (key.empty() || val.empty()) continue;
         // Skip content-type/length, already added
         if (key == "content-type" || key == "content-length") {
@@ -202,6 +214,7 @@ CGIHandler::Result CGIHandler::run(const std::string &resolvedScriptPath,
         dup2(inpipe[0], STDIN_FILENO);
         dup2(outpipe[1], STDOUT_FILENO);
         dup2(outpipe[1], STDERR_FILENO); // Redirect stderr to stdout for debugging
+        signal(SIGPIPE, SIG_DFL); // The server ignores it; exec would keep that
         // close unused
         close(inpipe[1]); close(outpipe[0]);
 
@@ -229,7 +242,7 @@ CGIHandler::Result CGIHandler::run(const std::string &resolvedScriptPath,
             ssize_t w = write(inpipe[1], body.c_str() + off, body.size() - off);
             if (w == -1) {
                 // Write failed, but continue - CGI might not need the body
-                std::cout << "[CGI DEBUG] Write to CGI stdin failed, continuing..." << std::endl;
+                LOG_DEBUG("CGI: Write to CGI stdin failed, continuing...");
                 break;
             }
             off += w;
@@ -249,23 +262,23 @@ CGIHandler::Result CGIHandler::run(const std::string &resolvedScriptPath,
     int iterations = 0;
     bool timeout_reached = false;
     
-    std::cout << "[CGI DEBUG] Starting to read from CGI process, timeout in ~5 seconds" << std::endl;
+    LOG_DEBUG("CGI: Starting to read from CGI process, timeout in ~5 seconds");
     
     while (iterations < max_wait_iterations) {
         ssize_t r = read(outpipe[0], buf, sizeof(buf));
         if (r > 0) {
             raw.append(buf, r);
             iterations = 0; // Reset counter when we get data
-            std::cout << "[CGI DEBUG] Read " << r << " bytes from CGI" << std::endl;
+            LOG_DEBUG("CGI: Read " << r << " bytes from CGI");
         } else if (r == 0) {
             // EOF - process finished
-            std::cout << "[CGI DEBUG] CGI process finished (EOF)" << std::endl;
+            LOG_DEBUG("CGI: process finished (EOF)");
             break;
         } else if (r == -1) {
             // For non-blocking reads, -1 with no data available is normal
             // We'll just wait and try again
             if (iterations % 10 == 0) { // Print every second
-                std::cout << "[CGI DEBUG] Waiting for CGI data... iteration " << iterations << "/50" << std::endl;
+                LOG_DEBUG("CGI: Waiting for CGI data... iteration " << iterations << "/50");
             }
             usleep(100000); // 100ms
             iterations++;
@@ -275,7 +288,7 @@ CGIHandler::Result CGIHandler::run(const std::string &resolvedScriptPath,
     
     if (iterations >= max_wait_iterations) {
         timeout_reached = true;
-        std::cout << "[CGI DEBUG] TIMEOUT REACHED! Killing CGI process with SIGKILL" << std::endl;
+        LOG_DEBUG("CGI: TIMEOUT REACHED! Killing CGI process with SIGKILL");
         kill(pid, SIGKILL);
     }
     close(outpipe[0]);
@@ -343,10 +356,18 @@ bool CGIHandler::startCGI(const std::string &resolvedScriptPath,
     resolvedScript = resolvedScriptPath;
     interpreter = effectiveInterpreter;
     
+    // Close-on-exec so later CGI children do not inherit (and keep alive) this pipe
     int inpipe[2], outpipe[2];
-    if (pipe(inpipe) == -1) return false;
-    if (pipe(outpipe) == -1) { close(inpipe[0]); close(inpipe[1]); return false; }
+    if (pipe2(inpipe, O_CLOEXEC) == -1) return false;
+    if (pipe2(outpipe, O_CLOEXEC) == -1) { close(inpipe[0]); close(inpipe[1]); return false; }
     
+    // Built before fork(): with worker threads the child may only make
+    // async-signal-safe calls until execve(), so it must not allocate
+    std::vector<std::string> envv = buildEnv(resolvedScriptPath);
+    std::vector<char*> envp = makeEnvp(envv);
+    std::vector<char*> argv = makeArgv(effectiveInterpreter, resolvedScriptPath);
+    const char *execPath = effectiveInterpreter.empty() ? resolvedScriptPath.c_str() : effectiveInterpreter.c_str();
+
     cgiPid = fork();
     if (cgiPid == -1) {
         close(inpipe[0]); close(inpipe[1]); close(outpipe[0]); close(outpipe[1]);
@@ -359,12 +380,8 @@ bool CGIHandler::startCGI(const std::string &resolvedScriptPath,
         dup2(outpipe[1], STDOUT_FILENO);
         dup2(outpipe[1], STDERR_FILENO);
         close(inpipe[1]); close(outpipe[0]);
+        signal(SIGPIPE, SIG_DFL); // The server ignores it; exec would keep that
         
-        std::vector<std::string> envv = buildEnv(resolvedScriptPath);
-        std::vector<char*> envp = makeEnvp(envv);
-        std::vector<char*> argv = makeArgv(effectiveInterpreter, resolvedScriptPath);
-        
-        const char *execPath = effectiveInterpreter.empty() ? resolvedScriptPath.c_str() : effectiveInterpreter.c_str();
         execve(execPath, &argv[0], &envp[0]);
         _exit(127);
     }
@@ -395,38 +412,24 @@ bool CGIHandler::startCGI(const std::string &resolvedScriptPath,
     startTime = time(NULL);
     cgiStarted = true;
     
-    std::cout << "[CGI] Started CGI process (pid=" << cgiPid << ", fd=" << cgiOutputFd << ")" << std::endl;
+    LOG_DEBUG("Started CGI process (pid=" << cgiPid << ", fd=" << cgiOutputFd << ")");
     return true;
 }
 
 int CGIHandler::processCGIOutput() {
     if (!cgiStarted || cgiOutputFd < 0) return -1;
     
-    // Check timeout
-    if (hasTimedOut()) {
-        std::cout << "[CGI] Timeout reached for pid " << cgiPid << std::endl;
-        killCGI();
-        asyncResult.status_code = 504;
-        asyncResult.status_text = "Gateway Timeout";
-        asyncResult.body = "<html><head><title>504 Gateway Timeout</title></head>"
-                          "<body><h1>504 Gateway Timeout</h1>"
-                          "<p>The CGI script took too long to respond.</p></body></html>";
-        asyncResult.headers["Content-Type"] = "text/html; charset=utf-8";
-        asyncResult.ok = false;
-        return -1;
-    }
-    
     // Try to read available data
     char buf[4096];
     ssize_t r = read(cgiOutputFd, buf, sizeof(buf));
     
     if (r > 0) {
         cgiBuffer.append(buf, r);
-        std::cout << "[CGI] Read " << r << " bytes from CGI (pid=" << cgiPid << ")" << std::endl;
+        LOG_DEBUG("Read " << r << " bytes from CGI (pid=" << cgiPid << ")");
         return 1; // Still reading
     } else if (r == 0) {
         // EOF - CGI finished
-        std::cout << "[CGI] CGI process finished (pid=" << cgiPid << ")" << std::endl;
+        LOG_DEBUG("CGI process finished (pid=" << cgiPid << ")");
         close(cgiOutputFd);
         cgiOutputFd = -1;
         
@@ -457,14 +460,22 @@ CGIHandler::Result CGIHandler::getResult() const {
     return asyncResult;
 }
 
-bool CGIHandler::hasTimedOut() const {
-    if (!cgiStarted) return false;
-    return (time(NULL) - startTime) > CGI_TIMEOUT;
+int CGIHandler::abortOnTimeout() {
+    LOG_WARN("CGI timeout reached for pid " << cgiPid);
+    killCGI();
+    asyncResult.status_code = 504;
+    asyncResult.status_text = "Gateway Timeout";
+    asyncResult.body = "<html><head><title>504 Gateway Timeout</title></head>"
+                      "<body><h1>504 Gateway Timeout</h1>"
+                      "<p>The CGI script took too long to respond.</p></body></html>";
+    asyncResult.headers["Content-Type"] = "text/html; charset=utf-8";
+    asyncResult.ok = false;
+    return -1;
 }
 
 void CGIHandler::killCGI() {
     if (cgiPid > 0) {
-        std::cout << "[CGI] Killing CGI process " << cgiPid << std::endl;
+        LOG_DEBUG("Killing CGI process " << cgiPid);
         kill(cgiPid, SIGKILL);
         waitpid(cgiPid, NULL, 0);
         cgiPid = -1;
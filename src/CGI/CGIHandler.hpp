@@ -13,7 +13,7 @@
  * - Fork and exec interpreter or direct script
  * - Write request body to child stdin (POST)
  * - Read stdout from child and parse CGI headers/body
- * - Enforce a simple timeout
+ * - Abort on timeout (the deadline itself is kept by the event loop)
  */
 class CGIHandler {
 public:
@@ -51,8 +51,9 @@ public:
     // Get CGI process ID
     pid_t getCGIPid() const { return cgiPid; }
     
-    // Check if CGI has timed out
-    bool hasTimedOut() const;
+    // Kill a CGI whose deadline passed and turn the result into a 504
+    // Returns -1, like processCGIOutput() on failure
+    int abortOnTimeout();
     
     // Kill CGI process and clean up
     void killCGI();
@@ -70,7 +71,6 @@ private:
     std::string resolvedScript;
     std::string interpreter;
     bool cgiStarted;
-    static const int CGI_TIMEOUT = 5; // 5 seconds
     
     Result asyncResult;
 
@@ -1,4 +1,75 @@
 #include "ConfigParser.hpp"
+#include <unistd.h>
+
+// Parses open_file_cache_valid: whole seconds, 0..86400
+static int parseCacheValidity(const std::string& value, int& seconds) {
+    for (size_t i = 0; i < value.length(); i++) {
+        if (!isdigit(value[i])) {
+            std::cerr << "Error: open_file_cache_valid must be a number of seconds: " << value << std::endl;
+            return -1;
+        }
+    }
+    long n = std::atol(value.c_str());
+    if (value.empty() || value.length() > 5 || n > 86400) {
+        std::cerr << "Error: open_file_cache_valid must be between 0 and 86400 seconds: " << value << std::endl;
+        return -1;
+    }
+    seconds = static_cast<int>(n);
+    return 0;
+}
+
+// Parses expires: "off", "max" (ten years) or N with an optional s/m/h/d suffix
+static int parseExpires(const std::string& value, long& seconds) {
+    if (value == "off") {
+        seconds = -1;
+        return 0;
+    }
+    if (value == "max") {
+        seconds = 315360000;
+        return 0;
+    }
+    size_t digits = 0;
+    while (digits < value.length() && isdigit(value[digits]))
+        digits++;
+    std::string unit = value.substr(digits);
+    long scale = 0;
+    if (unit.empty() || unit == "s") scale = 1;
+    else if (unit == "m") scale = 60;
+    else if (unit == "h") scale = 3600;
+    else if (unit == "d") scale = 86400;
+    long n = std::atol(value.substr(0, digits).c_str());
+    if (digits == 0 || digits > 9 || scale == 0 || n * scale > 315360000) {
+        std::cerr << "Error: expires must be off, max or a duration up to 3650d: " << value << std::endl;
+        return -1;
+    }
+    seconds = n * scale;
+    return 0;
+}
+
+// Parses a byte count with an optional k or m suffix (0 allowed)
+static int parseByteSize(const std::string& key, const std::string& value, size_t& bytes) {
+    size_t digits = 0;
+    while (digits < value.length() && isdigit(value[digits]))
+        digits++;
+    std::string suffix = value.substr(digits);
+    size_t unit = 1;
+    if (suffix == "k" || suffix == "K")
+        unit = 1024;
+    else if (suffix == "m" || suffix == "M")
+        unit = 1024 * 1024;
+    else if (!suffix.empty())
+        digits = 0;
+    if (digits == 0 || digits > 9) {
+        std::cerr << "Error: " << key << " must be a byte count (optionally with k or m): " << value << std::endl;
+        return -1;
+    }
+    bytes = static_cast<size_t>(std::atol(value.substr(0, digits).c_str())) * unit;
+    return 0;
+}
+
+static bool isOn(const std::string& value) {
+    return value == "true" || value == "1" || value == "on";
+}
 
 int ConfigParser::parseServerKeyValue(const std::string& key, const std::string& value, Config::ServerConfig& server) {
     if (value.find('"') != std::string::npos) {
@@ -70,6 +141,20 @@ int ConfigParser::parseServerKeyValue(const std::string& key, const std::string&
             return -1;
         }
     }
+    else if (key == "listen_backlog") {
+        for (size_t i = 0; i < value.length(); i++) {
+            if (!isdigit(value[i])) {
+                std::cerr << "Error: listen_backlog must be a valid integer: " << value << std::endl;
+                return -1;
+            }
+        }
+        int backlog = std::atoi(value.c_str());
+        if (value.empty() || backlog <= 0 || backlog > 65535) {
+            std::cerr << "Error: listen_backlog must be between 1 and 65535: " << value << std::endl;
+            return -1;
+        }
+        server.listen_backlog = backlog;
+    }
     else if (key == "default_server") {
         if (server.default_server != false) {
             std::cerr << "Error: Duplicate key 'default_server' detected" << std::endl;
@@ -77,6 +162,26 @@ int ConfigParser::parseServerKeyValue(const std::string& key, const std::string&
         }
         server.default_server = (value == "true" || value == "1" || value == "on");
     }
+    else if (key == "open_file_cache") {
+        for (size_t i = 0; i < value.length(); i++) {
+            if (!isdigit(value[i])) {
+                std::cerr << "Error: open_file_cache must be a number of entries: " << value << std::endl;
+                return -1;
+            }
+        }
+        long entries = std::atol(value.c_str());
+        if (value.empty() || value.length() > 7) {
+            std::cerr << "Error: open_file_cache must be between 0 and 9999999: " << value << std::endl;
+            return -1;
+        }
+        server.open_file_cache = static_cast<size_t>(entries);
+    }
+    else if (key == "open_file_cache_valid") {
+        return parseCacheValidity(value, server.open_file_cache_valid);
+    }
+    else if (key == "open_file_cache_errors") {
+        server.open_file_cache_errors = isOn(value);
+    }
     return 0;
 }
 
@@ -192,6 +297,140 @@ int ConfigParser::parseRouteKeyValue(const std::string& key, const std::string&
         }
         route.upload_enabled =  (value == "true" ? true : false);
     }
+    else if (key == "open_file_cache_valid") {
+        return parseCacheValidity(value, route.open_file_cache_valid);
+    }
+    else if (key == "open_file_cache_errors") {
+        route.open_file_cache_errors = isOn(value) ? 1 : 0;
+    }
+    else if (key == "expires") {
+        return parseExpires(value, route.expires);
+    }
+    else if (key == "cache_control") {
+        route.cache_control = value;
+    }
+    else if (key == "precompressed") {
+        route.precompressed = isOn(value);
+    }
+    else if (key == "gzip") {
+        route.gzip = isOn(value);
+    }
+    else if (key == "gzip_min_length") {
+        return parseByteSize(key, value, route.gzip_min_length);
+    }
+    else if (key == "gzip_types") {
+        route.gzip_types.clear();
+        std::istringstream iss(value);
+        std::string type;
+        while (iss >> type) {
+            for (size_t i = 0; i < type.size(); ++i)
+                type[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(type[i])));
+            route.gzip_types.push_back(type);
+        }
+    }
+    return 0;
+}
+
+// Parses "N" (1..1024) or "auto" (one per online CPU)
+static int parseWorkerCount(const std::string& key, const std::string& value, size_t& count) {
+    if (value == "auto") {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = (cpus > 0) ? static_cast<size_t>(cpus) : 1;
+        return 0;
+    }
+    for (size_t i = 0; i < value.length(); i++) {
+        if (!isdigit(value[i])) {
+            std::cerr << "Error: " << key << " must be a positive integer or 'auto': " << value << std::endl;
+            return -1;
+        }
+    }
+    int n = std::atoi(value.c_str());
+    if (value.empty() || n <= 0 || n > 1024) {
+        std::cerr << "Error: " << key << " must be between 1 and 1024: " << value << std::endl;
+        return -1;
+    }
+    count = static_cast<size_t>(n);
+    return 0;
+}
+
+// Parses a timeout in whole seconds (1..86400)
+static int parseTimeoutSeconds(const std::string& key, const std::string& value, size_t& seconds) {
+    for (size_t i = 0; i < value.length(); i++) {
+        if (!isdigit(value[i])) {
+            std::cerr << "Error: " << key << " must be a number of seconds: " << value << std::endl;
+            return -1;
+        }
+    }
+    long n = std::atol(value.c_str());
+    if (value.empty() || n <= 0 || n > 86400) {
+        std::cerr << "Error: " << key << " must be between 1 and 86400 seconds: " << value << std::endl;
+        return -1;
+    }
+    seconds = static_cast<size_t>(n);
+    return 0;
+}
+
+int ConfigParser::parseGlobalKeyValue(const std::string& key, const std::string& value, Config::GlobalConfig& global) {
+    if (value.find('"') != std::string::npos) {
+        std::cerr << "Error: Quotes are not allowed in values: " << key << " = " << value << std::endl;
+        return -1;
+    }
+
+    if (key == "event_backend") {
+        if (value != "epoll" && value != "poll") {
+            std::cerr << "Error: event_backend must be 'epoll' or 'poll': " << value << std::endl;
+            return -1;
+        }
+        global.event_backend = value;
+    }
+    else if (key == "edge_triggered") {
+        global.edge_triggered = (value == "true" || value == "1" || value == "on");
+    }
+    else if (key == "worker_threads") {
+        return parseWorkerCount(key, value, global.worker_threads);
+    }
+    else if (key == "worker_processes") {
+        return parseWorkerCount(key, value, global.worker_processes);
+    }
+    else if (key == "header_timeout") {
+        return parseTimeoutSeconds(key, value, global.header_timeout);
+    }
+    else if (key == "body_timeout") {
+        return parseTimeoutSeconds(key, value, global.body_timeout);
+    }
+    else if (key == "keepalive_timeout") {
+        return parseTimeoutSeconds(key, value, global.keepalive_timeout);
+    }
+    else if (key == "send_timeout") {
+        return parseTimeoutSeconds(key, value, global.send_timeout);
+    }
+    else if (key == "cgi_timeout") {
+        return parseTimeoutSeconds(key, value, global.cgi_timeout);
+    }
+    else if (key == "log_level") {
+        int level = Logger::levelFromName(value);
+        if (level < 0) {
+            std::cerr << "Error: log_level must be debug, info, warn, error or off: " << value << std::endl;
+            return -1;
+        }
+        global.log_level = level;
+    }
+    else if (key == "log_file") {
+        global.log_file = value;
+    }
+    else if (key == "file_cache_size") {
+        return parseByteSize(key, value, global.file_cache_size);
+    }
+    else if (key == "file_cache_max_file") {
+        return parseByteSize(key, value, global.file_cache_max_file);
+    }
+    else if (key == "precompress_build") {
+        global.precompress_build = isOn(value);
+    }
+    else {
+        std::cerr << "Error: Unknown #global directive: " << key << std::endl;
+        return -1;
+    }
     return 0;
 }
 
@@ -207,6 +446,7 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
     Config::RouteConfig* currentRoute = NULL;
     bool isServerSection = false;
     bool isRouteSection = false;
+    bool isGlobalSection = false;
     bool hasRootDirective = false;
 
     while (std::getline(file, line)) {
@@ -220,7 +460,22 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
         }
 
         if (line[0] == '#') {
-            if (line.find("#server") != std::string::npos) {
+            if (line.find("#global") != std::string::npos) {
+                if (currentServer != NULL) {
+                    if (currentRoute != NULL) {
+                        currentServer->routes.push_back(*currentRoute);
+                        delete currentRoute;
+                        currentRoute = NULL;
+                    }
+                    this->config.servers.push_back(*currentServer);
+                    delete currentServer;
+                    currentServer = NULL;
+                }
+                isGlobalSection = true;
+                isServerSection = false;
+                isRouteSection = false;
+            }
+            else if (line.find("#server") != std::string::npos) {
                 if (currentServer != NULL) {
                     if (currentRoute != NULL) {
                         currentServer->routes.push_back(*currentRoute);
@@ -235,9 +490,14 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
                 currentServer->host = "0.0.0.0";
                 currentServer->default_server = false;
                 currentServer->client_max_body_size = 1048576;
+                currentServer->listen_backlog = 511;
+                currentServer->open_file_cache = 0;
+                currentServer->open_file_cache_valid = 60;
+                currentServer->open_file_cache_errors = false;
                 currentServer->root = "/var/www/html";
                 isServerSection = true;
                 isRouteSection = false;
+                isGlobalSection = false;
             }
             else if (line.find("#route") != std::string::npos) { 
                 hasRootDirective = true;
@@ -261,6 +521,13 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
                 currentRoute->redirect_code = 301;
                 currentRoute->cgi_enabled = true;
                 currentRoute->upload_enabled = false;
+                currentRoute->open_file_cache_valid = -1;
+                currentRoute->open_file_cache_errors = -1;
+                currentRoute->expires = -1;
+                currentRoute->precompressed = false;
+                currentRoute->gzip = false;
+                currentRoute->gzip_min_length = 1024;
+                currentRoute->gzip_types = Config::RouteConfig::defaultGzipTypes();
                 if (currentServer && !currentServer->root.empty()) {
                     currentRoute->root = currentServer->root;
                 }
@@ -278,6 +545,7 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
                 
                 isServerSection = false;
                 isRouteSection = true;
+                isGlobalSection = false;
             }
             continue;
         }
@@ -337,7 +605,13 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
             value = value.substr(0, commentPos);
         }
         
-        if (isServerSection && currentServer != NULL) {
+        if (isGlobalSection) {
+            if (parseGlobalKeyValue(key, value, this->config.global) == -1) {
+                std::cerr << "Error parsing global key-value: " << key << " = " << value << std::endl;
+                return -1;
+            }
+        }
+        else if (isServerSection && currentServer != NULL) {
             if(parseServerKeyValue(key, value, *currentServer) == -1) {
                 std::cerr << "Error parsing server key-value: " << key << " = " << value << std::endl;
                 if (currentRoute != NULL) {
@@ -416,9 +690,14 @@ int ConfigParser::parseConfigFile(const std::string& filename) {
     }
     
     file.close();
+    this->snapshot = ConfigSnapshot(this->config);
     return 0;
 }
 
-const Config ConfigParser::getConfigs() {
+const Config& ConfigParser::getConfigs() const {
     return this->config;
 }
+
+ConfigSnapshot ConfigParser::getSnapshot() const {
+    return this->snapshot;
+}
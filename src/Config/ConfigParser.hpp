@@ -10,6 +10,8 @@
 #include <cstdlib>
 #include <cctype>
 #include <climits>
+#include "../Log/Logger.hpp"
+#include "ConfigSnapshot.hpp"
 
 
 /**
@@ -39,12 +41,29 @@ struct Config {
         std::vector<std::string> cgi_extensions;   // CGI file extensions
         bool upload_enabled;                       // File upload enabled
         std::string upload_path;                   // Upload directory path
+        int open_file_cache_valid;                 // Overrides the server value (-1 = inherit, 0 = bypass)
+        int open_file_cache_errors;                // Overrides the server value (-1 = inherit)
+        long expires;                              // Static file lifetime in seconds (-1 = off)
+        std::string cache_control;                 // Cache-Control value for static files
+        bool precompressed;                        // Serve .br/.gz sidecars to clients accepting them
+        bool gzip;                                 // Compress generated bodies (CGI, listings, errors) on the fly
+        size_t gzip_min_length;                    // Smaller bodies are sent as they are
+        std::vector<std::string> gzip_types;       // Media types that get compressed
 
         // Iterator typedefs for vector access
         typedef std::vector<std::string>::iterator MethodIterator;
         typedef std::vector<std::string>::const_iterator ConstMethodIterator;
         typedef std::vector<std::string>::iterator CgiExtensionIterator;
         typedef std::vector<std::string>::const_iterator ConstCgiExtensionIterator;
+
+        /**
+         * @brief Media types compressed when gzip_types is not set
+         */
+        static std::vector<std::string> defaultGzipTypes() {
+            static const char* types[] = { "text/html", "text/plain", "text/css", "application/javascript",
+                                           "application/json", "application/xml", "image/svg+xml" };
+            return std::vector<std::string>(types, types + sizeof(types) / sizeof(types[0]));
+        }
     };
 
     /**
@@ -62,6 +81,10 @@ struct Config {
         size_t client_max_body_size;                  // Max request body size
         bool default_server;                          // Default server flag
         bool chunked_transfer;                        // Chunked encoding support
+        int listen_backlog;                           // listen() backlog for this server's ports
+        size_t open_file_cache;                       // Lookups/descriptors cached per event loop (0 = off)
+        int open_file_cache_valid;                    // Seconds a cached lookup is trusted
+        bool open_file_cache_errors;                  // Also cache lookups that found nothing
         std::vector<RouteConfig> routes;              // Route configurations
 
         // Iterator typedefs for vector access
@@ -75,7 +98,37 @@ struct Config {
     typedef std::map<int, std::string>::const_iterator ConstErrorPagesIterator;
     };
     
+    /**
+     * @brief Process-wide settings from the optional #global section
+     * 
+     * Contains settings that apply to the event loop itself rather than to
+     * a virtual server, such as the readiness backend.
+     */
+    struct GlobalConfig {
+        std::string event_backend;                  // "epoll" or "poll"
+        bool edge_triggered;                        // Edge-triggered client sockets (epoll only)
+        size_t worker_threads;                      // Event loop threads (1 = single-threaded)
+        size_t worker_processes;                    // Pre-forked worker processes (1 = no master)
+        size_t header_timeout;                      // Seconds to receive a complete request head
+        size_t body_timeout;                        // Seconds allowed between two body reads
+        size_t keepalive_timeout;                   // Seconds an idle keep-alive connection is kept
+        size_t send_timeout;                        // Seconds allowed between two response writes
+        size_t cgi_timeout;                         // Seconds a CGI script may run
+        int log_level;                              // Minimum LOG_LEVEL_* written
+        std::string log_file;                       // Log destination (empty = stderr)
+        size_t file_cache_size;                     // Bytes of static files cached per event loop (0 = off)
+        size_t file_cache_max_file;                 // Largest file the cache takes
+        bool precompress_build;                     // Build missing sidecars for precompressed routes at startup
+
+        GlobalConfig() : event_backend("epoll"), edge_triggered(true), worker_threads(1), worker_processes(1),
+                         header_timeout(15), body_timeout(15), keepalive_timeout(15), send_timeout(15),
+                         cgi_timeout(5), log_level(LOG_LEVEL_INFO), log_file(""),
+                         file_cache_size(32 << 20), file_cache_max_file(1 << 20),
+                         precompress_build(false) {}
+    };
+
     std::vector<ServerConfig> servers;  // All server configurations
+    GlobalConfig global;                // Event loop settings
 
     // Iterator typedefs for server vector access
     typedef std::vector<ServerConfig>::iterator ServerIterator;
@@ -93,8 +146,10 @@ class ConfigParser {
 private:
     Config config;                                              // Parsed configuration data
     std::vector<std::pair<std::string, int> > server_listen_addresses;  // Unique listen addresses
+    std::vector<int> server_listen_backlogs;                            // listen() backlog of each address above
     std::map<std::string, Config::ServerConfig> server_map;     // Server name to config map
     std::map<std::string, Config::RouteConfig> route_map;       // Route path to config map
+    ConfigSnapshot snapshot;                                    // Shared read-only copy, set once parsing succeeds
 
 public:
     /**
@@ -127,6 +182,16 @@ public:
      */
     int parseRouteKeyValue(const std::string& key, const std::string& value, Config::RouteConfig& route);
 
+    /**
+     * @brief Parses #global section key-value pairs
+     * @param key Configuration directive name
+     * @param value Configuration directive value
+     * @param global Reference to global config to populate
+     * @return 0 on success, -1 on error
+     * Handles event_backend, edge_triggered and worker_threads
+     */
+    int parseGlobalKeyValue(const std::string& key, const std::string& value, Config::GlobalConfig& global);
+
     /**
      * @brief Main configuration file parsing function
      * @param filename Path to configuration file
@@ -163,6 +228,13 @@ public:
      */
     std::vector<std::pair<std::string, int> > getServerListenAddresses() const;
 
+    /**
+     * @brief Gets the listen() backlog of each unique listen address
+     * @return Backlogs in the same order as getServerListenAddresses(); an
+     *         address shared by several servers uses the largest backlog
+     */
+    std::vector<int> getServerListenBacklogs() const;
+
     /**
      * @brief Gets server configuration by server name
      * @param server_name Server name to lookup
@@ -187,7 +259,13 @@ public:
      * @brief Gets the complete parsed configuration
      * @return Const reference to parsed configuration structure
      */
-    const Config getConfigs();
+    const Config& getConfigs() const;
+
+    /**
+     * @brief Gets the shared immutable copy of the parsed configuration
+     * @return Snapshot handle (empty until parseConfigFile() succeeds)
+     */
+    ConfigSnapshot getSnapshot() const;
 
     /**
      * @brief Gets the server configuration using the host
@@ -11,11 +11,14 @@ void ConfigParser::initializeServerListenAddresses() {
                 if (server_listen_addresses[k].first == address.first && 
                     server_listen_addresses[k].second == address.second) {
                     isDuplicate = true;
+                    if (server.listen_backlog > server_listen_backlogs[k])
+                        server_listen_backlogs[k] = server.listen_backlog;
                     break;
                 }
             }
             if (!isDuplicate) {
                 this->server_listen_addresses.push_back(address);
+                this->server_listen_backlogs.push_back(server.listen_backlog);
             }
         }
     }
@@ -25,6 +28,10 @@ std::vector<std::pair<std::string, int> > ConfigParser::getServerListenAddresses
     return this->server_listen_addresses;
 }
 
+std::vector<int> ConfigParser::getServerListenBacklogs() const {
+    return this->server_listen_backlogs;
+}
+
 void ConfigParser::printServerListenAddresses(std::vector<std::pair<std::string, int> > server_listen_addresses) {
     std::cout << "Server Listen Addresses:" << std::endl;
     for (size_t i = 0; i < server_listen_addresses.size(); ++i) {
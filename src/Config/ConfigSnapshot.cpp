@@ -0,0 +1,51 @@
+#include "ConfigSnapshot.hpp"
+#include "ConfigParser.hpp"
+#include "VirtualHosts.hpp"
+
+struct ConfigSnapshot::Shared {
+    Config config;
+    VirtualHosts vhosts;    // Points into config
+    int refs;
+};
+
+ConfigSnapshot::ConfigSnapshot() : shared(NULL) {}
+
+ConfigSnapshot::ConfigSnapshot(const Config& config) : shared(new Shared()) {
+    shared->config = config;
+    shared->vhosts.build(shared->config);
+    shared->refs = 1;
+}
+
+ConfigSnapshot::ConfigSnapshot(const ConfigSnapshot& other) : shared(other.shared) {
+    if (shared)
+        __atomic_add_fetch(&shared->refs, 1, __ATOMIC_RELAXED);
+}
+
+ConfigSnapshot& ConfigSnapshot::operator=(const ConfigSnapshot& other) {
+    if (shared != other.shared) {
+        if (other.shared)
+            __atomic_add_fetch(&other.shared->refs, 1, __ATOMIC_RELAXED);
+        release();
+        shared = other.shared;
+    }
+    return *this;
+}
+
+const Config* ConfigSnapshot::get() const {
+    return shared ? &shared->config : NULL;
+}
+
+const VirtualHosts& ConfigSnapshot::vhosts() const {
+    return shared->vhosts;
+}
+
+ConfigSnapshot::~ConfigSnapshot() {
+    release();
+}
+
+void ConfigSnapshot::release() {
+    // Handles may be dropped from different worker threads
+    if (shared && __atomic_sub_fetch(&shared->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        delete shared;
+    shared = NULL;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+struct Config;
+class VirtualHosts;
+
+/**
+ * @brief Shared, read-only handle on a parsed Config
+ *
+ * The configuration is copied once when the snapshot is created, indexed
+ * for virtual host lookup, and never modified afterwards. Copying a handle
+ * only bumps an atomic reference count, so the parser, the listener sets,
+ * every event loop (one per thread) and every request refer to the same
+ * Config by pointer. The Config is freed when the last handle goes away.
+ */
+class ConfigSnapshot {
+public:
+    /**
+     * @brief Constructor - empty handle (get() returns NULL)
+     */
+    ConfigSnapshot();
+
+    /**
+     * @brief Creates a new snapshot holding a copy of a configuration
+     * @param config Fully parsed configuration
+     */
+    explicit ConfigSnapshot(const Config& config);
+
+    ConfigSnapshot(const ConfigSnapshot& other);
+    ConfigSnapshot& operator=(const ConfigSnapshot& other);
+
+    /**
+     * @brief Destructor - frees the Config with the last handle
+     */
+    ~ConfigSnapshot();
+
+    /**
+     * @brief Gets the shared configuration
+     * @return Pointer valid as long as any handle exists, or NULL if empty
+     */
+    const Config* get() const;
+
+    /**
+     * @brief Gets the virtual host index of the configuration
+     * @return Index shared by every handle (the snapshot must not be empty)
+     */
+    const VirtualHosts& vhosts() const;
+
+    const Config& operator*() const { return *get(); }
+    const Config* operator->() const { return get(); }
+
+private:
+    struct Shared;
+
+    Shared* shared;
+
+    void release();
+};
@@ -0,0 +1,98 @@
+#include "RootDirectories.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+
+RootDirectories::RootDirectories() {}
+
+RootDirectories::~RootDirectories() {
+    for (std::map<std::string, int>::iterator it = fds.begin(); it != fds.end(); ++it) {
+        if (it->second >= 0)
+            close(it->second);
+    }
+}
+
+int RootDirectories::open(const std::string& root) {
+    std::map<std::string, int>::iterator it = fds.find(root);
+    if (it != fds.end())
+        return it->second;
+    int fd = ::open(root.empty() ? "." : root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    fds[root] = fd;
+    return fd;
+}
+
+std::string RootDirectories::pathOf(int fd) {
+    char link[64];
+    char path[4096];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(link, path, sizeof(path));
+    if (n <= 0 || static_cast<size_t>(n) >= sizeof(path) || path[0] != '/')
+        return std::string();
+    return std::string(path, static_cast<size_t>(n));
+}
+
+/**
+ * @brief Fallback for kernels before openat2(): open, then check where it landed
+ *
+ * A file that may be created is not checked after the fact: its directory
+ * is opened and checked first, and the last component must not be a
+ * symlink, so nothing is ever created outside the root.
+ */
+static int openChecked(int rootFd, const char* rel, int flags, mode_t mode) {
+    if (flags & O_CREAT) {
+        std::string path(rel);
+        size_t slash = path.rfind('/');
+        std::string parent = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        std::string last = slash == std::string::npos ? path : path.substr(slash + 1);
+        int dirFd = openChecked(rootFd, parent.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC, 0);
+        if (dirFd < 0)
+            return -1;
+        int fd = openat(dirFd, last.c_str(), flags | O_NOFOLLOW, mode);
+        int saved = errno;
+        close(dirFd);
+        errno = saved;
+        return fd;
+    }
+    int fd = openat(rootFd, rel, flags, mode);
+    if (fd < 0)
+        return -1;
+    std::string root = RootDirectories::pathOf(rootFd);
+    std::string path = RootDirectories::pathOf(fd);
+    bool inside = !root.empty() && path.compare(0, root.size(), root) == 0
+                  && (path.size() == root.size() || root == "/" || path[root.size()] == '/');
+    if (!inside) {
+        close(fd);
+        errno = EXDEV;
+        return -1;
+    }
+    return fd;
+}
+
+// Set once openat2() reported ENOSYS; shared by every reactor thread
+static int noOpenat2 = 0;
+
+int RootDirectories::openBeneath(int rootFd, const std::string& relPath, int flags, mode_t mode) {
+    if (rootFd < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    const char* rel = relPath.empty() ? "." : relPath.c_str();
+    if (!__atomic_load_n(&noOpenat2, __ATOMIC_RELAXED)) {
+        struct open_how how;
+        how.flags = static_cast<unsigned long long>(flags);
+        how.mode = (flags & O_CREAT) ? mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        long fd;
+        do {
+            fd = syscall(SYS_openat2, rootFd, rel, &how, sizeof(how));
+        } while (fd < 0 && (errno == EINTR || errno == EAGAIN));
+        if (fd >= 0 || errno != ENOSYS)
+            return static_cast<int>(fd);
+        __atomic_store_n(&noOpenat2, 1, __ATOMIC_RELAXED);
+    }
+    return openChecked(rootFd, rel, flags, mode);
+}
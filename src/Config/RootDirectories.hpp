@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @brief Document roots opened once as directory descriptors
+ *
+ * Request paths are opened relative to these with openat2() and
+ * RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS, so the kernel keeps the whole
+ * lookup (including "..", absolute symlinks and /proc links) inside the
+ * root in the same call that opens the file. Roots are opened when a
+ * configuration is loaded, shared by path, and closed with it.
+ */
+class RootDirectories {
+public:
+    RootDirectories();
+
+    /**
+     * @brief Destructor - closes every root
+     */
+    ~RootDirectories();
+
+    /**
+     * @brief Opens a root, or returns the descriptor it already has
+     * @param root Root directory as configured
+     * @return Directory descriptor, or -1 if the root cannot be opened
+     */
+    int open(const std::string& root);
+
+    /**
+     * @brief Opens a path without leaving a root
+     * @param rootFd Descriptor from open()
+     * @param relPath Path below the root ("" is the root itself)
+     * @param flags open(2) flags
+     * @param mode Permissions when flags has O_CREAT
+     * @return New descriptor, or -1 with errno set (EXDEV/ELOOP on escape)
+     */
+    static int openBeneath(int rootFd, const std::string& relPath, int flags, mode_t mode = 0);
+
+    /**
+     * @brief Gives the absolute path an open descriptor refers to
+     * @return Path from /proc/self/fd, or "" if unknown
+     */
+    static std::string pathOf(int fd);
+
+private:
+    std::map<std::string, int> fds;     // Configured root -> descriptor
+
+    RootDirectories(const RootDirectories&);
+    RootDirectories& operator=(const RootDirectories&);
+};
@@ -0,0 +1,219 @@
+#include "RouteTable.hpp"
+
+static size_t hashBytes(const char* data, size_t len) {
+    // FNV-1a
+    size_t h = static_cast<size_t>(2166136261u);
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= static_cast<size_t>(16777619u);
+    }
+    return h;
+}
+
+static std::string trimTrailingSlash(const std::string& root) {
+    if (!root.empty() && root[root.size() - 1] == '/')
+        return root.substr(0, root.size() - 1);
+    return root;
+}
+
+/* ----------------------------- ExtensionSet ----------------------------- */
+
+ExtensionSet::ExtensionSet() : mask(0), count(0) {}
+
+void ExtensionSet::build(const std::vector<std::string>& extensions) {
+    size_t capacity = 8;
+    while (capacity < extensions.size() * 2)
+        capacity <<= 1;
+    slots.assign(capacity, std::string());
+    mask = capacity - 1;
+    count = 0;
+    for (size_t e = 0; e < extensions.size(); e++) {
+        const std::string& ext = extensions[e];
+        if (ext.empty())
+            continue;
+        for (size_t i = hashBytes(ext.data(), ext.size()) & mask;; i = (i + 1) & mask) {
+            if (slots[i].empty()) {
+                slots[i] = ext;
+                count++;
+                break;
+            }
+            if (slots[i] == ext)
+                break;
+        }
+    }
+}
+
+bool ExtensionSet::contains(const char* ext, size_t len) const {
+    if (count == 0 || len == 0)
+        return false;
+    for (size_t i = hashBytes(ext, len) & mask;; i = (i + 1) & mask) {
+        const std::string& slot = slots[i];
+        if (slot.empty())
+            return false;
+        if (slot.size() == len && slot.compare(0, len, ext, len) == 0)
+            return true;
+    }
+}
+
+/* ------------------------------ RouteTable ------------------------------ */
+
+RouteTable::RouteTable() : serverRootFd(-1) {}
+
+unsigned int RouteTable::methodBit(const std::string& method) {
+    if (method == "GET") return METHOD_GET;
+    if (method == "POST") return METHOD_POST;
+    if (method == "DELETE") return METHOD_DELETE;
+    if (method == "HEAD") return METHOD_HEAD;
+    if (method == "PUT") return METHOD_PUT;
+    if (method == "PATCH") return METHOD_PATCH;
+    if (method == "OPTIONS") return METHOD_OPTIONS;
+    return 0;
+}
+
+void RouteTable::build(const Config::ServerConfig& server, RootDirectories& roots) {
+    nodes.clear();
+    routes.clear();
+    nodes.push_back(Node());
+    nodes[0].route = -1;
+    serverRoot = server.root;
+    serverRootBase = trimTrailingSlash(server.root);
+    serverRootFd = roots.open(server.root);
+
+    routes.reserve(server.routes.size());
+    for (size_t i = 0; i < server.routes.size(); i++) {
+        const Config::RouteConfig& config = server.routes[i];
+        if (config.path.empty())
+            continue;
+        routes.push_back(CompiledRoute());
+        CompiledRoute& route = routes.back();
+        route.config = &config;
+        route.methods = 0;
+        for (size_t m = 0; m < config.accepted_methods.size(); m++)
+            route.methods |= methodBit(config.accepted_methods[m]);
+        // A route that serves GET answers HEAD the same way, without the body
+        if (route.methods & METHOD_GET)
+            route.methods |= METHOD_HEAD;
+        route.root = config.root.empty() ? server.root : config.root;
+        route.rootBase = trimTrailingSlash(route.root);
+        route.rootFd = roots.open(route.root);
+        if (config.cgi_enabled)
+            route.cgiExtensions.build(config.cgi_extensions);
+        insert(config.path, static_cast<int>(routes.size() - 1));
+    }
+}
+
+void RouteTable::insert(const std::string& path, int route) {
+    size_t node = 0;
+    size_t pos = 0;
+    for (;;) {
+        if (pos == path.size()) {
+            // Duplicate paths: the first route keeps the slot
+            if (nodes[node].route < 0)
+                nodes[node].route = route;
+            return;
+        }
+        size_t child = 0;
+        bool found = false;
+        for (size_t c = 0; c < nodes[node].children.size(); c++) {
+            child = nodes[node].children[c];
+            if (nodes[child].label[0] == path[pos]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            Node leaf;
+            leaf.label = path.substr(pos);
+            leaf.route = route;
+            nodes.push_back(leaf);
+            nodes[node].children.push_back(nodes.size() - 1);
+            return;
+        }
+
+        size_t common = 0;
+        const std::string& label = nodes[child].label;
+        while (common < label.size() && pos + common < path.size()
+               && label[common] == path[pos + common])
+            common++;
+        if (common < label.size()) {
+            // The new path leaves the edge midway: split it at the fork
+            Node mid;
+            mid.label = label.substr(0, common);
+            mid.route = -1;
+            mid.children.push_back(child);
+            nodes[child].label.erase(0, common);
+            nodes.push_back(mid);
+            size_t midIndex = nodes.size() - 1;
+            std::vector<size_t>& siblings = nodes[node].children;
+            for (size_t c = 0; c < siblings.size(); c++) {
+                if (siblings[c] == child)
+                    siblings[c] = midIndex;
+            }
+            child = midIndex;
+        }
+        node = child;
+        pos += common;
+    }
+}
+
+int RouteTable::match(const std::string& path) const {
+    int best = -1;
+    size_t node = 0;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        const Node& current = nodes[node];
+        size_t next = 0;
+        bool found = false;
+        for (size_t c = 0; c < current.children.size(); c++) {
+            next = current.children[c];
+            if (nodes[next].label[0] == path[pos]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+        const std::string& label = nodes[next].label;
+        if (path.compare(pos, label.size(), label) != 0)
+            break;
+        pos += label.size();
+        node = next;
+        if (nodes[node].route >= 0)
+            best = nodes[node].route;
+    }
+    return best;
+}
+
+void RouteTable::resolve(const std::string& path, const std::string& method, RouteContext& ctx) const {
+    int index = nodes.empty() ? -1 : match(path);
+    const CompiledRoute* route = index < 0 ? NULL : &routes[index];
+    size_t suffix = 0;
+
+    ctx.isCgi = false;
+    if (route) {
+        ctx.route = route->config;
+        ctx.root = route->root;
+        ctx.fsPath = route->rootBase;
+        ctx.rootFd = route->rootFd;
+        ctx.methodAllowed = (route->methods & methodBit(method)) != 0;
+        suffix = route->config->path.size();
+    } else {
+        ctx.route = NULL;
+        ctx.root = serverRoot;
+        ctx.fsPath = serverRootBase;
+        ctx.rootFd = serverRootFd;
+        ctx.methodAllowed = true;
+    }
+    if (suffix < path.size() && path[suffix] != '/')
+        ctx.fsPath += '/';
+    ctx.relStart = ctx.fsPath.size();
+    ctx.fsPath.append(path, suffix, std::string::npos);
+    while (ctx.relStart < ctx.fsPath.size() && ctx.fsPath[ctx.relStart] == '/')
+        ctx.relStart++;
+
+    if (route && !route->cgiExtensions.empty()) {
+        size_t dot = ctx.fsPath.find_last_of("./");
+        if (dot != std::string::npos && ctx.fsPath[dot] == '.')
+            ctx.isCgi = route->cgiExtensions.contains(ctx.fsPath.data() + dot, ctx.fsPath.size() - dot);
+    }
+}
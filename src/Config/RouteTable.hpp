@@ -0,0 +1,137 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "ConfigParser.hpp"
+#include "RootDirectories.hpp"
+
+/**
+ * @brief Set of file extensions (".py", ".php", ...) with O(1) lookups
+ *
+ * Open-addressing hash table sized once at build time; lookups take a
+ * pointer and length so the extension never has to be copied out of the
+ * request path.
+ */
+class ExtensionSet {
+public:
+    ExtensionSet();
+
+    /**
+     * @brief Builds the set
+     * @param extensions Extensions including the leading dot
+     */
+    void build(const std::vector<std::string>& extensions);
+
+    /**
+     * @brief Looks an extension up
+     * @param ext First byte of the extension (the dot)
+     * @param len Extension length
+     * @return true if the extension is in the set
+     */
+    bool contains(const char* ext, size_t len) const;
+
+    bool empty() const { return count == 0; }
+
+private:
+    std::vector<std::string> slots;     // Empty string marks a free slot
+    size_t mask;                        // slots.size() - 1
+    size_t count;
+};
+
+/**
+ * @brief Bit of each HTTP method in a route's accepted-method mask
+ */
+enum MethodBit {
+    METHOD_GET = 1 << 0,
+    METHOD_POST = 1 << 1,
+    METHOD_DELETE = 1 << 2,
+    METHOD_HEAD = 1 << 3,
+    METHOD_PUT = 1 << 4,
+    METHOD_PATCH = 1 << 5,
+    METHOD_OPTIONS = 1 << 6
+};
+
+/**
+ * @brief Where a request lands once routed; filled once per request
+ */
+struct RouteContext {
+    const Config::RouteConfig* route;   // Longest-prefix route, NULL if none matched
+    std::string root;                   // Route root, else the server root
+    std::string fsPath;                 // root + path after the route prefix
+    int rootFd;                         // Open root, for RootDirectories::openBeneath()
+    size_t relStart;                    // Where the part below the root starts in fsPath
+    bool methodAllowed;                 // Method is in the route's accepted_methods
+    bool isCgi;                         // CGI enabled and the extension is registered
+
+    RouteContext() : route(NULL), rootFd(-1), relStart(0), methodAllowed(true), isCgi(false) {}
+
+    /**
+     * @brief Gives fsPath relative to the root (no leading '/')
+     */
+    std::string relPath() const { return fsPath.substr(relStart); }
+};
+
+/**
+ * @brief Routes of one server compiled into a radix trie
+ *
+ * Route paths are stored as a compressed prefix tree keyed on raw bytes,
+ * so the longest matching prefix is found in a single walk over the
+ * request path whatever the number of routes. Each route carries its
+ * accepted methods as a bitmask and its CGI extensions as a hash set.
+ * Built once per configuration; entries point into the ServerConfig.
+ */
+class RouteTable {
+public:
+    RouteTable();
+
+    /**
+     * @brief Compiles every route of a server
+     * @param server Server configuration; must outlive the table
+     * @param roots Opens the root directories; must outlive the table
+     */
+    void build(const Config::ServerConfig& server, RootDirectories& roots);
+
+    /**
+     * @brief Routes a request
+     * @param path Request path (without query string)
+     * @param method Request method
+     * @param ctx Receives the route, filesystem path and flags
+     *
+     * An empty accepted_methods list allows nothing; a path no route
+     * matches is served from the server root with every method allowed.
+     */
+    void resolve(const std::string& path, const std::string& method, RouteContext& ctx) const;
+
+    /**
+     * @brief Maps a method name to its MethodBit
+     * @param method Method name (case-sensitive)
+     * @return The bit, or 0 for an unknown method
+     */
+    static unsigned int methodBit(const std::string& method);
+
+private:
+    struct CompiledRoute {
+        const Config::RouteConfig* config;
+        unsigned int methods;           // MethodBit mask of accepted_methods
+        std::string root;               // Effective root
+        std::string rootBase;           // root without its trailing '/'
+        int rootFd;                     // root opened as a directory
+        ExtensionSet cgiExtensions;     // Empty unless cgi_enabled
+    };
+
+    struct Node {
+        std::string label;              // Bytes on the edge into this node
+        std::vector<size_t> children;   // Node indices; first label bytes differ
+        int route;                      // Route ending here, -1 if none
+    };
+
+    std::vector<Node> nodes;            // nodes[0] is the root
+    std::vector<CompiledRoute> routes;
+    std::string serverRoot;
+    std::string serverRootBase;
+    int serverRootFd;
+
+    void insert(const std::string& path, int route);
+    int match(const std::string& path) const;
+};
@@ -0,0 +1,104 @@
+#include "VirtualHosts.hpp"
+#include "../HTTP/Utils.hpp"
+
+VirtualHosts::VirtualHosts() : mask(0), fallback(NULL) {}
+
+size_t VirtualHosts::hashKey(int port, const std::string& host) {
+    // FNV-1a over the port bytes followed by the host name
+    size_t h = static_cast<size_t>(2166136261u);
+    unsigned int p = static_cast<unsigned int>(port);
+    for (int i = 0; i < 4; i++) {
+        h ^= (p >> (i * 8)) & 0xff;
+        h *= static_cast<size_t>(16777619u);
+    }
+    for (size_t i = 0; i < host.size(); i++) {
+        h ^= static_cast<unsigned char>(host[i]);
+        h *= static_cast<size_t>(16777619u);
+    }
+    return h;
+}
+
+void VirtualHosts::build(const Config& config) {
+    // Every key is inserted once per port: names, the bind address and the
+    // per-port default. Sizing for at most 50% load keeps probe runs short.
+    size_t keys = 0;
+    for (size_t i = 0; i < config.servers.size(); i++) {
+        const Config::ServerConfig& server = config.servers[i];
+        keys += server.ports.size() * (server.server_names.size() + 2);
+    }
+    size_t capacity = 16;
+    while (capacity < keys * 2)
+        capacity <<= 1;
+    Entry empty;
+    empty.hash = 0;
+    empty.port = 0;
+    empty.server = NULL;
+    slots.assign(capacity, empty);
+    mask = capacity - 1;
+    fallback = config.servers.empty() ? NULL : &config.servers[0];
+    tables.assign(config.servers.size(), RouteTable());
+    for (size_t i = 0; i < config.servers.size(); i++)
+        tables[i].build(config.servers[i], roots);
+
+    // default_server servers claim their ports before anyone else
+    for (size_t i = 0; i < config.servers.size(); i++) {
+        const Config::ServerConfig& server = config.servers[i];
+        if (!server.default_server)
+            continue;
+        for (size_t p = 0; p < server.ports.size(); p++)
+            insert(server.ports[p], "", &server);
+    }
+    // Earlier servers win on duplicate keys, as in the old linear search
+    for (size_t i = 0; i < config.servers.size(); i++) {
+        const Config::ServerConfig& server = config.servers[i];
+        for (size_t p = 0; p < server.ports.size(); p++) {
+            int port = server.ports[p];
+            for (size_t n = 0; n < server.server_names.size(); n++) {
+                std::string name = server.server_names[n];
+                insert(port, stringToLower(name), &server);
+            }
+            insert(port, server.host, &server);
+            insert(port, "", &server);
+        }
+    }
+}
+
+void VirtualHosts::insert(int port, const std::string& host, const Config::ServerConfig* server) {
+    size_t hash = hashKey(port, host);
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry& entry = slots[i];
+        if (!entry.server) {
+            entry.hash = hash;
+            entry.port = port;
+            entry.host = host;
+            entry.server = server;
+            return;
+        }
+        if (entry.hash == hash && entry.port == port && entry.host == host)
+            return;
+    }
+}
+
+const Config::ServerConfig* VirtualHosts::find(int port, const std::string& host) const {
+    if (slots.empty())
+        return NULL;
+    size_t hash = hashKey(port, host);
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Entry& entry = slots[i];
+        if (!entry.server)
+            return NULL;
+        if (entry.hash == hash && entry.port == port && entry.host == host)
+            return entry.server;
+    }
+}
+
+const Config::ServerConfig* VirtualHosts::resolve(int port, const std::string& host) const {
+    const Config::ServerConfig* server = find(port, host);
+    if (!server)
+        server = find(port, "");
+    return server ? server : fallback;
+}
+
+const RouteTable& VirtualHosts::routes(const Config::ServerConfig* server) const {
+    return tables[static_cast<size_t>(server - fallback)];
+}
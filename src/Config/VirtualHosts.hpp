@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "ConfigParser.hpp"
+#include "RouteTable.hpp"
+
+/**
+ * @brief Name-based virtual host index, built once per configuration
+ *
+ * Maps (local port, lowercase host) to the server that answers it using an
+ * open-addressing hash table, so resolving a request costs one hash and a
+ * few probes however many server_name entries there are. Each port also
+ * gets a precomputed default server (the default_server one, else the
+ * first server listening there), stored under the empty host name.
+ * The compiled RouteTable of every server is kept alongside, with the
+ * document roots opened as directories. Entries point into the Config the
+ * index was built from, which must not change or move afterwards.
+ */
+class VirtualHosts {
+public:
+    VirtualHosts();
+
+    /**
+     * @brief Indexes every server name, host address and port default
+     * @param config Configuration to index; must outlive the index
+     */
+    void build(const Config& config);
+
+    /**
+     * @brief Finds the server answering a request
+     * @param port Local port the connection was accepted on
+     * @param host Lowercase host from the Host header, without port
+     * @return Exact match, else the port's default server, else the first
+     *         server of the configuration (NULL only if there are no servers)
+     */
+    const Config::ServerConfig* resolve(int port, const std::string& host) const;
+
+    /**
+     * @brief Gives the compiled routes of a server
+     * @param server A server returned by resolve()
+     * @return Route table built for that server
+     */
+    const RouteTable& routes(const Config::ServerConfig* server) const;
+
+private:
+    struct Entry {
+        size_t hash;                        // Cached hash of (port, host)
+        int port;
+        std::string host;
+        const Config::ServerConfig* server; // NULL marks a free slot
+    };
+
+    std::vector<Entry> slots;               // Power-of-two sized, linear probing
+    size_t mask;                            // slots.size() - 1
+    const Config::ServerConfig* fallback;   // First server of the configuration
+    std::vector<RouteTable> tables;         // One per server, in configuration order
+    RootDirectories roots;                  // Every root the tables open beneath
+
+    static size_t hashKey(int port, const std::string& host);
+    void insert(int port, const std::string& host, const Config::ServerConfig* server);
+    const Config::ServerConfig* find(int port, const std::string& host) const;
+};
@@ -0,0 +1,60 @@
+#include "Arena.hpp"
+
+Arena::Arena() : first(NULL), current(NULL), offset(0), large(NULL) {}
+
+Arena::~Arena() {
+    freeChain(first);
+    freeChain(large);
+}
+
+Arena::Block* Arena::newBlock(size_t size) {
+    Block* block = new Block;
+    block->next = NULL;
+    block->data = new char[size];
+    return block;
+}
+
+void Arena::freeChain(Block* block) {
+    while (block) {
+        Block* next = block->next;
+        delete[] block->data;
+        delete block;
+        block = next;
+    }
+}
+
+void* Arena::allocate(size_t bytes) {
+    bytes = (bytes + ALIGN - 1) & ~(ALIGN - 1);
+    if (bytes > BLOCK_SIZE / 4) {
+        Block* block = newBlock(bytes);
+        block->next = large;
+        large = block;
+        return block->data;
+    }
+    if (!current || offset + bytes > BLOCK_SIZE) {
+        // Step to the next kept block, growing the chain only when needed
+        if (current && current->next) {
+            current = current->next;
+        } else {
+            Block* block = newBlock(BLOCK_SIZE);
+            if (current)
+                current->next = block;
+            else
+                first = block;
+            current = block;
+        }
+        offset = 0;
+    }
+    void* p = current->data + offset;
+    offset += bytes;
+    return p;
+}
+
+void Arena::reset() {
+    current = first;
+    offset = 0;
+    if (large) {
+        freeChain(large);
+        large = NULL;
+    }
+}
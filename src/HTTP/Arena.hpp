@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+/**
+ * @brief Bump allocator for data that lives exactly as long as one request
+ *
+ * Memory comes from a chain of fixed-size blocks; allocate() advances a
+ * pointer and deallocation is a no-op. reset() rewinds to the first block
+ * in O(1) and keeps the chain, so a keep-alive connection stops calling
+ * malloc once it has seen its largest request. Requests bigger than a
+ * quarter block get a dedicated allocation, freed on reset().
+ */
+class Arena {
+public:
+    static const size_t BLOCK_SIZE = 4096;      // Usable bytes per block
+
+    Arena();
+
+    /**
+     * @brief Destructor - frees every block
+     */
+    ~Arena();
+
+    /**
+     * @brief Carves memory out of the current block
+     * @param bytes Size wanted (rounded up to the platform alignment)
+     * @return Suitably aligned storage, valid until reset()
+     */
+    void* allocate(size_t bytes);
+
+    /**
+     * @brief Makes all memory handed out so far reusable
+     */
+    void reset();
+
+private:
+    struct Block {
+        Block* next;
+        char* data;
+    };
+
+    static const size_t ALIGN = 2 * sizeof(void*);
+
+    Block* first;           // Chain kept across reset()
+    Block* current;         // Block being filled
+    size_t offset;          // Bytes used in current
+    Block* large;           // Oversized allocations, freed by reset()
+
+    static Block* newBlock(size_t size);
+    static void freeChain(Block* block);
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+};
+
+/**
+ * @brief Standard allocator that draws from an Arena
+ *
+ * Lets node-based containers (std::map, std::list) place their nodes in
+ * the request arena. deallocate() does nothing; the memory comes back when
+ * the arena is reset. A default-constructed allocator has no arena and
+ * falls back to operator new/delete.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T               value_type;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef size_t          size_type;
+    typedef ptrdiff_t       difference_type;
+
+    template <typename U>
+    struct rebind { typedef ArenaAllocator<U> other; };
+
+    Arena* arena;
+
+    ArenaAllocator() : arena(NULL) {}
+    explicit ArenaAllocator(Arena* arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    pointer allocate(size_type n, const void* = 0) {
+        if (!arena)
+            return static_cast<pointer>(::operator new(n * sizeof(T)));
+        return static_cast<pointer>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type) {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+    void construct(pointer p, const T& value) { new (static_cast<void*>(p)) T(value); }
+    void destroy(pointer p) { p->~T(); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
+
+/**
+ * @brief String whose characters live in an Arena once it outgrows the
+ * inline buffer (constructed with a default allocator it uses the heap)
+ */
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
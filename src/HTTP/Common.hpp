@@ -1,10 +1,16 @@
 #pragma once
 
 #include <string>
+#include <sys/types.h>
 
 // Full definition of FilePart
 struct FilePart {
     std::string filename;
     std::string content_type;
-    std::string content;
+    std::string content;    // Part body, unless it was streamed to fd
+    int fd;                 // Temporary file holding the body (-1 = in content); owned by the request
+    std::string tmpName;    // Name of fd in the upload directory, "" for an unnamed O_TMPFILE
+    off_t size;             // Bytes written to fd
+
+    FilePart() : fd(-1), size(0) {}
 };
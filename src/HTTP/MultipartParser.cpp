@@ -0,0 +1,406 @@
+#include "MultipartParser.hpp"
+#include "Utils.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char* BAD_BODY = "400 Bad Request";
+static const char* WRITE_FAILED = "500 Internal Server Error";
+static const char* NO_SPACE = "507 Insufficient Storage";
+
+MultipartParser::MultipartParser()
+    : state(MP_PREAMBLE), matched(0), headerBytes(0), dirFd(-1), bodyLength(0), consumed(0),
+      partLength(0), reserved(0), errorCode(BAD_BODY) {
+    current.fd = -1;
+    current.size = 0;
+}
+
+MultipartParser::~MultipartParser() {
+    reset();
+}
+
+void MultipartParser::start(const std::string& boundary, int dirFd, size_t length) {
+    reset();
+    this->dirFd = dirFd;
+    bodyLength = length;
+    delimiter = "\r\n--" + boundary;
+    size_t m = delimiter.size();
+    for (size_t c = 0; c < 256; c++)
+        skip[c] = m;
+    for (size_t j = 0; j + 1 < m; j++)
+        skip[static_cast<unsigned char>(delimiter[j])] = m - 1 - j;
+    // The body opens with "--boundary": act as if its CRLF was already seen
+    matched = 2;
+}
+
+void MultipartParser::closePart(Part& part) {
+    if (part.fd >= 0) {
+        // A named file renamed into place is left alone; checking the inode
+        // keeps a name reused since then by another upload from going too
+        struct stat own;
+        struct stat named;
+        if (!part.tmpName.empty() && fstat(part.fd, &own) == 0
+            && fstatat(dirFd, part.tmpName.c_str(), &named, AT_SYMLINK_NOFOLLOW) == 0
+            && named.st_dev == own.st_dev && named.st_ino == own.st_ino)
+            unlinkat(dirFd, part.tmpName.c_str(), 0);
+        close(part.fd);
+    }
+    part.fd = -1;
+}
+
+void MultipartParser::reset() {
+    // Unnamed temporary files vanish with their last descriptor, named
+    // ones are unlinked; the directory is needed until then
+    closePart(current);
+    for (size_t i = 0; i < done.size(); i++)
+        closePart(done[i]);
+    done.clear();
+    current = Part();
+    current.fd = -1;
+    current.size = 0;
+    if (dirFd >= 0)
+        close(dirFd);
+    dirFd = -1;
+    state = MP_PREAMBLE;
+    matched = 0;
+    lineBuf.clear();
+    headerBytes = 0;
+    bodyLength = 0;
+    consumed = 0;
+    partLength = 0;
+    reserved = 0;
+    errorCode = BAD_BODY;
+}
+
+bool MultipartParser::fail(const char* code) {
+    errorCode = code;
+    state = MP_FAILED;
+    return false;
+}
+
+/**
+ * @brief Horspool search for the whole delimiter
+ * @return Offset of the first occurrence, or std::string::npos
+ */
+size_t MultipartParser::search(const char* data, size_t len) const {
+    size_t m = delimiter.size();
+    if (len < m)
+        return std::string::npos;
+    const unsigned char* d = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char last = static_cast<unsigned char>(delimiter[m - 1]);
+    size_t i = 0;
+    while (i <= len - m) {
+        unsigned char c = d[i + m - 1];
+        if (c == last && memcmp(d + i, delimiter.data(), m - 1) == 0)
+            return i;
+        i += skip[c];
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief Passes content on until the next delimiter
+ * @param used Bytes taken, through the delimiter if one was found
+ */
+bool MultipartParser::scanBody(const char* data, size_t len, size_t& used) {
+    size_t m = delimiter.size();
+    used = 0;
+    if (matched > 0) {
+        // Finish the delimiter the previous piece ended with
+        size_t n = m - matched < len ? m - matched : len;
+        if (memcmp(data, delimiter.data() + matched, n) == 0) {
+            matched += n;
+            used = n;
+            if (matched < m)
+                return true;
+            matched = 0;
+            return foundDelimiter();
+        }
+        // It was content; the CR only occurs at the start of the
+        // delimiter, so no later match can begin inside the held bytes
+        size_t held = matched;
+        matched = 0;
+        if (!emit(delimiter.data(), held))
+            return false;
+    }
+
+    size_t at = search(data, len);
+    if (at != std::string::npos) {
+        if (!emit(data, at))
+            return false;
+        used = at + m;
+        return foundDelimiter();
+    }
+
+    // Hold back a tail that may be the start of a delimiter
+    size_t tail = len;
+    size_t from = len > m - 1 ? len - (m - 1) : 0;
+    const char* cr = static_cast<const char*>(memchr(data + from, '\r', len - from));
+    while (cr) {
+        size_t at = static_cast<size_t>(cr - data);
+        if (memcmp(cr, delimiter.data(), len - at) == 0) {
+            tail = at;
+            break;
+        }
+        cr = static_cast<const char*>(memchr(cr + 1, '\r', len - at - 1));
+    }
+    if (!emit(data, tail))
+        return false;
+    matched = len - tail;
+    used = len;
+    return true;
+}
+
+bool MultipartParser::foundDelimiter() {
+    if (state == MP_BODY && !endPart())
+        return false;
+    state = MP_BOUNDARY_TAIL;
+    lineBuf.clear();
+    return true;
+}
+
+/**
+ * @brief Appends content to the current part (dropped in the preamble)
+ */
+bool MultipartParser::emit(const char* data, size_t len) {
+    if (state != MP_BODY || len == 0)
+        return true;
+    if (current.fd < 0) {
+        current.value.append(data, len);
+        return true;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(current.fd, data + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return fail(errno == ENOSPC || errno == EDQUOT ? NO_SPACE : WRITE_FAILED);
+        done += static_cast<size_t>(n);
+    }
+    current.size += static_cast<off_t>(len);
+    return true;
+}
+
+bool MultipartParser::feed(const char* data, size_t len) {
+    size_t start = consumed;
+    consumed += len;
+    size_t used = 0;
+    while (used < len) {
+        if (state == MP_FAILED)
+            return false;
+        if (state == MP_EPILOGUE)
+            return true;
+        if (state == MP_PREAMBLE || state == MP_BODY) {
+            size_t n = 0;
+            if (!scanBody(data + used, len - used, n))
+                return false;
+            used += n;
+            continue;
+        }
+
+        // Delimiter tail and part headers are lines
+        const char* begin = data + used;
+        const char* lf = static_cast<const char*>(memchr(begin, '\n', len - used));
+        size_t take = lf ? static_cast<size_t>(lf - begin) + 1 : len - used;
+        headerBytes += take;
+        if (headerBytes > MAX_HEADERS)
+            return fail(BAD_BODY);
+        used += take;
+        if (!lf) {
+            lineBuf.append(begin, take);
+            continue;
+        }
+        lineBuf.append(begin, take - 1);
+        if (!lineBuf.empty() && lineBuf[lineBuf.size() - 1] == '\r')
+            lineBuf.erase(lineBuf.size() - 1);
+        std::string line;
+        line.swap(lineBuf);
+        // Upper bound for the part that may start here
+        size_t left = bodyLength > start + used ? bodyLength - start - used : 0;
+        if (!handleLine(line.data(), line.size()))
+            return false;
+        if (state == MP_BODY && current.fd >= 0 && reserved == 0) {
+            // A part Content-Length is the client's word; never reserve
+            // more than the rest of the body can hold, nor without a bound
+            off_t hint = static_cast<off_t>(left);
+            if (partLength > 0 && partLength < hint)
+                hint = partLength;
+            if (hint >= PREALLOC_MIN) {
+                if (fallocate(current.fd, FALLOC_FL_KEEP_SIZE, 0, hint) == 0)
+                    reserved = hint;
+                else if (errno == ENOSPC || errno == EDQUOT)
+                    return fail(NO_SPACE);
+            }
+        }
+    }
+    return state != MP_FAILED;
+}
+
+/**
+ * @brief Reads a parameter of a Content-Disposition value (name, filename)
+ */
+static std::string dispositionParam(const std::string& value, const char* key) {
+    size_t keyLen = strlen(key);
+    size_t pos = value.find(';');
+    while (pos != std::string::npos) {
+        size_t b = value.find_first_not_of(" \t", pos + 1);
+        if (b == std::string::npos)
+            break;
+        size_t eq = value.find('=', b);
+        if (eq == std::string::npos)
+            break;
+        std::string name = value.substr(b, eq - b);
+        size_t e = name.find_last_not_of(" \t");
+        name.erase(e == std::string::npos ? 0 : e + 1);
+        stringToLower(name);
+        size_t v = eq + 1;
+        std::string param;
+        size_t next;
+        if (v < value.size() && value[v] == '"') {
+            size_t close = value.find('"', v + 1);
+            if (close == std::string::npos)
+                close = value.size();
+            param = value.substr(v + 1, close - v - 1);
+            next = value.find(';', close);
+        } else {
+            next = value.find(';', v);
+            param = value.substr(v, next == std::string::npos ? std::string::npos : next - v);
+        }
+        if (name.size() == keyLen && name == key)
+            return param;
+        pos = next;
+    }
+    return std::string();
+}
+
+bool MultipartParser::handleLine(const char* line, size_t len) {
+    if (state == MP_BOUNDARY_TAIL) {
+        // Transport padding may follow the delimiter
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t'))
+            len--;
+        if (len >= 2 && line[0] == '-' && line[1] == '-') {
+            state = MP_EPILOGUE;
+            return true;
+        }
+        if (len != 0)
+            return fail(BAD_BODY);
+        current = Part();
+        current.fd = -1;
+        current.size = 0;
+        partLength = 0;
+        reserved = 0;
+        headerBytes = 0;
+        state = MP_HEADERS;
+        return true;
+    }
+
+    // MP_HEADERS
+    if (len == 0)
+        return beginPart();
+    const char* colon = static_cast<const char*>(memchr(line, ':', len));
+    if (!colon)
+        return fail(BAD_BODY);
+    std::string key(line, colon);
+    stringToLower(key);
+    std::string value(colon + 1, line + len);
+    size_t b = value.find_first_not_of(" \t");
+    value.erase(0, b == std::string::npos ? value.size() : b);
+    if (key == "content-disposition") {
+        current.name = dispositionParam(value, "name");
+        current.filename = dispositionParam(value, "filename");
+    } else if (key == "content-type") {
+        current.contentType = value;
+    } else if (key == "content-length") {
+        partLength = static_cast<off_t>(strtoll(value.c_str(), NULL, 10));
+        if (partLength < 0)
+            partLength = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Picks where the part body goes once its headers are read
+ */
+bool MultipartParser::beginPart() {
+    state = MP_BODY;
+    if (current.filename.empty())
+        return true;
+    int fd = openat(dirFd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0 && errno != ENOSPC && errno != EDQUOT) {
+        // No O_TMPFILE on this filesystem: a hidden name stands in
+        fd = openNamedTemp(current.tmpName);
+    }
+    if (fd < 0)
+        return fail(errno == ENOSPC || errno == EDQUOT ? NO_SPACE : WRITE_FAILED);
+    current.fd = fd;
+    return true;
+}
+
+/**
+ * @brief Creates ".upload.XXXXXX" in the upload directory, like mkstemp()
+ * @param name Set to the name that was created
+ * @return The open file, or -1 with errno set
+ */
+int MultipartParser::openNamedTemp(std::string& name) {
+    static const char letters[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    // Shared by the reactor threads; a collision only costs another try
+    static unsigned long counter = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    unsigned long seed = static_cast<unsigned long>(now.tv_nsec)
+                         ^ (static_cast<unsigned long>(getpid()) << 16);
+    for (int attempt = 0; attempt < 100; attempt++) {
+        unsigned long n = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+        unsigned long v = seed ^ (n * 2654435761UL);
+        char suffix[7];
+        for (size_t i = 0; i < 6; i++) {
+            suffix[i] = letters[v % 62];
+            v /= 62;
+        }
+        suffix[6] = '\0';
+        name = std::string(".upload.") + suffix;
+        int fd = openat(dirFd, name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+        if (fd >= 0 || errno != EEXIST) {
+            if (fd < 0)
+                name.clear();
+            return fd;
+        }
+    }
+    name.clear();
+    errno = EEXIST;
+    return -1;
+}
+
+bool MultipartParser::endPart() {
+    // Give back what was preallocated past the end of the file; a hole
+    // punched beyond EOF is a no-op on ext4, truncating frees the blocks
+    if (current.fd >= 0 && reserved > current.size && ftruncate(current.fd, current.size) != 0)
+        return fail(WRITE_FAILED);
+    if (current.name.empty())
+        closePart(current);
+    else
+        done.push_back(current);
+    current = Part();
+    current.fd = -1;
+    current.size = 0;
+    reserved = 0;
+    return true;
+}
+
+bool MultipartParser::finish() {
+    if (state == MP_FAILED)
+        return false;
+    // The closing "--" may end the body without a CRLF
+    if (state == MP_BOUNDARY_TAIL && lineBuf.compare(0, 2, "--") == 0)
+        state = MP_EPILOGUE;
+    if (state != MP_EPILOGUE)
+        return fail(BAD_BODY);
+    return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @brief Incremental multipart/form-data parser that streams file parts to disk
+ *
+ * Fed the body as it arrives, in pieces of any size. Delimiters are found
+ * with a Boyer-Moore-Horspool skip table; a delimiter split across two
+ * pieces is tracked as the length of its matched prefix, since the
+ * delimiter only holds a CR at its first byte. File parts are written to
+ * unnamed O_TMPFILE files in the upload directory (preallocated when a
+ * size bound is known) and only get a name when the request succeeds, so
+ * a failed or abandoned upload leaves nothing behind. Filesystems without
+ * O_TMPFILE get a hidden, randomly named file instead, unlinked again
+ * unless it was renamed into place. Plain fields are kept in memory.
+ */
+class MultipartParser {
+public:
+    /**
+     * @brief One finished part
+     */
+    struct Part {
+        std::string name;           // Form field name
+        std::string filename;       // Client file name ("" for a plain field)
+        std::string contentType;
+        std::string value;          // Body of a field
+        int fd;                     // Temporary file with the file body, or -1
+        std::string tmpName;        // Its name in the upload directory, "" for O_TMPFILE
+        off_t size;                 // Bytes written to fd
+    };
+
+    MultipartParser();
+
+    /**
+     * @brief Destructor - closes and removes the temporary files
+     */
+    ~MultipartParser();
+
+    /**
+     * @brief Prepares for a new body
+     * @param boundary Boundary parameter of the Content-Type
+     * @param dirFd Upload directory (O_PATH is enough), taken over; temporary files are made there
+     * @param length Upper bound of the body length (Content-Length, or the body
+     *               size limit when chunked), 0 if unbounded; caps preallocation
+     */
+    void start(const std::string& boundary, int dirFd, size_t length);
+
+    /**
+     * @brief Tells whether start() was called since the last reset()
+     */
+    bool active() const { return dirFd >= 0; }
+
+    /**
+     * @brief Consumes a piece of the body
+     * @return false if the body is malformed or a file cannot be written (see error())
+     */
+    bool feed(const char* data, size_t len);
+
+    /**
+     * @brief Checks that the body ended after the closing delimiter
+     * @return false for a truncated body
+     */
+    bool finish();
+
+    /**
+     * @brief Status line for the last failure ("400 ...", "507 ...")
+     */
+    const char* error() const { return errorCode; }
+
+    /**
+     * @brief Parts completed so far, in body order
+     */
+    const std::vector<Part>& parts() const { return done; }
+
+    /**
+     * @brief Closes every temporary file, unlinks those still named, and forgets the body
+     */
+    void reset();
+
+private:
+    enum State {
+        MP_PREAMBLE,        // Before the first delimiter
+        MP_BOUNDARY_TAIL,   // Rest of a delimiter line: "--" ends the body, CRLF starts a part
+        MP_HEADERS,         // Part header lines
+        MP_BODY,            // Part content, up to the next delimiter
+        MP_EPILOGUE,        // After the closing delimiter; ignored
+        MP_FAILED
+    };
+
+    static const size_t MAX_HEADERS = 8192;         // Header bytes per part
+    static const off_t PREALLOC_MIN = 1 << 20;      // Smaller files are not preallocated
+
+    State state;
+    std::string delimiter;      // CRLF "--" boundary
+    size_t skip[256];           // Horspool shift per byte value
+    size_t matched;             // Delimiter prefix seen at the end of the last piece
+    std::string lineBuf;        // Header line split across pieces
+    size_t headerBytes;
+    int dirFd;                  // Upload directory, closed by reset()
+    size_t bodyLength;          // Upper bound of the body, 0 if unbounded
+    size_t consumed;            // Body bytes fed so far
+    Part current;
+    off_t partLength;           // Content-Length header of the current part, 0 if absent
+    off_t reserved;             // Bytes preallocated for current.fd
+    std::vector<Part> done;
+    const char* errorCode;
+
+    size_t search(const char* data, size_t len) const;
+    bool scanBody(const char* data, size_t len, size_t& used);
+    bool emit(const char* data, size_t len);
+    bool foundDelimiter();
+    bool handleLine(const char* line, size_t len);
+    bool beginPart();
+    int openNamedTemp(std::string& name);
+    bool endPart();
+    bool fail(const char* code);
+    void closePart(Part& part);
+
+    MultipartParser(const MultipartParser&);
+    MultipartParser& operator=(const MultipartParser&);
+};
@@ -1,26 +1,94 @@
 #include "Request.hpp"
 #include "../Config/ConfigParser.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Appends the percent-decoded form of a URL component ('+' is a space)
+ */
+template <typename String>
+static void appendDecoded(String& decoded, const char* str, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (str[i] == '%' && i + 2 < len) {
+            char hex1 = str[i + 1];
+            char hex2 = str[i + 2];
+            
+            if (std::isxdigit(hex1) && std::isxdigit(hex2)) {
+                int value = 0;
+                if (hex1 >= '0' && hex1 <= '9') value += (hex1 - '0') * 16;
+                else if (hex1 >= 'A' && hex1 <= 'F') value += (hex1 - 'A' + 10) * 16;
+                else if (hex1 >= 'a' && hex1 <= 'f') value += (hex1 - 'a' + 10) * 16;
+                
+                if (hex2 >= '0' && hex2 <= '9') value += (hex2 - '0');
+                else if (hex2 >= 'A' && hex2 <= 'F') value += (hex2 - 'A' + 10);
+                else if (hex2 >= 'a' && hex2 <= 'f') value += (hex2 - 'a' + 10);
+                
+                decoded += static_cast<char>(value);
+                i += 2;
+            } else {
+                decoded += str[i];
+            }
+        } else if (str[i] == '+') {
+            decoded += ' ';
+        } else {
+            decoded += str[i];
+        }
+    }
+}
 
-Request::Request() {
+Request::Request()
+    : headers(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      query_params(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      uploads(std::less<ArenaString>(), UploadMap::allocator_type(&arena)),
+      cgi_env(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      cookies(std::less<ArenaString>(), StringMap::allocator_type(&arena)) {
     this->clientFD = -1;
+    this->localPort = 0;
+    memset(&this->client_addr, 0, sizeof(this->client_addr));
     this->is_valid = false;
     this->is_chunked = false;
     this->Port = -1;
     this->isIp = false;
     this->is_Complete = false;
     this->configSet = false;  // Initialize server config flag
+    this->fullServerConfig = NULL;
+    this->serverConfig = NULL;
+    this->routeTable = NULL;
     this->error_code.clear();
-}
-
-Request::Request(int clientFD) {
+    this->parseState = P_REQUEST_LINE;
+    this->headBytes = 0;
+    this->bodyRemaining = 0;
+    this->bodyLimit = 0;
+    this->bodyBytes = 0;
+    this->lastHeader = this->headers.end();
+}
+
+Request::Request(int clientFD)
+    : headers(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      query_params(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      uploads(std::less<ArenaString>(), UploadMap::allocator_type(&arena)),
+      cgi_env(std::less<ArenaString>(), StringMap::allocator_type(&arena)),
+      cookies(std::less<ArenaString>(), StringMap::allocator_type(&arena)) {
     this->clientFD = clientFD;
+    this->localPort = 0;
+    memset(&this->client_addr, 0, sizeof(this->client_addr));
     this->is_valid = false;
     this->is_chunked = false;
     this->Port = -1;
     this->isIp = false;
     this->is_Complete = false;
     this->configSet = false;  // Initialize server config flag
+    this->fullServerConfig = NULL;
+    this->serverConfig = NULL;
+    this->routeTable = NULL;
     this->error_code.clear();
+    this->parseState = P_REQUEST_LINE;
+    this->headBytes = 0;
+    this->bodyRemaining = 0;
+    this->bodyLimit = 0;
+    this->bodyBytes = 0;
+    this->lastHeader = this->headers.end();
 }
 
 Request::~Request() {}
@@ -29,87 +97,378 @@ void Request::reset() {
     this->method.clear();
     this->path.clear();
     this->version.clear();
-    this->headers.clear();
     this->body.clear();
     this->error_code.clear();
     this->Host.clear();
     this->is_Complete = false;
     this->Port = -1;
     this->isIp = false;
-    this->query_params.clear();
-    this->uploads.clear();
+    this->uploads.clear();      // File parts hold heap strings of their own
     this->cgi_extension.clear();
-    this->cgi_env.clear();
-    this->cookies.clear();
+    dropTables();
+    this->arena.reset();    // Everything the tables held goes in one step
     this->is_chunked = false;
-    this->chunks.clear();
     this->is_valid = false;
     this->configSet = false;  // Reset server config flag
-}
+    this->fullServerConfig = NULL;
+    this->serverConfig = NULL;
+    this->routeTable = NULL;
+    this->route = RouteContext();
+    this->parseState = P_REQUEST_LINE;
+    this->lineBuf.clear();
+    this->headBytes = 0;
+    this->bodyRemaining = 0;
+    this->bodyLimit = 0;
+    this->bodyBytes = 0;
+    this->multipart.reset();    // Uploads never put in place are freed or unlinked
+    this->lastHeader = this->headers.end();
+}
+
+/**
+ * @brief Empties the string tables without visiting their entries
+ *
+ * Their nodes, keys and values all come from the arena and own nothing
+ * else, so empty tables are built over the old ones and the arena rewind
+ * that follows releases the rest at once.
+ */
+void Request::dropTables() {
+    StringMap::allocator_type alloc(&this->arena);
+    new (&this->headers) StringMap(std::less<ArenaString>(), alloc);
+    new (&this->query_params) StringMap(std::less<ArenaString>(), alloc);
+    new (&this->cgi_env) StringMap(std::less<ArenaString>(), alloc);
+    new (&this->cookies) StringMap(std::less<ArenaString>(), alloc);
+}
+
+ArenaString Request::arenaString(const char* data, size_t len) {
+    return ArenaString(data, len, ArenaString::allocator_type(&this->arena));
+}
+
+/**
+ * @brief Sets a table entry, with key and value copied into the arena
+ * @return The entry; an existing one gets the new value
+ */
+Request::HeaderIterator Request::put(StringMap& table, const char* key, size_t keyLen,
+                                     const char* value, size_t valueLen) {
+    ArenaString k = arenaString(key, keyLen);
+    HeaderIterator it = table.find(k);
+    if (it == table.end())
+        return table.insert(StringMap::value_type(k, arenaString(value, valueLen))).first;
+    it->second.assign(value, valueLen);
+    return it;
+}
+
+Request::HeaderIterator Request::put(StringMap& table, const std::string& key, const std::string& value) {
+    return put(table, key.data(), key.size(), value.data(), value.size());
+}
+
+/**
+ * @brief Looks a header up by its lowercase name without a heap temporary
+ */
+Request::HeaderIterator Request::findHeader(const char* name) {
+    return this->headers.find(arenaString(name, strlen(name)));
+}
+
+void Request::setBodyLimit(size_t limit) {
+    this->bodyLimit = limit;
+}
+
+bool Request::hasStarted() const {
+    return this->parseState != P_REQUEST_LINE || !this->lineBuf.empty();
+}
+
+Request::ParseStatus Request::fail(const char* code) {
+    if (this->error_code.empty())
+        this->error_code = code;
+    this->is_valid = false;
+    this->parseState = P_ERROR;
+    this->lineBuf.clear();
+    return PARSE_ERROR;
+}
+
+Request::ParseStatus Request::feed(const char* data, size_t len, size_t& used) {
+    used = 0;
+    while (this->parseState != P_DONE && this->parseState != P_ERROR) {
+        if (this->parseState == P_BODY_START) {
+            // Runs after the caller had a chance to apply the server limits
+            if (!beginBody())
+                return fail(BAD_REQ);
+            continue;
+        }
+        if (used == len)
+            return PARSE_AGAIN;
+
+        if (this->parseState == P_BODY || this->parseState == P_CHUNK_DATA) {
+            size_t n = len - used;
+            if (n > this->bodyRemaining)
+                n = this->bodyRemaining;
+            if (this->multipart.active()) {
+                if (!this->multipart.feed(data + used, n))
+                    return fail(this->multipart.error());
+            } else {
+                this->body.append(data + used, n);
+            }
+            used += n;
+            this->bodyBytes += n;
+            this->bodyRemaining -= n;
+            if (this->bodyRemaining == 0) {
+                if (this->parseState == P_CHUNK_DATA)
+                    this->parseState = P_CHUNK_DATA_END;
+                else if (!finishMessage())
+                    return fail(BAD_REQ);
+            }
+            continue;
+        }
 
-bool Request::parseFromSocket(int clientFD, const std::string& buffer, size_t size) {
-    // Back-compat helper: delegate to split parsing
-    this->reset();
-    this->clientFD = clientFD;
-    this->requestContent = buffer.substr(0, size);
-    try {
-        size_t header_end = this->requestContent.find("\r\n\r\n");
-        if (header_end == std::string::npos) return false;
-        if (!parseHeadersSection(this->requestContent.substr(0, header_end))) return false;
-        std::string body = (header_end + 4 < this->requestContent.size()) ? this->requestContent.substr(header_end + 4) : std::string();
-        if (!parseBodySection(body)) return false;
-        return this->is_valid;
-    } catch (...) {
-        this->is_valid = false;
+        // Line-oriented states: take bytes up to and including the next LF
+        const char* start = data + used;
+        const char* lf = static_cast<const char*>(memchr(start, '\n', len - used));
+        size_t take = lf ? static_cast<size_t>(lf - start) + 1 : len - used;
+        bool inHead = (this->parseState == P_REQUEST_LINE || this->parseState == P_HEADER_LINE
+                       || this->parseState == P_TRAILER);
+        if (inHead) {
+            this->headBytes += take;
+            if (this->headBytes > MAX_HEAD_SIZE)
+                return fail(this->parseState == P_TRAILER ? BAD_REQ : HEAD_T_LARGE);
+        } else if (this->lineBuf.size() + take > MAX_HEAD_SIZE) {
+            return fail(BAD_REQ);
+        }
+        if (!lf) {
+            // Line continues in the next read; keep what we have of it
+            this->lineBuf.append(start, take);
+            used += take;
+            return PARSE_AGAIN;
+        }
+
+        const char* line = start;
+        size_t lineLen = take - 1;
+        if (!this->lineBuf.empty()) {
+            this->lineBuf.append(start, lineLen);
+            line = this->lineBuf.data();
+            lineLen = this->lineBuf.size();
+        }
+        used += take;
+        if (lineLen > 0 && line[lineLen - 1] == '\r')
+            lineLen--;
+        bool ok = handleLine(line, lineLen);
+        this->lineBuf.clear();
+        if (!ok)
+            return fail(BAD_REQ);
+        if (this->parseState == P_BODY_START)
+            return PARSE_HEADERS_DONE;
+    }
+    return this->parseState == P_DONE ? PARSE_DONE : PARSE_ERROR;
+}
+
+bool Request::handleLine(const char* line, size_t len) {
+    switch (this->parseState) {
+    case P_REQUEST_LINE:
+        // Empty lines before the request line are tolerated (RFC 9112 2.2)
+        if (len == 0) {
+            this->headBytes = 0;
+            return true;
+        }
+        if (!parseStartLine(line, len))
+            return false;
+        this->parseState = P_HEADER_LINE;
+        return true;
+
+    case P_HEADER_LINE:
+        if (len == 0) {
+            parseQueryString();
+            this->parseState = P_BODY_START;
+            return true;
+        }
+        if (line[0] == ' ' || line[0] == '\t') {
+            // obs-fold: continuation of the previous field value
+            if (this->lastHeader == this->headers.end())
+                return false;
+            size_t i = 0;
+            while (i < len && (line[i] == ' ' || line[i] == '\t'))
+                i++;
+            if (i < len) {
+                this->lastHeader->second += ' ';
+                this->lastHeader->second.append(line + i, len - i);
+            }
+            return true;
+        }
+        return parseHeaders(line, len);
+
+    case P_CHUNK_SIZE: {
+        // chunk-size [ ; chunk-ext ]; at most 15 hex digits so it cannot overflow
+        size_t i = 0;
+        size_t size = 0;
+        while (i < len && isxdigit(static_cast<unsigned char>(line[i]))) {
+            if (i == 15)
+                return false;
+            char c = line[i];
+            size = size * 16 + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : (tolower(c) - 'a' + 10));
+            i++;
+        }
+        if (i == 0)
+            return false;
+        while (i < len && (line[i] == ' ' || line[i] == '\t'))
+            i++;
+        if (i < len && line[i] != ';')
+            return false;
+        if (size == 0) {
+            this->headBytes = 0;
+            this->parseState = P_TRAILER;
+            return true;
+        }
+        if (this->bodyLimit > 0 && size > this->bodyLimit - this->bodyBytes) {
+            this->error_code = BODY_T_LARGE;
+            return false;
+        }
+        this->bodyRemaining = size;
+        this->parseState = P_CHUNK_DATA;
+        return true;
+    }
+
+    case P_CHUNK_DATA_END:
+        if (len != 0)
+            return false;
+        this->parseState = P_CHUNK_SIZE;
+        return true;
+
+    case P_TRAILER:
+        // Trailer fields are accepted but not merged into the headers
+        if (len == 0)
+            return finishMessage();
+        return memchr(line, ':', len) != NULL;
+
+    default:
         return false;
     }
 }
 
-bool Request::parseHeadersSection(const std::string& headers_section) {
-    std::vector<std::string> header_lines;
-    size_t pos = 0, prev = 0;
-    while ((pos = headers_section.find("\r\n", prev)) != std::string::npos) {
-        header_lines.push_back(headers_section.substr(prev, pos - prev));
-        prev = pos + 2;
+bool Request::beginBody() {
+    ConstHeaderIterator te = findHeader("transfer-encoding");
+    if (te != this->headers.end() && te->second.find("chunked") != std::string::npos) {
+        this->is_chunked = true;
+        // Only the body size limit bounds a chunked body
+        startMultipart(this->bodyLimit);
+        this->parseState = P_CHUNK_SIZE;
+        return true;
     }
-    if (prev < headers_section.size()) header_lines.push_back(headers_section.substr(prev));
-    if (header_lines.empty()) { this->error_code = BAD_REQ; return false; }
-
-    std::vector<std::string> merged;
-    for (size_t i = 0; i < header_lines.size(); ++i) {
-        const std::string &ln = header_lines[i];
-        if (!ln.empty() && (ln[0] == ' ' || ln[0] == '\t')) {
-            if (!merged.empty()) {
-                size_t cont = ln.find_first_not_of(" \t");
-                std::string part = (cont == std::string::npos) ? std::string() : ln.substr(cont);
-                if (!part.empty()) merged.back() += std::string(" ") + part;
-            } else {
-                merged.push_back(ln);
+
+    ConstHeaderIterator cl = this->headers.find("content-length");
+    if (cl == this->headers.end())
+        return finishMessage();
+
+    const ArenaString& digits = cl->second;
+    if (digits.empty() || digits.size() > 18)
+        return false;
+    size_t length = 0;
+    for (size_t i = 0; i < digits.size(); i++) {
+        if (!isdigit(static_cast<unsigned char>(digits[i])))
+            return false;
+        length = length * 10 + (digits[i] - '0');
+    }
+    if (this->bodyLimit > 0 && length > this->bodyLimit) {
+        this->error_code = BODY_T_LARGE;
+        return false;
+    }
+    if (length == 0)
+        return finishMessage();
+    if (!startMultipart(length))
+        this->body.reserve(length < BODY_RESERVE_MAX ? length : BODY_RESERVE_MAX);
+    this->bodyRemaining = length;
+    this->parseState = P_BODY;
+    return true;
+}
+
+bool Request::finishMessage() {
+    if (this->multipart.active()) {
+        if (!this->multipart.finish()) {
+            this->error_code = this->multipart.error();
+            return false;
+        }
+        const std::vector<MultipartParser::Part>& parts = this->multipart.parts();
+        for (size_t i = 0; i < parts.size(); i++) {
+            const MultipartParser::Part& part = parts[i];
+            if (part.filename.empty()) {
+                addQueryParam(part.name, part.value);
+                continue;
             }
-        } else {
-            merged.push_back(ln);
+            FilePart file_part;
+            file_part.filename = part.filename;
+            file_part.content_type = part.contentType;
+            file_part.content = part.value;
+            file_part.fd = part.fd;
+            file_part.tmpName = part.tmpName;
+            file_part.size = part.size;
+            addUpload(part.name, file_part);
         }
+    } else if (!parseBodyByType(this->body)) {
+        return false;
     }
-    header_lines.swap(merged);
-
-    try { parseStartLine(header_lines[0]); }
-    catch (...) { this->is_valid = false; return false; }
+    parseCookies();
+    extractCgiInfo();
+    validateRequest();
+    if (!this->is_valid)
+        return false;
+    this->parseState = P_DONE;
+    this->is_Complete = true;
+    return true;
+}
 
-    for (size_t i = 1; i < header_lines.size(); ++i) {
-        try { parseHeaders(header_lines[i]); }
-        catch (...) { this->is_valid = false; return false; }
+/**
+ * @brief Extracts the boundary parameter of a multipart Content-Type
+ */
+template <typename String>
+static bool multipartBoundary(const String& content_type, std::string& boundary) {
+    size_t boundary_pos = content_type.find("boundary=");
+    if (boundary_pos == String::npos)
+        return false;
+    boundary.assign(content_type.data() + boundary_pos + 9, content_type.size() - boundary_pos - 9);
+    if (!boundary.empty() && boundary[0] == '"' && boundary[boundary.length() - 1] == '"') {
+        if (boundary.length() >= 2)
+            boundary = boundary.substr(1, boundary.length() - 2);
     }
+    return true;
+}
 
-    size_t qpos = this->path.find('?');
-    if (qpos != std::string::npos) { this->path = this->path.substr(0, qpos); parseQueryString(); }
+/**
+ * @brief Streams a form-data upload to the upload directory as it arrives
+ * @param length Content-Length, or the body size limit when chunked (0 if none)
+ * @return true if the body goes to the multipart parser rather than to body
+ *
+ * Only plain POSTs to a static route qualify: a CGI script reads the raw
+ * body. Anything that stops the directory from being opened leaves the
+ * body to be buffered and parsed whole, as before.
+ */
+bool Request::startMultipart(size_t length) {
+    if (this->method != "POST" || !this->route.route || this->route.isCgi || !this->route.methodAllowed)
+        return false;
+    ConstHeaderIterator it = this->headers.find("content-type");
+    std::string boundary;
+    if (it == this->headers.end() || it->second.find("multipart/form-data") == std::string::npos
+        || !multipartBoundary(it->second, boundary) || boundary.empty())
+        return false;
+
+    std::string dir = uploadDirectory();
+    if (dir.empty())
+        return false;
+    mkdir(dir.c_str(), 0755);
+    int dirFd = open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0)
+        return false;
+    this->multipart.start(boundary, dirFd, length);
     return true;
 }
 
+std::string Request::uploadDirectory() const {
+    const Config::RouteConfig* matched = this->route.route;
+    std::string dir = (matched && !matched->upload_path.empty()) ? matched->upload_path : this->route.root;
+    if (dir.size() > 1 && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+    return dir;
+}
+
 void Request::debugPrint() const {
     std::cout << "---- Request debug dump ----\n";
     std::cout << "clientFD: " << this->clientFD << "\n";
     std::cout << "configSet: " << (this->configSet ? "true" : "false") << "\n";
-    std::cout << "requestContent(size): " << this->requestContent.size() << "\n";
     std::cout << "Method: " << this->method << "\n";
     std::cout << "Path: " << this->path << "\n";
     std::cout << "Version: " << this->version << "\n";
@@ -132,18 +491,18 @@ void Request::debugPrint() const {
     }
 
     std::cout << "Query params(" << this->query_params.size() << "):\n";
-    for (std::map<std::string, std::string>::const_iterator it = this->query_params.begin(); it != this->query_params.end(); ++it) {
+    for (ConstHeaderIterator it = this->query_params.begin(); it != this->query_params.end(); ++it) {
         std::cout << "  " << it->first << " = " << it->second << "\n";
     }
 
     std::cout << "Uploads(" << this->uploads.size() << "):\n";
-    for (std::map<std::string, FilePart>::const_iterator it = this->uploads.begin(); it != this->uploads.end(); ++it) {
+    for (UploadMap::const_iterator it = this->uploads.begin(); it != this->uploads.end(); ++it) {
         std::cout << "  field: " << it->first << ", filename: " << it->second.filename << ", content-type: " << it->second.content_type << ", size: " << it->second.content.size() << "\n";
     }
 
     std::cout << "CGI extension: " << this->cgi_extension << "\n";
     std::cout << "CGI env(" << this->cgi_env.size() << "):\n";
-    for (std::map<std::string, std::string>::const_iterator it = this->cgi_env.begin(); it != this->cgi_env.end(); ++it) {
+    for (ConstHeaderIterator it = this->cgi_env.begin(); it != this->cgi_env.end(); ++it) {
         std::cout << "  " << it->first << " = " << it->second << "\n";
     }
 
@@ -154,109 +513,62 @@ void Request::debugPrint() const {
     std::cout << "client_addr: " << client_ip << ":" << ntohs(this->client_addr.sin_port) << "\n";
 
     std::cout << "cookies(" << this->cookies.size() << "):\n";
-    for (std::map<std::string, std::string>::const_iterator it = this->cookies.begin(); it != this->cookies.end(); ++it) {
+    for (ConstHeaderIterator it = this->cookies.begin(); it != this->cookies.end(); ++it) {
         std::cout << "  " << it->first << " = " << it->second << "\n";
     }
 
     std::cout << "is_chunked: " << (this->is_chunked ? "true" : "false") << "\n";
-    std::cout << "chunks count: " << this->chunks.size() << "\n";
 
     // Print a short summary of server config if present
-    if (!this->fullServerConfig.servers.empty()) {
-        std::cout << "fullServerConfig.servers count: " << this->fullServerConfig.servers.size() << "\n";
+    if (this->fullServerConfig) {
+        std::cout << "fullServerConfig.servers count: " << this->fullServerConfig->servers.size() << "\n";
     } else {
         std::cout << "fullServerConfig: empty\n";
     }
 
-    std::cout << "serverConfig summary:\n";
-    std::cout << "  host: " << this->serverConfig.host << "\n";
-    std::cout << "  ports(" << this->serverConfig.ports.size() << "):\n";
-    for (size_t i = 0; i < this->serverConfig.ports.size(); ++i) std::cout << "    " << this->serverConfig.ports[i] << "\n";
-    std::cout << "  server_names(" << this->serverConfig.server_names.size() << "):\n";
-    for (size_t i = 0; i < this->serverConfig.server_names.size(); ++i) std::cout << "    " << this->serverConfig.server_names[i] << "\n";
-
-    std::cout << "-----------------------------\n";
-}
-
-bool Request::parseBodySection(const std::string& body_section) {
-    // Delegate all body assembly/validation to parseBodyByType which will
-    // enforce Content-Length, handle chunked decoding, and then dispatch
-    // to the specific parsers based on content-type.
-    if (!parseBodyByType(body_section)) {
-        this->is_valid = false;
-        return false;
+    if (this->serverConfig) {
+        std::cout << "serverConfig summary:\n";
+        std::cout << "  host: " << this->serverConfig->host << "\n";
+        std::cout << "  ports(" << this->serverConfig->ports.size() << "):\n";
+        for (size_t i = 0; i < this->serverConfig->ports.size(); ++i) std::cout << "    " << this->serverConfig->ports[i] << "\n";
+        std::cout << "  server_names(" << this->serverConfig->server_names.size() << "):\n";
+        for (size_t i = 0; i < this->serverConfig->server_names.size(); ++i) std::cout << "    " << this->serverConfig->server_names[i] << "\n";
     }
 
-    parseCookies();
-    extractCgiInfo();
-    validateRequest();
-    return this->is_valid;
+    std::cout << "-----------------------------\n";
 }
 
-bool Request::parseBodyByType(const std::string& raw_body_section) {
-    // If Transfer-Encoding: chunked -> attempt to decode the chunked payload
-    ConstHeaderIterator te = this->headers.find("transfer-encoding");
-    if (te != this->headers.end() && te->second.find("chunked") != std::string::npos) {
-        // parseChunkedTransfer will populate this->body on success
-        if (!parseChunkedTransfer(raw_body_section)) {
-            // incomplete or protocol error (parseChunkedTransfer sets error_code on fatal)
-            return false;
-        }
-    } else {
-        // Enforce Content-Length if present
-        ConstHeaderIterator cl_it = this->headers.find("content-length");
-        if (cl_it != this->headers.end()) {
-            unsigned long expected_length = strtoul(cl_it->second.c_str(), NULL, 10);
-            if (raw_body_section.length() != expected_length) {
-                if (raw_body_section.length() < expected_length) {
-                    // incomplete body
-                    return false;
-                }
-                this->error_code = BAD_REQ;
-                return false;
-            }
-        }
-
-        // No chunked encoding: accept the provided raw body as the assembled body
-        this->body = raw_body_section;
-    }
-
-    // At this point this->body contains the assembled payload. Now dispatch
+bool Request::parseBodyByType(const std::string& body_data) {
+    // body_data is the assembled payload (chunks already decoded). Dispatch
     // to the appropriate parser based on Content-Type.
     ConstHeaderIterator it = this->headers.find("content-type");
-    std::string content_type = (it != this->headers.end()) ? it->second : std::string();
+    std::string content_type = (it != this->headers.end()) ? std::string(it->second.data(), it->second.size()) : std::string();
 
     if (content_type.find("multipart/form-data") != std::string::npos) {
-        size_t boundary_pos = content_type.find("boundary=");
-        if (boundary_pos != std::string::npos) {
-            std::string boundary = content_type.substr(boundary_pos + 9);
-            if (!boundary.empty() && boundary[0] == '"' && boundary[boundary.length() - 1] == '"') {
-                if (boundary.length() >= 2)
-                    boundary = boundary.substr(1, boundary.length() - 2);
-            }
-            return parseBodyMultipart(this->body, boundary);
-        }
+        std::string boundary;
+        if (multipartBoundary(content_type, boundary))
+            return parseBodyMultipart(body_data, boundary);
         // no boundary -> treat as generic
-        return parseBodyGeneric(this->body, content_type);
+        return parseBodyGeneric(body_data, content_type);
     }
 
     if (content_type.find("application/x-www-form-urlencoded") != std::string::npos) {
-        return parseBodyUrlEncoded(this->body);
+        return parseBodyUrlEncoded(body_data);
     }
 
     // Heuristic: if header present and starts with text/ or application/, treat as raw text
     if (!content_type.empty()) {
         if (content_type.find("text/") == 0 || content_type.find("application/json") != std::string::npos || content_type.find("application/xml") != std::string::npos) {
-            return parseBodyRaw(this->body);
+            return parseBodyRaw(body_data);
         }
         // For octet-stream treat as binary
         if (content_type.find("application/octet-stream") != std::string::npos) {
-            return parseBodyBinary(this->body);
+            return parseBodyBinary(body_data);
         }
     }
 
     // Fallback: generic parser
-    return parseBodyGeneric(this->body, content_type);
+    return parseBodyGeneric(body_data, content_type);
 }
 
 bool Request::parseBodyMultipart(const std::string& body_data, const std::string& boundary) {
@@ -292,22 +604,6 @@ void Request::setChunked(bool ischunked)
     this->is_chunked = ischunked;
 }
 
-bool Request::hasChunkedEncoding() const {
-    ConstHeaderIterator it = this->headers.find("transfer-encoding");
-    return (it != this->headers.end() && it->second.find("chunked") != std::string::npos);
-}
-
-size_t Request::expectedContentLength() const {
-    ConstHeaderIterator it = this->headers.find("content-length");
-    if (it == this->headers.end()) return 0;
-    char *end = NULL;
-    unsigned long v = strtoul(it->second.c_str(), &end, 10);
-    if (end == it->second.c_str()) {
-        return 0;
-    }
-    return static_cast<size_t>(v);
-}
-
 void Request::setMethod(const std::string& method) {
     if (this->method.empty() && !method.empty()) {
         this->method = method;
@@ -318,11 +614,15 @@ void Request::setMethod(const std::string& method) {
 }
 
 void Request::setPath(const std::string& path) {
-    if (path.size() > MAX_PATH_SIZE && error_code.empty()) {
+    setPath(path.data(), path.size());
+}
+
+void Request::setPath(const char* path, size_t len) {
+    if (len > MAX_PATH_SIZE && error_code.empty()) {
         this->error_code = URI_T_LONG;
     }
-    else if (this->path.empty() && !path.empty()) {
-        this->path = urlDecode(path);  // Decode URL-encoded characters like %20
+    else if (this->path.empty() && len > 0) {
+        appendDecoded(this->path, path, len);  // Decode URL-encoded characters like %20
     }
     else if (error_code.empty()) {
         this->error_code = BAD_REQ;
@@ -338,42 +638,36 @@ void Request::setVersion(const std::string& version) {
     }
 }
 
-void Request::parseStartLine(const std::string& line) {
-    size_t pos = std::string::npos;
-    // Allow parsing of common HTTP methods so they can get proper 501 responses
-    const char* methods[] = {"GET", "POST", "DELETE", "HEAD", "PUT", "PATCH", "OPTIONS", "TRACE", "CONNECT", NULL};
-    
-    
-    for (size_t i = 0; methods[i]; i++) {
-        if ((pos = line.find(methods[i], 0)) != std::string::npos) {
+bool Request::parseStartLine(const char* line, size_t len) {
+    // method SP request-target SP HTTP-version, fields separated by blanks
+    const char* tokens[3];
+    size_t tokenLen[3];
+    size_t count = 0;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (line[i] == ' ' || line[i] == '\t'))
+            i++;
+        if (i == len)
             break;
+        if (count == 3) {
+            this->error_code = BAD_REQ;
+            return false;
         }
+        tokens[count] = line + i;
+        while (i < len && line[i] != ' ' && line[i] != '\t')
+            i++;
+        tokenLen[count] = static_cast<size_t>(line + i - tokens[count]);
+        count++;
     }
-    
-    if (pos == std::string::npos) {
-        throw -1;
-    }
-    
-    try {
-        std::string str;
-        std::stringstream ss(line);
-        
-        ss >> str;
-        setMethod(str);
-        
-        ss >> str;
-        setPath(str);
-        
-        ss >> str;
-        setVersion(str);
-        
-        if (!this->error_code.empty()) {
-            throw 1;
-        }
-    }
-    catch (const std::exception& e) {
-        throw 1;
+    if (count != 3) {
+        this->error_code = BAD_REQ;
+        return false;
     }
+
+    setMethod(std::string(tokens[0], tokenLen[0]));
+    setPath(tokens[1], tokenLen[1]);
+    setVersion(std::string(tokens[2], tokenLen[2]));
+    return this->error_code.empty();
 }
 
 const std::string& Request::getMethod() const {
@@ -388,10 +682,10 @@ const std::string& Request::getVersion() const {
     return this->version;
 }
 
-const std::string& Request::getHeader(const std::string& key) const {
-    ConstHeaderIterator it = this->headers.find(key);
+std::string Request::getHeader(const std::string& key) const {
+    ConstHeaderIterator it = this->headers.find(ArenaString(key.data(), key.size()));
     if (it != headers.end()) {
-        return it->second;
+        return std::string(it->second.data(), it->second.size());
     }
     return key;
 }
@@ -412,7 +706,7 @@ sockaddr_in Request::getClientAddr() const {
 
 void Request::setHeader(const std::string& key, const std::string& value) {
     if (!key.empty() && !value.empty())
-        this->headers[key] = value;
+        put(this->headers, key, value);
 }
 
 void Request::setBody(const std::string& body) {
@@ -427,6 +721,10 @@ void Request::setClientAddr(const sockaddr_in& addr) {
     this->client_addr = addr;
 }
 
+void Request::setLocalPort(int port) {
+    this->localPort = port;
+}
+
 void Request::setErrorCode(const std::string& error_code) {
     this->error_code = error_code;
 }
@@ -439,20 +737,24 @@ const std::string& Request::getErrorCode() const {
 }
 
 void Request::addQueryParam(const std::string& key, const std::string& value) {
-    if (!key.empty())
-        this->query_params.insert(std::pair<std::string, std::string>(key, value));
+    // The first occurrence of a name wins
+    if (key.empty())
+        return;
+    ArenaString k = arenaString(key.data(), key.size());
+    if (this->query_params.find(k) == this->query_params.end())
+        this->query_params.insert(StringMap::value_type(k, arenaString(value.data(), value.size())));
 }
 
 void Request::parseQueryPair(const std::string &query, size_t start, size_t end) {
     size_t pos = query.find("=", start);
     if (pos != std::string::npos && pos <= end) {
-        std::string key = query.substr(start, pos - start);
-        std::string value = query.substr(pos + 1, end - pos - 1);
-        
-        key = urlDecode(key);
-        value = urlDecode(value);
-        
-        addQueryParam(key, value);
+        // Decoded straight into the arena; the first occurrence of a name wins
+        ArenaString key(ArenaString::allocator_type(&this->arena));
+        ArenaString value(ArenaString::allocator_type(&this->arena));
+        appendDecoded(key, query.data() + start, pos - start);
+        appendDecoded(value, query.data() + pos + 1, end - pos);
+        if (!key.empty() && this->query_params.find(key) == this->query_params.end())
+            this->query_params.insert(StringMap::value_type(key, value));
     }
 }
 
@@ -462,27 +764,25 @@ bool Request::parseQueryString() {
     if (pos == std::string::npos)
         return false;
         
-    std::string queryParams;
-    queryParams = path.substr(pos + 1, std::string::npos);
-    path.erase(pos);
-    
-    size_t start = 0;
+    // Pairs are read in place; the path loses its query afterwards
+    size_t start = pos + 1;
     size_t end = 0;
-    while (start < queryParams.size()) {
-        end = queryParams.find("&", start);
+    while (start < path.size()) {
+        end = path.find("&", start);
         if (end != std::string::npos) {
-            parseQueryPair(queryParams, start, end - 1);
+            parseQueryPair(path, start, end - 1);
             start = end + 1;
         }
         else {
-            parseQueryPair(queryParams, start, queryParams.size() - 1);
+            parseQueryPair(path, start, path.size() - 1);
             break;
         }
     }
+    path.erase(pos);
     return true;
 }
 
-const std::map<std::string, std::string>& Request::getQueryParams() const {
+const Request::StringMap& Request::getQueryParams() const {
     return this->query_params;
 }
 
@@ -498,152 +798,110 @@ void Request::setPort(int port) {
     }
 }
 
-bool Request::isValidIpAddress(std::string& hostValue) {
-    int octet1, octet2, octet3, octet4, portValue, consumed;
-    portValue = -1;
-    
-    int result = sscanf(hostValue.c_str(), "%d.%d.%d.%d:%d%n", 
-                        &octet1, &octet2, &octet3, &octet4, &portValue, &consumed);
-    
-    if ((octet1 >= 0 && octet1 <= 255) &&
-        (octet2 >= 0 && octet2 <= 255) &&
-        (octet3 >= 0 && octet3 <= 255) &&
-        (octet4 >= 0 && octet4 <= 255) &&
-        (static_cast<size_t>(consumed) == hostValue.length())) {
-        
-
-        if (result == 5) {
-            if (isValidPort(portValue)) {
-                this->Port = portValue;
-                hostValue = hostValue.substr(0, hostValue.find(':'));
-                setHost(hostValue);
-                this->isIp = true;
-                return true;
-            }
+bool Request::parseHost(const std::string& value) {
+    std::string host;
+    host.reserve(value.size());
+    bool numeric = true;        // Only digits and dots so far
+    bool octetsValid = true;    // Every dot-separated group fits an IPv4 octet
+    int dots = 0;
+    int octet = 0;
+    int octetDigits = 0;
+    size_t i = 0;
+    for (; i < value.size() && value[i] != ':'; i++) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c == '.') {
+            if (octetDigits == 0)
+                octetsValid = false;
+            dots++;
+            octet = 0;
+            octetDigits = 0;
+        } else if (isdigit(c)) {
+            octet = octet * 10 + (c - '0');
+            if (++octetDigits > 3 || octet > 255)
+                octetsValid = false;
+        } else if (isalpha(c) || c == '-') {
+            numeric = false;
+        } else {
             return false;
-        } 
-        else if (result == 4) {
-            setHost(hostValue);
-            this->Port = 80; 
-            this->isIp = true;
-            return true;
         }
+        host += static_cast<char>(tolower(c));
     }
-    return false;
-}
+    if (host.empty() || host[0] == '.' || host[0] == '-')
+        return false;
+    if (numeric && (dots != 3 || octetDigits == 0 || !octetsValid))
+        return false;
 
-bool Request::isValidDomainName(std::string& hostValue) {
-    for (size_t i = 0; i < hostValue.length(); i++) {
-        if (!isalnum(hostValue[i]) && hostValue[i] != '.' && hostValue[i] != '-' && hostValue[i] != ':')
-            return false;
-        if (i == 0 && (hostValue[i] == '.' || hostValue[i] == '-' || hostValue[i] == ':'))
+    int port = 80;
+    if (i < value.size()) {
+        // ":" port, up to five digits
+        size_t digits = value.size() - i - 1;
+        if (digits == 0 || digits > 5)
             return false;
-    }
-    
-    size_t colonPos = hostValue.find(':');
-    if (colonPos != std::string::npos) {
-        std::string portPart = hostValue.substr(colonPos + 1);
-            for (size_t i = 0; i < portPart.length(); i++) {
-                if (!isdigit(portPart[i]))
-                    return false;
-            }
-            int port = atoi(portPart.c_str());
-            if (isValidPort(port)) {
-                this->Port = port;
-                hostValue = hostValue.substr(0, colonPos);
-                setHost(hostValue);
-            } else {
+        port = 0;
+        for (i++; i < value.size(); i++) {
+            if (!isdigit(static_cast<unsigned char>(value[i])))
                 return false;
-            }
-    } else {
-        setHost(hostValue);
-        this->Port = -1;
+            port = port * 10 + (value[i] - '0');
+        }
+        if (!isValidPort(port))
+            return false;
     }
-    
-    this->isIp = false;
+
+    this->Host.swap(host);
+    this->Port = port;
+    this->isIp = numeric;
     return true;
 }
 
-bool Request::isValidHost(std::string& Host) {
-    size_t pos = Host.find_first_not_of("0123456789.:");
-    
-    if (pos == std::string::npos) {
-        return isValidIpAddress(Host);
+bool Request::parseHeaders(const char* line, size_t len) {
+    const char* colon = static_cast<const char*>(memchr(line, ':', len));
+    if (!colon) {
+        this->error_code = BAD_REQ;
+        return false;
     }
-    
-    return isValidDomainName(Host);
-}
 
-bool Request::parseHeaders(const std::string& headers_text) {
-    std::string key, value;
-    size_t pos = headers_text.find(":", 0);
-    
-    if (pos == std::string::npos) {
+    // Trim whitespace around key and value without building temporaries
+    const char* kb = line;
+    const char* ke = colon;
+    while (kb < ke && (*kb == ' ' || *kb == '\t')) kb++;
+    while (ke > kb && (ke[-1] == ' ' || ke[-1] == '\t')) ke--;
+    const char* vb = colon + 1;
+    const char* ve = line + len;
+    while (vb < ve && isspace(static_cast<unsigned char>(*vb))) vb++;
+    while (ve > vb && isspace(static_cast<unsigned char>(ve[-1]))) ve--;
+
+    size_t valueLen = static_cast<size_t>(ve - vb);
+    if (!isValidKey(kb, ke - kb) || !isValidValue(vb, valueLen)) {
         this->error_code = BAD_REQ;
-        throw 1;
-    }
-    
-    key = headers_text.substr(0, pos);
-    // Trim whitespace around key first
-    size_t kstart = key.find_first_not_of(" \t");
-    size_t kend = key.find_last_not_of(" \t");
-    if (kstart == std::string::npos) {
-        key.clear();
-    } else {
-        key = key.substr(kstart, kend - kstart + 1);
+        return false;
     }
     // Normalize key to lowercase for canonical lookup
-    stringToLower(key);
+    ArenaString key = arenaString(kb, ke - kb);
+    for (size_t i = 0; i < key.size(); i++)
+        key[i] = static_cast<char>(tolower(static_cast<unsigned char>(key[i])));
 
-    size_t valueStartIndex = headers_text.find_first_not_of(": \r\t\v\f", pos);
-    if (valueStartIndex == std::string::npos) {
-        valueStartIndex = pos + 1;
+    // Store the parsed host and port information for server matching
+    if (key == "host" && !parseHost(std::string(vb, valueLen))) {
+        this->error_code = BAD_REQ;
+        return false;
     }
 
-    // Header line passed in does not contain CRLF terminator here (we split by CRLF earlier)
-    value = headers_text.substr(valueStartIndex);
-    // Trim whitespace around value and remove any trailing CR/LF
-    size_t vstart = value.find_first_not_of(" \t\r\n\v\f");
-    size_t vend = value.find_last_not_of(" \t\r\n\v\f");
-    if (vstart == std::string::npos) {
-        value.clear();
+    HeaderIterator it = this->headers.find(key);
+    if (it == this->headers.end()) {
+        it = this->headers.insert(StringMap::value_type(key, arenaString(vb, valueLen))).first;
+    } else if (key == "content-length" && it->second.compare(0, it->second.size(), vb, valueLen) != 0) {
+        // Conflicting lengths make the message framing ambiguous
+        this->error_code = BAD_REQ;
+        return false;
     } else {
-        value = value.substr(vstart, vend - vstart + 1);
-    }
-    if (!isValidKey(key) || !isValidValue(value)){
-        if (this->error_code.empty())
-            this->error_code = BAD_REQ;
-        throw 1;
+        // Repeated headers update the value (rather than silently failing insert)
+        it->second.assign(vb, valueLen);
     }
-
-    if (key == "host") {
-        if (value.empty()) {
-            if (this->error_code.empty())
-                this->error_code = BAD_REQ;
-            throw 1;
-        }
-        
-        std::string hostCopy = value;
-        if (!isValidHost(hostCopy)) {
-            if (this->error_code.empty())
-                this->error_code = BAD_REQ;
-            throw 1;
-        }
-        
-        // Store the parsed host and port information for server matching
-        this->Host = hostCopy;
-        // Port is set by isValidHost methods (isValidIpAddress/isValidDomainName)
-        if (this->Port == -1) {
-            this->Port = 80; // Default port if none specified
-        }
-    }
-    
-    // Use assignment so repeated headers update the value (rather than silently failing insert)
-    this->headers[key] = value;
+    this->lastHeader = it;
     return true;
 }
 
-const std::map<std::string, std::string>& Request::getAllHeaders() const {
+const Request::StringMap& Request::getAllHeaders() const {
     return this->headers;
 }
 
@@ -672,11 +930,11 @@ bool Request::isValid() {
     return this->is_valid;
 }
 
-const std::map<std::string, FilePart>& Request::getUploads() const {
+const Request::UploadMap& Request::getUploads() const {
     return this->uploads;
 }
 
-const std::map<std::string, std::string>& Request::getCGIEnv() const {
+const Request::StringMap& Request::getCGIEnv() const {
     return this->cgi_env;
 }
 
@@ -684,60 +942,17 @@ const std::string& Request::getCGIExtension() const {
     return this->cgi_extension;
 }
 
-const std::map<std::string, std::string>& Request::getCookies() const {
+const Request::StringMap& Request::getCookies() const {
     return this->cookies;
 }
 
-const std::vector<std::string>& Request::getChunks() const {
-    return this->chunks;
-}
-
 bool Request::isChunked() const {
     return this->is_chunked;
 }
 
 void Request::addUpload(const std::string& key, const FilePart& file_part) {
     if (!key.empty())
-        this->uploads[key] = file_part;
-}
-
-bool Request::parseBody(const std::string& body_data) {
-    ConstHeaderIterator cl_it = this->headers.find("content-length");
-    if (cl_it != this->headers.end()) {
-        unsigned long expected_length = strtoul(cl_it->second.c_str(), NULL, 10);
-        if (body_data.length() != expected_length) {
-            if (body_data.length() < expected_length) {
-                return false;
-            }
-            this->error_code = BAD_REQ;
-            return false;
-        }
-    }
-    
-    if (body_data.empty()) {
-        return true;
-    }
-    
-    ConstHeaderIterator it = this->headers.find("content-type");
-    if (it != this->headers.end()) {
-        std::string content_type = it->second;
-        if (content_type.find("multipart/form-data") != std::string::npos) {
-            size_t boundary_pos = content_type.find("boundary=");
-            if (boundary_pos != std::string::npos) {
-                std::string boundary = content_type.substr(boundary_pos + 9);
-                if (!boundary.empty() && boundary[0] == '"' && boundary[boundary.length() - 1] == '"') {
-                    if (boundary.length() >= 2)
-                        boundary = boundary.substr(1, boundary.length() - 2);
-                }
-                return parseMultipartBody(body_data, boundary);
-            }
-        } else if (content_type.find("application/x-www-form-urlencoded") != std::string::npos) {
-            parseFormData(body_data);
-        }
-    }
-    
-    this->body = body_data;
-    return true;
+        this->uploads[arenaString(key.data(), key.size())] = file_part;
 }
 
 bool Request::parseMultipartBody(const std::string& body_data, const std::string& boundary) {
@@ -797,7 +1012,7 @@ bool Request::parseMultipartPart(const std::string& part_data) {
     std::string headers_section = part_data.substr(0, headers_end);
     std::string body_section = part_data.substr(headers_end + 4);
     
-    std::map<std::string, std::string> part_headers;
+    StringMap part_headers(std::less<ArenaString>(), StringMap::allocator_type(&this->arena));
     std::stringstream ss(headers_section);
     std::string line;
     
@@ -817,13 +1032,13 @@ bool Request::parseMultipartPart(const std::string& part_data) {
             value.erase(value.find_last_not_of(" \t") + 1);
             
             stringToLower(key);
-            part_headers[key] = value;
+            put(part_headers, key, value);
         }
     }
     
-    std::map<std::string, std::string>::iterator cd_it = part_headers.find("content-disposition");
+    HeaderIterator cd_it = part_headers.find(arenaString("content-disposition", 19));
     if (cd_it != part_headers.end()) {
-        std::string disposition = cd_it->second;
+        std::string disposition(cd_it->second.data(), cd_it->second.size());
         std::string name, filename;
         
         size_t name_pos = disposition.find("name=\"");
@@ -850,9 +1065,9 @@ bool Request::parseMultipartPart(const std::string& part_data) {
                 file_part.filename = filename;
                 file_part.content = body_section;
                 
-                std::map<std::string, std::string>::iterator ct_it = part_headers.find("content-type");
+                HeaderIterator ct_it = part_headers.find("content-type");
                 if (ct_it != part_headers.end()) {
-                    file_part.content_type = ct_it->second;
+                    file_part.content_type.assign(ct_it->second.data(), ct_it->second.size());
                 }
                 
                 addUpload(name, file_part);
@@ -896,32 +1111,7 @@ bool Request::parseFormData(const std::string& form_data) {
 
 std::string Request::urlDecode(const std::string& str) {
     std::string decoded;
-    for (size_t i = 0; i < str.length(); ++i) {
-        if (str[i] == '%' && i + 2 < str.length()) {
-            char hex1 = str[i + 1];
-            char hex2 = str[i + 2];
-            
-            if (std::isxdigit(hex1) && std::isxdigit(hex2)) {
-                int value = 0;
-                if (hex1 >= '0' && hex1 <= '9') value += (hex1 - '0') * 16;
-                else if (hex1 >= 'A' && hex1 <= 'F') value += (hex1 - 'A' + 10) * 16;
-                else if (hex1 >= 'a' && hex1 <= 'f') value += (hex1 - 'a' + 10) * 16;
-                
-                if (hex2 >= '0' && hex2 <= '9') value += (hex2 - '0');
-                else if (hex2 >= 'A' && hex2 <= 'F') value += (hex2 - 'A' + 10);
-                else if (hex2 >= 'a' && hex2 <= 'f') value += (hex2 - 'a' + 10);
-                
-                decoded += static_cast<char>(value);
-                i += 2;
-            } else {
-                decoded += str[i];
-            }
-        } else if (str[i] == '+') {
-            decoded += ' ';
-        } else {
-            decoded += str[i];
-        }
-    }
+    appendDecoded(decoded, str.data(), str.size());
     return decoded;
 }
 
@@ -942,93 +1132,6 @@ std::string Request::urlEncode(const std::string& str) {
     return encoded;
 }
 
-bool Request::parseChunkedTransfer(const std::string& chunked_data) {
-    // If nothing provided yet, treat as incomplete
-    if (chunked_data.empty()) return false;
-
-    this->is_chunked = true;
-
-    std::vector<std::string> decoded_chunks;
-    std::string decoded_body;
-
-    size_t pos = 0;
-    const size_t len = chunked_data.length();
-
-    while (true) {
-        // find end of size line
-        size_t crlf_pos = chunked_data.find("\r\n", pos);
-        if (crlf_pos == std::string::npos) {
-            // incomplete size line
-            return false;
-        }
-
-        std::string size_line = chunked_data.substr(pos, crlf_pos - pos);
-        // trim whitespace
-        size_t sstart = size_line.find_first_not_of(" \t");
-        size_t send = size_line.find_last_not_of(" \t");
-        if (sstart == std::string::npos) {
-            this->error_code = BAD_REQ;
-            return false;
-        }
-        size_line = size_line.substr(sstart, send - sstart + 1);
-
-        // strip chunk extensions
-        size_t semi = size_line.find(';');
-        std::string size_token = (semi == std::string::npos) ? size_line : size_line.substr(0, semi);
-
-        // parse hex size
-        char *endptr = NULL;
-        unsigned long chunk_size = strtoul(size_token.c_str(), &endptr, 16);
-        if (endptr == size_token.c_str()) {
-            this->error_code = BAD_REQ;
-            return false;
-        }
-
-        // move pos to payload start
-        pos = crlf_pos + 2;
-
-        // if terminating chunk
-        if (chunk_size == 0) {
-            // minimal terminator is an immediate CRLF after the 0-chunk (no trailers)
-            if (pos + 2 > len) return false; // need more data
-            if (chunked_data[pos] == '\r' && chunked_data[pos + 1] == '\n') {
-                // success
-                this->chunks.swap(decoded_chunks);
-                this->body.swap(decoded_body);
-                return true;
-            }
-            // otherwise trailers present; they must end with CRLFCRLF
-            size_t trailers_end = chunked_data.find("\r\n\r\n", pos);
-            if (trailers_end == std::string::npos) return false; // need more data
-            this->chunks.swap(decoded_chunks);
-            this->body.swap(decoded_body);
-            return true;
-        }
-
-        // ensure we have payload + CRLF available
-        if (pos + chunk_size + 2 > len) return false; // incomplete payload
-
-        // extract payload
-        decoded_chunks.push_back(chunked_data.substr(pos, chunk_size));
-        decoded_body.append(chunked_data, pos, chunk_size);
-
-        pos += chunk_size;
-
-        // expect CRLF after payload
-        if (pos + 1 >= len || chunked_data[pos] != '\r' || chunked_data[pos + 1] != '\n') {
-            this->error_code = BAD_REQ;
-            return false;
-        }
-        pos += 2; // move to next size line
-
-        // if we've consumed everything, wait for more (incomplete)
-        if (pos >= len) return false;
-    }
-
-    // unreachable
-    return false;
-}
-
 bool Request::extractCgiInfo() {
     size_t dot_pos = this->path.find_last_of('.');
     if (dot_pos != std::string::npos) {
@@ -1036,21 +1139,31 @@ bool Request::extractCgiInfo() {
         if (extension == ".php" || extension == ".cgi" || extension == ".py") {
             this->cgi_extension = extension;
             
-            this->cgi_env["QUERY_STRING"] = "";
-            this->cgi_env["REQUEST_METHOD"] = this->method;
-            this->cgi_env["CONTENT_TYPE"] = this->getHeader("content-type");
-            this->cgi_env["CONTENT_LENGTH"] = this->getHeader("content-length");
-            this->cgi_env["SCRIPT_NAME"] = this->path;
+            // A missing header reads as its own name, as getHeader() does
+            ConstHeaderIterator ct = this->headers.find("content-type");
+            ConstHeaderIterator cl = this->headers.find("content-length");
+            put(this->cgi_env, "QUERY_STRING", 12, "", 0);
+            put(this->cgi_env, "REQUEST_METHOD", 14, this->method.data(), this->method.size());
+            if (ct != this->headers.end())
+                put(this->cgi_env, "CONTENT_TYPE", 12, ct->second.data(), ct->second.size());
+            else
+                put(this->cgi_env, "CONTENT_TYPE", 12, "content-type", 12);
+            if (cl != this->headers.end())
+                put(this->cgi_env, "CONTENT_LENGTH", 14, cl->second.data(), cl->second.size());
+            else
+                put(this->cgi_env, "CONTENT_LENGTH", 14, "content-length", 14);
+            put(this->cgi_env, "SCRIPT_NAME", 11, this->path.data(), this->path.size());
             
             if (!this->query_params.empty()) {
-                std::stringstream ss;
-                for (std::map<std::string, std::string>::const_iterator it = this->query_params.begin();
+                HeaderIterator qs = this->cgi_env.find("QUERY_STRING");
+                for (ConstHeaderIterator it = this->query_params.begin();
                      it != this->query_params.end(); ++it) {
                     if (it != this->query_params.begin())
-                        ss << "&";
-                    ss << it->first << "=" << it->second;
+                        qs->second += '&';
+                    qs->second += it->first;
+                    qs->second += '=';
+                    qs->second += it->second;
                 }
-                this->cgi_env["QUERY_STRING"] = ss.str();
             }
             
             return true;
@@ -1062,49 +1175,31 @@ bool Request::extractCgiInfo() {
 
 bool Request::parseCookies() {
     ConstHeaderIterator it = this->headers.find("cookie");
-    if (it != this->headers.end()) {
-        std::string cookie_str = it->second;
-        std::string::size_type pos = 0;
-        std::string::size_type prev = 0;
-        
-        while ((pos = cookie_str.find(';', prev)) != std::string::npos) {
-            std::string cookie = cookie_str.substr(prev, pos - prev);
-            std::string::size_type equals_pos = cookie.find('=');
-            
-            if (equals_pos != std::string::npos) {
-                std::string key = cookie.substr(0, equals_pos);
-                std::string value = cookie.substr(equals_pos + 1);
-                
-                key.erase(0, key.find_first_not_of(" \t"));
-                key.erase(key.find_last_not_of(" \t") + 1);
-                value.erase(0, value.find_first_not_of(" \t"));
-                value.erase(value.find_last_not_of(" \t") + 1);
-                
-                this->cookies[key] = value;
-            }
-            
-            prev = pos + 1;
-        }
-        
-        std::string cookie = cookie_str.substr(prev);
-        std::string::size_type equals_pos = cookie.find('=');
-        
-        if (equals_pos != std::string::npos) {
-            std::string key = cookie.substr(0, equals_pos);
-            std::string value = cookie.substr(equals_pos + 1);
-            
-            key.erase(0, key.find_first_not_of(" \t"));
-            key.erase(key.find_last_not_of(" \t") + 1);
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
-            
-            this->cookies[key] = value;
+    if (it == this->headers.end())
+        return false;
+
+    // Pairs are cut straight out of the header value
+    const char* cookie_str = it->second.data();
+    size_t len = it->second.size();
+    size_t prev = 0;
+    while (prev <= len) {
+        const char* semi = static_cast<const char*>(memchr(cookie_str + prev, ';', len - prev));
+        size_t end = semi ? static_cast<size_t>(semi - cookie_str) : len;
+        const char* equals = static_cast<const char*>(memchr(cookie_str + prev, '=', end - prev));
+        if (equals) {
+            const char* kb = cookie_str + prev;
+            const char* ke = equals;
+            const char* vb = equals + 1;
+            const char* ve = cookie_str + end;
+            while (kb < ke && (*kb == ' ' || *kb == '\t')) kb++;
+            while (ke > kb && (ke[-1] == ' ' || ke[-1] == '\t')) ke--;
+            while (vb < ve && (*vb == ' ' || *vb == '\t')) vb++;
+            while (ve > vb && (ve[-1] == ' ' || ve[-1] == '\t')) ve--;
+            put(this->cookies, kb, ke - kb, vb, ve - vb);
         }
-        
-        return true;
+        prev = end + 1;
     }
-    
-    return false;
+    return true;
 }
 
 bool Request::validateMethod() const {
@@ -1174,130 +1269,36 @@ void Request::validateRequest() {
 }
 
 // Server configuration methods implementation
-void Request::setServerConfig(const Config& config) {
+void Request::setServerConfig(const Config* config) {
     this->fullServerConfig = config;
-    this->configSet = true;
+    this->configSet = (config != NULL);
 }
 
 const Config& Request::getServerConfig() const {
     if (!configSet) {
         throw std::runtime_error("Server configuration not set for this request");
     }
-    return fullServerConfig;
+    return *fullServerConfig;
 }
 
 bool Request::hasServerConfig() const {
     return configSet;
 }
 
-Config Request::getserverConfig(std::string host , int port, bool isIp) const 
-{
-    // First, try to find server by exact host and port match
-    for (size_t i = 0; i < fullServerConfig.servers.size(); i++) {
-        const Config::ServerConfig& server = fullServerConfig.servers[i];
-        
-        // Check if the port matches any of the server's ports
-        bool portMatch = false;
-        for (size_t j = 0; j < server.ports.size(); j++) {
-            if (server.ports[j] == port) {
-                portMatch = true;
-                break;
-            }
-        }
-        
-        if (!portMatch) {
-            continue;
-        }
-        
-        // If it's an IP address, match against server host
-        if (isIp) {
-            if (server.host == host) {
-                Config matchedConfig;
-                matchedConfig.servers.push_back(server);
-                return matchedConfig;
-            }
-        } else {
-            // If it's a domain name, check server_names
-            for (size_t j = 0; j < server.server_names.size(); j++) {
-                if (server.server_names[j] == host) {
-                    Config matchedConfig;
-                    matchedConfig.servers.push_back(server);
-                    return matchedConfig;
-                }
-            }
-        }
-    }
-    
-    // If no exact match found, try to find default server for the port
-    for (size_t i = 0; i < fullServerConfig.servers.size(); i++) {
-        const Config::ServerConfig& server = fullServerConfig.servers[i];
-        
-        // Check if the port matches
-        bool portMatch = false;
-        for (size_t j = 0; j < server.ports.size(); j++) {
-            if (server.ports[j] == port) {
-                portMatch = true;
-                break;
-            }
-        }
-        
-        if (portMatch && server.default_server) {
-            Config matchedConfig;
-            matchedConfig.servers.push_back(server);
-            return matchedConfig;
-        }
-    }
-    
-    // If still no match, return the first server that matches the port
-    for (size_t i = 0; i < fullServerConfig.servers.size(); i++) {
-        const Config::ServerConfig& server = fullServerConfig.servers[i];
-        
-        for (size_t j = 0; j < server.ports.size(); j++) {
-            if (server.ports[j] == port) {
-                Config matchedConfig;
-                matchedConfig.servers.push_back(server);
-                return matchedConfig;
-            }
-        }
-    }
-    
-    // If no server matches the port, return the first available server
-    if (!fullServerConfig.servers.empty()) {
-        Config matchedConfig;
-        matchedConfig.servers.push_back(fullServerConfig.servers[0]);
-        return matchedConfig;
-    }
-    
-    // Return empty config if nothing matches
-    Config emptyConfig;
-    return emptyConfig;
-}
-void Request::matchServerConfiguration() {
-    // if (!this->configSet || this->Host.empty()) {
-    //     return; // Can't match without config or host
-    // }
-    
-    try {
-        // Get the matched server configuration
-        Config matchedConfig = this->getserverConfig(this->Host, this->Port, this->isIp);
-        
-        // Store the matched server configuration
-        if (!matchedConfig.servers.empty()) {
-            this->serverConfig = matchedConfig.servers[0];
-        }
-                  
-    } catch (const std::exception& e) {
-        std::cerr << "Error during server matching: " << e.what() << std::endl;
-        // Use default server config as fallback
-        if (!fullServerConfig.servers.empty()) {
-            this->serverConfig = fullServerConfig.servers[0];
-        }
-    }
+void Request::matchServerConfiguration(const VirtualHosts& vhosts) {
+    // Only a pointer into the shared snapshot is kept; nothing is copied
+    this->serverConfig = vhosts.resolve(this->localPort, this->Host);
+    this->routeTable = this->serverConfig ? &vhosts.routes(this->serverConfig) : NULL;
+}
+
+void Request::resolveRoute() {
+    if (this->routeTable)
+        this->routeTable->resolve(this->path, this->method, this->route);
 }
 
 const Config::ServerConfig* Request::getCurrentServer() const {
     if (!configSet) {
     return NULL;
     }
-    return &serverConfig;
-}
\ No newline at end of file
+    return serverConfig;
+}
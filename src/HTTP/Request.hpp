@@ -15,13 +15,19 @@
 #include <iostream>
 #include <arpa/inet.h>
 #include "Utils.hpp"
+#include "Arena.hpp"
 #include "Common.hpp"
+#include "MultipartParser.hpp"
 #include "../Config/ConfigParser.hpp"  // Include full Config definition
+#include "../Config/VirtualHosts.hpp"
 
 
 #define MAX_PATH_SIZE 4000
+#define MAX_HEAD_SIZE 8192
 #define BAD_REQ "400 Bad Request"
+#define BODY_T_LARGE "413 Request Entity Too Large"
 #define URI_T_LONG "414 URI Too Long"
+#define HEAD_T_LARGE "431 Request Header Fields Too Large"
 #define VERSION_ERR "505 HTTP Version Not Supported"
 
 // Remove forward declaration since we're including the full definition
@@ -38,16 +44,36 @@ class Request
 {
 
     public:
-        typedef std::map<std::string, std::string>::iterator        HeaderIterator;
-        typedef std::map<std::string, std::string>::const_iterator  ConstHeaderIterator;
-    public:
+        // Tables of one request; their nodes, keys and values live in the
+        // request arena
+        typedef std::map<ArenaString, ArenaString, std::less<ArenaString>,
+                         ArenaAllocator<std::pair<const ArenaString, ArenaString> > > StringMap;
+        typedef std::map<ArenaString, FilePart, std::less<ArenaString>,
+                         ArenaAllocator<std::pair<const ArenaString, FilePart> > >    UploadMap;
+        typedef StringMap::iterator                                 HeaderIterator;
+        typedef StringMap::const_iterator                           ConstHeaderIterator;
+
+        /**
+         * @brief Outcome of feed()
+         */
+        enum ParseStatus {
+            PARSE_ERROR = -1,       // Malformed or refused message; error_code is set
+            PARSE_AGAIN = 0,        // All given bytes were consumed; more are needed
+            PARSE_HEADERS_DONE = 1, // Head complete; the body is read by the next feed()
+            PARSE_DONE = 2          // Whole message parsed
+        };
+    private:
+        Arena arena;    // Backs the tables below; declared first so it outlives them
 
+    public:
         int clientFD;
-        Config                  fullServerConfig;  // Full configuration (contains all servers)
-        Config::ServerConfig    serverConfig;      // Matched server configuration for this request
+        int localPort;                                 // Port of the listener that accepted the connection
+        const Config*               fullServerConfig;  // Shared configuration snapshot (all servers)
+        const Config::ServerConfig* serverConfig;      // Matched server inside the snapshot
+        const RouteTable*           routeTable;        // Compiled routes of serverConfig
+        RouteContext                route;             // Routing result, see resolveRoute()
     
         bool        configSet;     // Flag to track if server config has been set
-        std::string requestContent;
         std::string method;             
         std::string path;                
         std::string version;
@@ -55,69 +81,92 @@ class Request
         bool       is_Complete; // Indicates if the request is fully parsed
         int         Port;
         bool        isIp;   
-        std::map<std::string, std::string> headers;
+        StringMap headers;
         std::string body;             
     
-        std::map<std::string, std::string> query_params; 
-        std::map<std::string, FilePart> uploads;       
+        StringMap query_params;
+        UploadMap uploads;
         std::string cgi_extension;                     
-        std::map<std::string, std::string> cgi_env;                                       
+        StringMap cgi_env;
         sockaddr_in client_addr;                         
         bool is_valid;                                   
         std::string error_code;                         
 
-        std::map<std::string, std::string> cookies;    
+        StringMap cookies;
         bool is_chunked;                                 
-        std::vector<std::string> chunks;                 
 
-       
-        /**
-         * @brief Parses the HTTP request start line (method, path, version)
-         * @param line The first line of the HTTP request
-         * @throws int Exception code if parsing fails
-         */
-        void parseStartLine(const std::string& line);
-
-        /**
-         * @brief Parses individual HTTP header lines
-         * @param headers_text A single header line in "key: value" format
-         * @return true if parsing successful, false otherwise
-         * @throws int Exception code for malformed headers
-         */
-        bool parseHeaders(const std::string& headers_text);
+    private:
+        /**
+         * @brief Position of the incremental parser inside the message
+         */
+        enum ParseState {
+            P_REQUEST_LINE,     // Waiting for "METHOD target HTTP/1.1"
+            P_HEADER_LINE,      // Header fields, up to the blank line
+            P_BODY_START,       // Head done; framing is chosen on the next feed()
+            P_BODY,             // Content-Length body
+            P_CHUNK_SIZE,       // Chunk size line (extensions ignored)
+            P_CHUNK_DATA,       // Chunk payload
+            P_CHUNK_DATA_END,   // CRLF closing a chunk payload
+            P_TRAILER,          // Trailer fields after the last chunk
+            P_DONE,
+            P_ERROR
+        };
+
+        static const size_t BODY_RESERVE_MAX = 1 << 20; // Upfront body allocation cap
+
+        ParseState      parseState;
+        std::string     lineBuf;        // Start of a line split across two feeds
+        size_t          headBytes;      // Bytes of head (or trailer) seen so far
+        size_t          bodyRemaining;  // Bytes left in the body or current chunk
+        size_t          bodyLimit;      // client_max_body_size, 0 = unlimited
+        size_t          bodyBytes;      // Decoded body bytes received so far
+        MultipartParser multipart;      // Streams form-data uploads instead of buffering the body
+        HeaderIterator  lastHeader;     // Target of obs-fold continuation lines
+
+        bool handleLine(const char* line, size_t len);
+        bool beginBody();
+        bool finishMessage();
+        bool startMultipart(size_t length);
+        ParseStatus fail(const char* code);
+        ArenaString arenaString(const char* data, size_t len);
+        HeaderIterator put(StringMap& table, const char* key, size_t keyLen,
+                           const char* value, size_t valueLen);
+        HeaderIterator put(StringMap& table, const std::string& key, const std::string& value);
+        HeaderIterator findHeader(const char* name);
+        void dropTables();
+        void setPath(const char* path, size_t len);
+
+        Request(const Request&);
+        Request& operator=(const Request&);
 
+    public:
         /**
-         * @brief Validates if a string is a valid IPv4 address
-         * @param hostValue Reference to potential IP address string (may include port)
-         * @return true if valid IP address format, false otherwise
-         * 
-         * Checks if the string is a properly formatted IPv4 address with optional port.
-         * Valid formats include "192.168.1.1" or "192.168.1.1:8080".
-         * If valid, sets isIp=true, updates Port (default 80 if not specified),
-         * and may modify hostValue to remove port component.
+         * @brief Parses the HTTP request start line (method, path, version)
+         * @param line The first line of the HTTP request, without CRLF
+         * @param len Length of the line
+         * @return true if parsing successful, false otherwise (error_code set)
          */
-        bool isValidIpAddress(std::string& hostValue);
+        bool parseStartLine(const char* line, size_t len);
 
         /**
-         * @brief Validates if a string is a valid domain name
-         * @param hostValue Reference to potential domain name string (may include port)
-         * @return true if valid domain name format, false otherwise
-         * 
-         * Checks if the string follows proper domain name formatting rules.
-         * Validates character set (alphanumeric, dots, hyphens) and structure.
-         * Handles domains with optional port (e.g., "example.com:8080").
-         * If valid, sets isIp=false, updates Port (default 80 if not specified),
-         * and may modify hostValue to remove port component.
+         * @brief Parses one HTTP header line
+         * @param line A single header line in "key: value" format, without CRLF
+         * @param len Length of the line
+         * @return true if parsing successful, false otherwise (error_code set)
          */
-        bool isValidDomainName(std::string& hostValue);
-
+        bool parseHeaders(const char* line, size_t len);
 
         /**
-         * @brief Validates if the provided host is in correct format
-         * @param Host The host string to validate (IP:port or domain:port)
-         * @return true if host format is valid, false otherwise
+         * @brief Parses a Host header value in a single pass
+         * @param value Header value: host name or IPv4 address, optional ":port"
+         * @return true if the value is well formed
+         *
+         * Valid names use letters, digits, dots and hyphens and do not start
+         * with a dot or hyphen; an all-numeric host must be a dotted IPv4
+         * address. On success sets Host (lowercased, port removed), Port
+         * (80 when absent) and isIp.
          */
-        bool isValidHost(std::string& Host);
+        bool parseHost(const std::string& value);
 
         /**
          * @brief Parses query string parameters from URL
@@ -141,13 +190,6 @@ class Request
         void addQueryParam(const std::string& key, const std::string& value);
 
 
-        /**
-         * @brief Parses HTTP request body data
-         * @param body_data Raw body content as string
-         * @return true if parsing successful, false otherwise
-         */
-        bool parseBody(const std::string& body_data);
-
     /**
      * @brief Parse body based on content type (state-machine dispatch)
      * @param body_data Raw body data (already assembled if chunked)
@@ -198,13 +240,6 @@ class Request
          */
         std::string urlEncode(const std::string& str);
 
-        /**
-         * @brief Parses chunked transfer encoding data
-         * @param chunked_data Raw chunked data
-         * @return true if parsing successful, false otherwise
-         */
-        bool parseChunkedTransfer(const std::string& chunked_data);
-
         /**
          * @brief Extracts CGI-related information from request
          * @return true if request contains CGI elements, false otherwise
@@ -229,24 +264,6 @@ class Request
          */
         bool validatePath() const;
 
-        /**
-         * @brief Validates host header format
-         * @param host Host string to validate
-         * @return true if host is valid, false otherwise
-         */
-        bool validateHost(const std::string& host);
-
-    // Split parsing API for multiplexed reader
-    // Parse start-line and header fields only (no body)
-    bool parseHeadersSection(const std::string& headers_section);
-
-    // Parse body based on headers (Content-Length or chunked), then cookies/CGI/validate
-    bool parseBodySection(const std::string& body_section);
-
-    // Helpers for body handling
-    bool hasChunkedEncoding() const;
-    size_t expectedContentLength() const;
-
     public:
         /**
          * @brief Default constructor - initializes empty request
@@ -265,13 +282,31 @@ class Request
         ~Request();
 
         /**
-         * @brief Main parsing function that processes raw HTTP data from socket
-         * @param clientFd Client file descriptor
-         * @param buffer Raw HTTP request data
-         * @param bufferSize Size of the buffer
-         * @return true if request was successfully parsed and is valid
+         * @brief Feeds received bytes to the incremental parser
+         * @param data Next bytes of the connection (may be NULL when len is 0)
+         * @param len Number of bytes available
+         * @param used Receives how many bytes belong to this request
+         * @return PARSE_AGAIN, PARSE_HEADERS_DONE, PARSE_DONE or PARSE_ERROR
+         *
+         * The parser keeps its position (request line, headers, body, chunk
+         * size, trailers) between calls, so bytes can be handed over in any
+         * split as they arrive. Only a line cut by the end of data is buffered;
+         * everything else is decoded in place into the request fields. Bytes
+         * past the end of the message are left unused for the next request.
          */
-        bool parseFromSocket(int clientFd, const std::string& buffer, size_t bufferSize);
+        ParseStatus feed(const char* data, size_t len, size_t& used);
+
+        /**
+         * @brief Sets the largest body accepted (checked before it is read)
+         * @param limit Maximum body size in bytes, 0 for no limit
+         */
+        void setBodyLimit(size_t limit);
+
+        /**
+         * @brief Checks whether any byte of the current message was received
+         * @return true once the parser has left its initial state
+         */
+        bool hasStarted() const;
 
 
         /**
@@ -337,6 +372,12 @@ class Request
          */
         void setClientAddr(const sockaddr_in& addr);
 
+        /**
+         * @brief Sets the local port the connection was accepted on
+         * @param port Listener port (kept across reset())
+         */
+        void setLocalPort(int port);
+
         /**
          * @brief Gets the HTTP method
          * @return Reference to method string
@@ -358,9 +399,9 @@ class Request
         /**
          * @brief Gets value of specific HTTP header
          * @param key Header name to lookup
-         * @return Reference to header value, or key if not found
+         * @return Copy of the header value, or key if not found
          */
-        const std::string&    getHeader(const std::string& key) const; // OK
+        std::string           getHeader(const std::string& key) const; // OK
 
         /**
          * @brief Gets the request body content
@@ -402,19 +443,19 @@ class Request
          * @brief Gets all parsed query parameters
          * @return Const reference to query parameters map
          */
-        const std::map<std::string, std::string>&   getQueryParams() const; // OK
+        const StringMap&                            getQueryParams() const; // OK
 
         /**
          * @brief Gets all uploaded files (multipart form data)
          * @return Const reference to uploads map
          */
-        const std::map<std::string, FilePart>&      getUploads() const;
+        const UploadMap&                            getUploads() const;
 
         /**
          * @brief Gets CGI environment variables
          * @return Const reference to CGI environment map
          */
-        const std::map<std::string, std::string>&   getCGIEnv() const;
+        const StringMap&                            getCGIEnv() const;
 
         /**
          * @brief Gets the CGI file extension if detected
@@ -426,19 +467,13 @@ class Request
          * @brief Gets all parsed HTTP cookies
          * @return Const reference to cookies map
          */
-        const std::map<std::string, std::string>&   getCookies() const;
-
-        /**
-         * @brief Gets chunks from chunked transfer encoding
-         * @return Const reference to chunks vector
-         */
-        const std::vector<std::string>&             getChunks() const;
+        const StringMap&                            getCookies() const;
 
         /**
          * @brief Gets all HTTP headers
          * @return Const reference to headers map
          */
-        const std::map<std::string, std::string>& getAllHeaders() const;
+        const StringMap& getAllHeaders() const;
 
         /**
          * @brief Checks if request parsing is complete
@@ -490,25 +525,28 @@ class Request
         void reset();
 
         /**
-         * @brief Gets server configuration based on host or server name
-         * @param serverToFind Host or server name to match
-         * @param serversConfigs Configuration containing all servers
-         * @return Matching server configuration
+         * @brief Matches and sets the server configuration for this request
+         * @param vhosts Virtual host index of the configuration set with setServerConfig()
+         *
+         * Looks up the local port of the connection and the Host header name,
+         * falling back to the port's default server.
          */
-        Config getserverConfig(std::string host , int port, bool isIp) const ;
+        void matchServerConfiguration(const VirtualHosts& vhosts);
 
         /**
-         * @brief Matches and sets the appropriate server configuration for this request
-         * Uses the parsed Host header and port to find the matching server configuration
-         * and updates the request's server config automatically
+         * @brief Routes the request once through the matched server's route table
+         *
+         * Fills route (matched location, filesystem path, CGI flag, method
+         * allowed) for every handler to reuse. Call after
+         * matchServerConfiguration().
          */
-        void matchServerConfiguration();
+        void resolveRoute();
 
         /**
-         * @brief Sets the server configuration for this request
-         * @param config string containing  host and port and a boolean indicating if it is an IP
+         * @brief Sets the configuration this request is matched against
+         * @param config Shared snapshot; must outlive the request
          */
-        void setServerConfig(const Config& config);
+        void setServerConfig(const Config* config);
 
         void setChunked(bool ischunked);
 
@@ -531,5 +569,11 @@ class Request
          */
         const Config::ServerConfig* getCurrentServer() const;
 
+        /**
+         * @brief Directory uploads of the routed request are stored in
+         * @return upload_path of the route, else its root (no trailing slash)
+         */
+        std::string uploadDirectory() const;
+
     
 };
@@ -1,4 +1,7 @@
 #include "Utils.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
 
 
 std::string stringToLower(std::string& str)
@@ -11,9 +14,14 @@ std::string stringToLower(std::string& str)
 
 bool isValidKey(const std::string &key)
 {
-    if (key.empty())
+    return isValidKey(key.data(), key.size());
+}
+
+bool isValidKey(const char *key, size_t len)
+{
+    if (len == 0)
         return false;
-    for (size_t i = 0; i < key.size(); i++)
+    for (size_t i = 0; i < len; i++)
     {
         if (!isprint(key[i]) || key[i] == ' ')
             return false;
@@ -23,7 +31,12 @@ bool isValidKey(const std::string &key)
 
 bool isValidValue(const std::string &value)
 {
-    for (size_t i = 0; i < value.size(); i++)
+    return isValidValue(value.data(), value.size());
+}
+
+bool isValidValue(const char *value, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
     {
         if (!isprint(value[i]))
             return false;
@@ -33,4 +46,80 @@ bool isValidValue(const std::string &value)
 
 bool isValidPort(int port){
     return port >= 1 && port <= 65535;
-}
\ No newline at end of file
+}
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string httpDate(time_t t){
+    struct tm tm;
+    char buf[64];
+    gmtime_r(&t, &tm);
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+/**
+ * @brief Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT")
+ * @return false if the value is not in that format
+ */
+bool parseHttpDate(const std::string &value, time_t &t){
+    return parseHttpDate(value.c_str(), t);
+}
+
+bool parseHttpDate(const char *value, time_t &t){
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0')
+        return false;
+    t = timegm(&tm);
+    return t != static_cast<time_t>(-1);
+}
+
+/**
+ * @brief Strong entity tag of a file version: inode, size and mtime in hex
+ */
+std::string entityTag(ino_t ino, off_t size, time_t mtime){
+    char tag[80];
+    snprintf(tag, sizeof(tag), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(ino),
+             static_cast<unsigned long>(size), static_cast<unsigned long>(mtime));
+    return tag;
+}
+
+/**
+ * @brief Tells whether an Accept-Encoding value takes a content coding
+ *
+ * A listed coding wins over "*"; either one with q=0 refuses it.
+ */
+bool acceptsCoding(const std::string &acceptEncoding, const std::string &coding){
+    return acceptsCoding(acceptEncoding.data(), acceptEncoding.size(), coding);
+}
+
+bool acceptsCoding(const char *acceptEncoding, size_t len, const std::string &coding){
+    int listed = -1, wildcard = -1;     // -1 absent, 0 refused, 1 accepted
+    size_t pos = 0;
+    while (pos < len){
+        const char *end = static_cast<const char *>(memchr(acceptEncoding + pos, ',', len - pos));
+        size_t comma = end ? static_cast<size_t>(end - acceptEncoding) : len;
+        std::string item(acceptEncoding + pos, comma - pos);
+        pos = comma + 1;
+        size_t semi = item.find(';');
+        std::string name = item.substr(0, semi);
+        size_t b = name.find_first_not_of(" \t");
+        size_t e = name.find_last_not_of(" \t");
+        if (b == std::string::npos)
+            continue;
+        name = name.substr(b, e - b + 1);
+        stringToLower(name);
+        int accepted = 1;
+        if (semi != std::string::npos){
+            size_t q = item.find("q=", semi);
+            if (q != std::string::npos && atof(item.c_str() + q + 2) <= 0.0)
+                accepted = 0;
+        }
+        if (name == coding || (coding == "gzip" && name == "x-gzip"))
+            listed = accepted;
+        else if (name == "*")
+            wildcard = accepted;
+    }
+    return listed >= 0 ? listed == 1 : wildcard == 1;
+}
@@ -2,8 +2,18 @@
 #include <string>
 #include <cctype>
 #include <typeinfo>  
+#include <ctime>
+#include <sys/types.h>
 
 std::string stringToLower(std::string& str);
 bool isValidKey(const std::string &key);
+bool isValidKey(const char *key, size_t len);
 bool isValidValue(const std::string &value);
-bool isValidPort(int port);
\ No newline at end of file
+bool isValidValue(const char *value, size_t len);
+bool isValidPort(int port);
+std::string httpDate(time_t t);
+bool parseHttpDate(const std::string &value, time_t &t);
+bool parseHttpDate(const char *value, time_t &t);
+std::string entityTag(ino_t ino, off_t size, time_t mtime);
+bool acceptsCoding(const std::string &acceptEncoding, const std::string &coding);
+bool acceptsCoding(const char *acceptEncoding, size_t len, const std::string &coding);
@@ -0,0 +1,257 @@
+#include "Logger.hpp"
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+/**
+ * @brief Single-producer/single-consumer byte ring, one per logging thread
+ *
+ * head only moves forward in the owning thread, tail only in the drainer;
+ * both are free-running counters, so head - tail is the queued byte count.
+ */
+struct LogRing {
+    static const size_t CAPACITY = 1 << 16;
+
+    char data[CAPACITY];
+    size_t head;                // Bytes ever queued (producer)
+    size_t tail;                // Bytes ever drained (consumer)
+    unsigned long dropped;      // Lines lost because the ring was full
+    LogRing* next;              // Registry link (rings are never freed)
+
+    LogRing() : head(0), tail(0), dropped(0), next(NULL) {}
+};
+
+volatile int Logger::runtimeLevel = LOG_LEVEL_INFO;
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;   // Ring list, flusher start
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;      // One drainer at a time
+static LogRing* rings = NULL;                   // All rings, newest first
+static __thread LogRing* localRing = NULL;      // Ring of the calling thread
+static int sinkFd = STDERR_FILENO;              // Destination of drained batches
+static volatile int flusherRunning = 0;         // Flusher thread alive in this process
+static volatile int stopRequested = 0;          // Asks the flusher to exit
+static pthread_t flusherThread;
+static bool forkHandlersSet = false;
+static time_t clockSecond = 0;                  // Wall clock, refreshed once per flusher pass
+static __thread time_t stampSecond = 0;         // Second the thread's stamp was formatted for
+static __thread char stamp[32];                 // "YYYY/MM/DD HH:MM:SS " prefix of each record
+static __thread size_t stampLen = 0;
+
+static const char* const levelTags[] = { "[DEBUG] ", "[INFO] ", "[WARN] ", "[ERROR] " };
+
+/* ------------------------------- draining ------------------------------- */
+
+static char batch[1 << 16];     // Staging buffer, only touched under drainLock
+static size_t batchLen = 0;
+
+static void writeBatch() {
+    size_t off = 0;
+    while (off < batchLen) {
+        ssize_t w = ::write(sinkFd, batch + off, batchLen - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break; // nowhere to report it; drop the batch
+        off += static_cast<size_t>(w);
+    }
+    batchLen = 0;
+}
+
+static void appendBatch(const char* data, size_t len) {
+    while (len > 0) {
+        if (batchLen == sizeof(batch))
+            writeBatch();
+        size_t n = sizeof(batch) - batchLen;
+        if (n > len)
+            n = len;
+        memcpy(batch + batchLen, data, n);
+        batchLen += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Moves everything queued on every ring to the sink; caller holds drainLock
+static size_t drainLocked() {
+    size_t total = 0;
+    for (LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = ring->tail;
+        while (tail != head) {
+            size_t offset = tail & (LogRing::CAPACITY - 1);
+            size_t chunk = head - tail;
+            if (chunk > LogRing::CAPACITY - offset)
+                chunk = LogRing::CAPACITY - offset;
+            appendBatch(ring->data + offset, chunk);
+            tail += chunk;
+            total += chunk;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0UL, __ATOMIC_RELAXED);
+        if (dropped) {
+            std::ostringstream note;
+            note << levelTags[LOG_LEVEL_WARN] << "logger dropped " << dropped << " lines (ring full)\n";
+            appendBatch(note.str().data(), note.str().size());
+        }
+    }
+    if (batchLen)
+        writeBatch();
+    return total;
+}
+
+static void* flusherMain(void*) {
+    // Back off while idle so a quiet server does not wake up constantly
+    useconds_t delay = 2000;
+    while (!__atomic_load_n(&stopRequested, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&clockSecond, time(NULL), __ATOMIC_RELAXED);
+        pthread_mutex_lock(&drainLock);
+        size_t drained = drainLocked();
+        pthread_mutex_unlock(&drainLock);
+        delay = drained ? 2000 : (delay < 50000 ? delay * 2 : 50000);
+        usleep(delay);
+    }
+    return NULL;
+}
+
+/* --------------------------------- fork --------------------------------- */
+
+static void beforeFork() {
+    pthread_mutex_lock(&registryLock);
+    pthread_mutex_lock(&drainLock);
+    drainLocked();
+}
+
+static void afterForkParent() {
+    pthread_mutex_unlock(&drainLock);
+    pthread_mutex_unlock(&registryLock);
+}
+
+static void afterForkChild() {
+    // The flusher thread did not survive fork(); the next write() restarts it
+    flusherRunning = 0;
+    stopRequested = 0;
+    pthread_mutex_unlock(&drainLock);
+    pthread_mutex_unlock(&registryLock);
+}
+
+/* -------------------------------- public -------------------------------- */
+
+static void startFlusher() {
+    pthread_mutex_lock(&registryLock);
+    if (!forkHandlersSet) {
+        pthread_atfork(beforeFork, afterForkParent, afterForkChild);
+        forkHandlersSet = true;
+    }
+    if (!flusherRunning) {
+        stopRequested = 0;
+        if (pthread_create(&flusherThread, NULL, flusherMain, NULL) == 0)
+            __atomic_store_n(&flusherRunning, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registryLock);
+}
+
+static LogRing* registerRing() {
+    LogRing* ring = new LogRing();
+    pthread_mutex_lock(&registryLock);
+    ring->next = rings;
+    __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registryLock);
+    localRing = ring;
+    return ring;
+}
+
+// Time prefix of a record; reformatted only when the second changes
+static void refreshStamp() {
+    time_t now = 0;
+    if (__atomic_load_n(&flusherRunning, __ATOMIC_ACQUIRE))
+        now = __atomic_load_n(&clockSecond, __ATOMIC_RELAXED);
+    if (now == 0)
+        now = time(NULL);   // no flusher pass yet: read the clock directly
+    if (now == stampSecond && stampLen)
+        return;
+    struct tm local;
+    localtime_r(&now, &local);
+    stampLen = strftime(stamp, sizeof(stamp), "%Y/%m/%d %H:%M:%S ", &local);
+    stampSecond = now;
+}
+
+static void copyIn(LogRing* ring, size_t pos, const char* data, size_t len) {
+    size_t offset = pos & (LogRing::CAPACITY - 1);
+    size_t first = LogRing::CAPACITY - offset;
+    if (first > len)
+        first = len;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, len - first);
+}
+
+void Logger::write(int level, const std::string& message) {
+    if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_ERROR)
+        level = LOG_LEVEL_ERROR;
+    LogRing* ring = localRing ? localRing : registerRing();
+    if (!__atomic_load_n(&flusherRunning, __ATOMIC_ACQUIRE))
+        startFlusher();
+
+    refreshStamp();
+    const char* tag = levelTags[level];
+    size_t tagLen = strlen(tag);
+    size_t len = stampLen + tagLen + message.size() + 1;
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (len > LogRing::CAPACITY - (head - tail)) {
+        __atomic_add_fetch(&ring->dropped, 1UL, __ATOMIC_RELAXED);
+        return;
+    }
+    copyIn(ring, head, stamp, stampLen);
+    copyIn(ring, head + stampLen, tag, tagLen);
+    copyIn(ring, head + stampLen + tagLen, message.data(), message.size());
+    copyIn(ring, head + len - 1, "\n", 1);
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+    // Without a flusher thread, stay correct by writing synchronously
+    if (!__atomic_load_n(&flusherRunning, __ATOMIC_ACQUIRE))
+        flush();
+}
+
+void Logger::flush() {
+    pthread_mutex_lock(&drainLock);
+    drainLocked();
+    pthread_mutex_unlock(&drainLock);
+}
+
+void Logger::shutdown() {
+    if (__atomic_load_n(&flusherRunning, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&stopRequested, 1, __ATOMIC_RELEASE);
+        pthread_join(flusherThread, NULL);
+        flusherRunning = 0;
+    }
+    flush();
+}
+
+int Logger::levelFromName(const std::string& name) {
+    if (name == "debug") return LOG_LEVEL_DEBUG;
+    if (name == "info") return LOG_LEVEL_INFO;
+    if (name == "warn") return LOG_LEVEL_WARN;
+    if (name == "error") return LOG_LEVEL_ERROR;
+    if (name == "off") return LOG_LEVEL_OFF;
+    return -1;
+}
+
+int Logger::configure(int level, const std::string& path) {
+    runtimeLevel = level;
+    if (path.empty())
+        return 0;
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    pthread_mutex_lock(&drainLock);
+    drainLocked();
+    if (sinkFd != STDERR_FILENO)
+        close(sinkFd);
+    sinkFd = fd;
+    pthread_mutex_unlock(&drainLock);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+
+/**
+ * @brief Levels in increasing severity; a message is kept when its level is
+ *        at least both the compile-time and the runtime threshold
+ */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF   4
+
+/**
+ * Compile-time threshold: build with -DLOG_COMPILE_LEVEL=LOG_LEVEL_INFO (for
+ * example) and every LOG_DEBUG call disappears from the binary, arguments
+ * included.
+ */
+#ifndef LOG_COMPILE_LEVEL
+# define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief Logs a stream expression at a level
+ * The expression is only formatted when the level is enabled, so disabled
+ * levels cost one predictable branch (or nothing when compiled out).
+ * Usage: LOG_INFO("accepted client_fd=" << fd);
+ */
+#define LOG_AT(level, expr) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && Logger::enabled(level)) { \
+            std::ostringstream log_stream_; \
+            log_stream_ << expr; \
+            Logger::write((level), log_stream_.str()); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(expr) LOG_AT(LOG_LEVEL_DEBUG, expr)
+#define LOG_INFO(expr)  LOG_AT(LOG_LEVEL_INFO, expr)
+#define LOG_WARN(expr)  LOG_AT(LOG_LEVEL_WARN, expr)
+#define LOG_ERROR(expr) LOG_AT(LOG_LEVEL_ERROR, expr)
+
+/**
+ * @brief Asynchronous process-wide logger
+ *
+ * Every thread that logs gets its own single-producer/single-consumer byte
+ * ring, so write() never takes a lock or makes a syscall: it copies the
+ * formatted line into the ring and returns (a full ring drops the line and
+ * counts it). A background thread drains all rings every few milliseconds
+ * and hands each batch to one write() on the log file or stderr. Lines
+ * start with the local time ("2024/01/31 12:00:00 [INFO] ..."), read from a
+ * clock the flusher refreshes on every pass rather than once per line.
+ *
+ * fork() is handled with pthread_atfork: the parent drains everything before
+ * forking so the child never repeats inherited lines, and the child restarts
+ * its flusher on its first log call (a CGI child execs before that happens).
+ */
+class Logger {
+public:
+    /**
+     * @brief Sets the runtime threshold and the destination
+     * @param level One of LOG_LEVEL_*
+     * @param path Log file (opened for append), or empty for stderr
+     * @return 0 on success, -1 if the file cannot be opened (stderr is kept)
+     */
+    static int configure(int level, const std::string& path);
+
+    /**
+     * @brief Parses a level name
+     * @param name "debug", "info", "warn", "error" or "off"
+     * @return Matching LOG_LEVEL_* value, or -1 if unknown
+     */
+    static int levelFromName(const std::string& name);
+
+    /**
+     * @brief Checks the runtime threshold
+     * @param level LOG_LEVEL_* of the message
+     * @return true if messages of this level are kept
+     */
+    static bool enabled(int level) {
+        return level >= runtimeLevel;
+    }
+
+    /**
+     * @brief Queues one line on the calling thread's ring
+     * @param level LOG_LEVEL_* of the message (selects the [TAG] prefix)
+     * @param message Text without trailing newline
+     */
+    static void write(int level, const std::string& message);
+
+    /**
+     * @brief Writes out everything queued so far, synchronously
+     * Called before exit/_exit so no line is lost
+     */
+    static void flush();
+
+    /**
+     * @brief Stops the flusher thread after a final flush
+     */
+    static void shutdown();
+
+private:
+    static volatile int runtimeLevel;   // Runtime threshold (read on every log call)
+
+    Logger();
+};
@@ -0,0 +1,201 @@
+#include "EventBackend.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+EventBackend* EventBackend::create(const std::string& name) {
+    if (name == "epoll") {
+        EpollBackend* ep = new EpollBackend();
+        if (ep->isValid())
+            return ep;
+        delete ep;
+    }
+    return new PollBackend();
+}
+
+/* ---------------------------- poll() backend ---------------------------- */
+
+PollBackend::PollBackend() {}
+
+PollBackend::~PollBackend() {}
+
+int PollBackend::indexOf(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= position.size())
+        return -1;
+    return position[fd];
+}
+
+int PollBackend::add(int fd, short events, bool edgeTriggered) {
+    (void)edgeTriggered;
+    if (fd < 0 || indexOf(fd) != -1)
+        return -1;
+    pollfd p;
+    memset(&p, 0, sizeof(p));
+    p.fd = fd;
+    p.events = events;
+    if (static_cast<size_t>(fd) >= position.size())
+        position.resize(fd + 1, -1);
+    position[fd] = static_cast<int>(fds.size());
+    fds.push_back(p);
+    return 0;
+}
+
+int PollBackend::addListener(int fd) {
+    return add(fd, POLLIN, false);
+}
+
+int PollBackend::modify(int fd, short events) {
+    int idx = indexOf(fd);
+    if (idx == -1)
+        return -1;
+    fds[idx].events = events;
+    return 0;
+}
+
+void PollBackend::remove(int fd) {
+    int idx = indexOf(fd);
+    if (idx == -1)
+        return;
+    // Swap-remove: the last entry takes the freed position
+    fds[idx] = fds.back();
+    position[fds[idx].fd] = idx;
+    fds.pop_back();
+    position[fd] = -1;
+}
+
+int PollBackend::wait(std::vector<Event>& ready, int timeoutMs) {
+    ready.clear();
+    int n = poll(fds.data(), fds.size(), timeoutMs);
+    if (n == -1)
+        return (errno == EINTR) ? 0 : -1;
+    for (size_t i = 0; i < fds.size() && static_cast<int>(ready.size()) < n; i++) {
+        if (fds[i].revents) {
+            Event ev;
+            ev.fd = fds[i].fd;
+            ev.revents = fds[i].revents;
+            ready.push_back(ev);
+        }
+    }
+    return static_cast<int>(ready.size());
+}
+
+const char* PollBackend::name() const {
+    return "poll";
+}
+
+bool PollBackend::supportsEdgeTriggered() const {
+    return false;
+}
+
+/* ----------------------------- epoll backend ----------------------------- */
+
+static unsigned int toEpollMask(short events) {
+    unsigned int mask = 0;
+    if (events & POLLIN)  mask |= EPOLLIN | EPOLLRDHUP;
+    if (events & POLLOUT) mask |= EPOLLOUT;
+    return mask;
+}
+
+static short fromEpollMask(unsigned int mask) {
+    short revents = 0;
+    if (mask & (EPOLLIN | EPOLLRDHUP)) revents |= POLLIN;
+    if (mask & EPOLLOUT) revents |= POLLOUT;
+    if (mask & EPOLLHUP) revents |= POLLHUP;
+    if (mask & EPOLLERR) revents |= POLLERR;
+    return revents;
+}
+
+EpollBackend::EpollBackend() : epfd(epoll_create1(EPOLL_CLOEXEC)), watched(0) {
+    buffer.resize(64);
+}
+
+EpollBackend::~EpollBackend() {
+    if (epfd >= 0)
+        close(epfd);
+}
+
+bool EpollBackend::isValid() const {
+    return epfd >= 0;
+}
+
+int EpollBackend::add(int fd, short events, bool edgeTriggered) {
+    if (fd < 0)
+        return -1;
+    if (static_cast<size_t>(fd) >= edgeFlags.size())
+        edgeFlags.resize(fd + 1, 0);
+    edgeFlags[fd] = edgeTriggered ? static_cast<unsigned int>(EPOLLET) : 0u;
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollMask(events) | edgeFlags[fd];
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        return -1;
+    watched++;
+    return 0;
+}
+
+int EpollBackend::addListener(int fd) {
+    if (fd < 0)
+        return -1;
+    if (static_cast<size_t>(fd) >= edgeFlags.size())
+        edgeFlags.resize(fd + 1, 0);
+    edgeFlags[fd] = 0;
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        // Kernels before 4.5 reject the flag; every worker is woken then
+        if (errno != EINVAL)
+            return -1;
+        return add(fd, POLLIN, false);
+    }
+    watched++;
+    return 0;
+}
+
+int EpollBackend::modify(int fd, short events) {
+    if (fd < 0 || static_cast<size_t>(fd) >= edgeFlags.size())
+        return -1;
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollMask(events) | edgeFlags[fd];
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollBackend::remove(int fd) {
+    if (fd < 0)
+        return;
+    // The fd may already be closed (CGI pipes); the kernel then dropped it itself
+    if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) == 0 && watched > 0)
+        watched--;
+    if (static_cast<size_t>(fd) < edgeFlags.size())
+        edgeFlags[fd] = 0;
+}
+
+int EpollBackend::wait(std::vector<Event>& ready, int timeoutMs) {
+    ready.clear();
+    if (buffer.size() < watched && buffer.size() < 4096)
+        buffer.resize(watched < 4096 ? watched : 4096);
+    int n = epoll_wait(epfd, &buffer[0], static_cast<int>(buffer.size()), timeoutMs);
+    if (n == -1)
+        return (errno == EINTR) ? 0 : -1;
+    for (int i = 0; i < n; i++) {
+        Event ev;
+        ev.fd = buffer[i].data.fd;
+        ev.revents = fromEpollMask(buffer[i].events);
+        ready.push_back(ev);
+    }
+    return n;
+}
+
+const char* EpollBackend::name() const {
+    return "epoll";
+}
+
+bool EpollBackend::supportsEdgeTriggered() const {
+    return true;
+}
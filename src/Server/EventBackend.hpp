@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <poll.h>
+#include <sys/epoll.h>
+
+/**
+ * @brief Readiness notification backend used by the event loop
+ *
+ * Hides the multiplexing syscall (poll() or epoll) behind a small interface.
+ * Interest masks and reported events use the POLLIN/POLLOUT/POLLHUP/POLLERR
+ * bits for both backends so the event loop does not depend on which one runs.
+ */
+class EventBackend {
+public:
+    /**
+     * @brief A single readiness notification returned by wait()
+     */
+    struct Event {
+        int fd;         // File descriptor that became ready
+        short revents;  // POLLIN/POLLOUT/POLLHUP/POLLERR bits that fired
+    };
+
+    virtual ~EventBackend() {}
+
+    /**
+     * @brief Starts watching a file descriptor
+     * @param fd File descriptor to watch
+     * @param events Interest mask (POLLIN/POLLOUT)
+     * @param edgeTriggered Request edge-triggered delivery (ignored by poll())
+     * @return 0 on success, -1 on failure
+     */
+    virtual int add(int fd, short events, bool edgeTriggered) = 0;
+
+    /**
+     * @brief Starts watching a listening socket for POLLIN
+     * @param fd Listener, possibly shared with other worker processes
+     * @return 0 on success, -1 on failure
+     * With epoll the listener is registered EPOLLEXCLUSIVE so a new
+     * connection wakes one waiting worker instead of all of them.
+     */
+    virtual int addListener(int fd) = 0;
+
+    /**
+     * @brief Replaces the interest mask of a watched file descriptor
+     * @param fd File descriptor to update
+     * @param events New interest mask
+     * @return 0 on success, -1 on failure
+     */
+    virtual int modify(int fd, short events) = 0;
+
+    /**
+     * @brief Stops watching a file descriptor (must be called before close())
+     * @param fd File descriptor to forget
+     */
+    virtual void remove(int fd) = 0;
+
+    /**
+     * @brief Waits for readiness and fills the ready list
+     * @param ready Output vector, cleared then filled with ready descriptors only
+     * @param timeoutMs Maximum time to block in milliseconds (-1 = forever)
+     * @return Number of ready descriptors, 0 on timeout/EINTR, -1 on error
+     */
+    virtual int wait(std::vector<Event>& ready, int timeoutMs) = 0;
+
+    /**
+     * @brief Gets the backend name for logging
+     * @return "poll" or "epoll"
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief Whether add() honours the edgeTriggered flag
+     * @return true for epoll, false for poll()
+     */
+    virtual bool supportsEdgeTriggered() const = 0;
+
+    /**
+     * @brief Creates a backend by name
+     * @param name "epoll" or "poll"
+     * @return Newly allocated backend (caller owns it); falls back to poll()
+     *         when epoll is requested but unavailable
+     */
+    static EventBackend* create(const std::string& name);
+};
+
+/**
+ * @brief poll() based backend (portable fallback)
+ *
+ * Keeps the pollfd array the kernel scans; wait() still reports only the
+ * descriptors with non-zero revents so the loop body stays O(ready).
+ * add/modify/remove are O(1): an fd-indexed table locates each entry and
+ * removal swaps the last entry into the freed position.
+ */
+class PollBackend : public EventBackend {
+private:
+    std::vector<pollfd> fds;    // Array handed to poll()
+    std::vector<int> position;  // Index of each fd in fds (-1 if absent), indexed by fd
+
+    int indexOf(int fd) const;
+
+public:
+    PollBackend();
+    virtual ~PollBackend();
+
+    virtual int add(int fd, short events, bool edgeTriggered);
+    virtual int addListener(int fd);
+    virtual int modify(int fd, short events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<Event>& ready, int timeoutMs);
+    virtual const char* name() const;
+    virtual bool supportsEdgeTriggered() const;
+};
+
+/**
+ * @brief epoll based backend (Linux)
+ *
+ * The kernel keeps the interest list, so each wakeup costs O(ready) instead
+ * of O(watched). Client sockets may be registered edge-triggered; callers
+ * must then drain reads/writes until EAGAIN.
+ */
+class EpollBackend : public EventBackend {
+private:
+    int epfd;                               // epoll instance
+    std::vector<unsigned int> edgeFlags;    // Per-fd EPOLLET flag, indexed by fd
+    std::vector<epoll_event> buffer;        // epoll_wait() output reused across waits
+    size_t watched;                         // Number of registered descriptors
+
+public:
+    EpollBackend();
+    virtual ~EpollBackend();
+
+    /**
+     * @brief Checks whether the epoll instance was created successfully
+     * @return true if usable
+     */
+    bool isValid() const;
+
+    virtual int add(int fd, short events, bool edgeTriggered);
+    virtual int addListener(int fd);
+    virtual int modify(int fd, short events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<Event>& ready, int timeoutMs);
+    virtual const char* name() const;
+    virtual bool supportsEdgeTriggered() const;
+};
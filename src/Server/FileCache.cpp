@@ -0,0 +1,237 @@
+#include "FileCache.hpp"
+#include "../HTTP/Utils.hpp"
+#include "../Log/Logger.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+/**
+ * @brief File content copied to the heap
+ *
+ * Never mapped from the file: a rewrite in place would change the bytes
+ * under responses already queued with the old length and ETag, and a
+ * truncation would fault on the next access.
+ */
+class CachedBody : public SharedBlock {
+public:
+    CachedBody(const char* bytes, size_t length) {
+        this->bytes = bytes;
+        this->length = length;
+    }
+
+protected:
+    ~CachedBody() { delete[] bytes; }
+};
+
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                                 | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::FileCache(size_t maxBytes, size_t maxFileSize)
+    : inotifyFd(-1), maxBytes(maxBytes), maxFileSize(maxFileSize), usedBytes(0) {
+    if (maxBytes == 0)
+        return;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+        LOG_WARN("file cache disabled: inotify unavailable");
+}
+
+FileCache::~FileCache() {
+    clear();
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+}
+
+void FileCache::disable() {
+    clear();
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+    inotifyFd = -1;
+    watchDirs.clear();
+    dirWatches.clear();
+}
+
+const FileCache::Entry* FileCache::lookup(const std::string& key) {
+    std::map<std::string, EntryList::iterator>::iterator it = index.find(key);
+    if (it == index.end())
+        return NULL;
+    lru.splice(lru.begin(), lru, it->second);
+    return &*it->second;
+}
+
+bool FileCache::watchDirectory(const std::string& dir) {
+    if (dirWatches.count(dir))
+        return true;
+    int wd = inotify_add_watch(inotifyFd, dir.c_str(), WATCH_MASK);
+    if (wd < 0)
+        return false;
+    // One descriptor per inode: a second name for a watched directory would
+    // get events under the first name, so files behind it are not cached
+    if (watchDirs.count(wd))
+        return false;
+    watchDirs[wd] = dir;
+    dirWatches[dir] = wd;
+    return true;
+}
+
+const FileCache::Entry* FileCache::insert(const std::string& key, const std::string& path, int fd,
+                                          const std::string& contentType,
+                                          const std::string& contentEncoding) {
+    if (inotifyFd < 0)
+        return NULL;
+    size_t slash = path.find_last_of('/');
+    std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    // Watch before reading, so a write racing the read still invalidates
+    if (!watchDirectory(dir))
+        return NULL;
+
+    struct stat st;
+    // A descriptor whose name was since removed or replaced no longer
+    // matches what the watch covers
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_nlink == 0)
+        return NULL;
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size > maxFileSize || size > maxBytes)
+        return NULL;
+
+    char* bytes = new char[size ? size : 1];
+    size_t got = 0;
+    while (got < size) {
+        ssize_t r = pread(fd, bytes + got, size - got, static_cast<off_t>(got));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        got += static_cast<size_t>(r);
+    }
+    if (got != size) {
+        delete[] bytes;
+        return NULL;
+    }
+
+    std::map<std::string, EntryList::iterator>::iterator old = index.find(key);
+    if (old != index.end())
+        erase(old->second);
+    while (!lru.empty() && usedBytes + size > maxBytes)
+        erase(--lru.end());
+
+    lru.push_front(Entry());
+    Entry& entry = lru.front();
+    entry.key = key;
+    entry.path = path;
+    entry.mtime = st.st_mtime;
+    entry.lastModified = httpDate(st.st_mtime);
+    entry.etag = entityTag(st.st_ino, st.st_size, st.st_mtime);
+    char length[32];
+    snprintf(length, sizeof(length), "%lu", static_cast<unsigned long>(size));
+    entry.headers = "Content-Length: ";
+    entry.headers += length;
+    entry.headers += "\r\nContent-Type: " + contentType;
+    if (!contentEncoding.empty())
+        entry.headers += "\r\nContent-Encoding: " + contentEncoding;
+    entry.headers += "\r\nETag: " + entry.etag;
+    entry.headers += "\r\nLast-Modified: " + entry.lastModified;
+    entry.headers += "\r\nAccept-Ranges: bytes\r\n";
+    entry.contentType = contentType;
+    entry.contentEncoding = contentEncoding;
+    entry.body = new CachedBody(bytes, size);
+    index[key] = lru.begin();
+    usedBytes += size;
+    return &entry;
+}
+
+void FileCache::erase(EntryList::iterator it) {
+    usedBytes -= it->body->size();
+    it->body->release();
+    index.erase(it->key);
+    lru.erase(it);
+}
+
+/**
+ * @brief Tells whether two paths are the same file up to a .br/.gz suffix
+ */
+static bool sameOrSidecar(const std::string& a, const std::string& b) {
+    const std::string& longer = a.size() > b.size() ? a : b;
+    const std::string& shorter = a.size() > b.size() ? b : a;
+    size_t extra = longer.size() - shorter.size();
+    if (extra != 0 && extra != 3)
+        return false;
+    if (longer.compare(0, shorter.size(), shorter) != 0)
+        return false;
+    return extra == 0 || longer.compare(shorter.size(), 3, ".br") == 0
+                      || longer.compare(shorter.size(), 3, ".gz") == 0;
+}
+
+void FileCache::dropPath(const std::string& path) {
+    // Events are rare next to lookups, so a scan is fine here
+    for (EntryList::iterator it = lru.begin(); it != lru.end();) {
+        EntryList::iterator next = it;
+        ++next;
+        if (sameOrSidecar(it->path, path))
+            erase(it);
+        it = next;
+    }
+}
+
+void FileCache::dropTree(const std::string& dir) {
+    std::string prefix = (dir == "/") ? dir : dir + "/";
+    for (EntryList::iterator it = lru.begin(); it != lru.end();) {
+        EntryList::iterator next = it;
+        ++next;
+        if (it->path.compare(0, prefix.size(), prefix) == 0)
+            erase(it);
+        it = next;
+    }
+}
+
+void FileCache::clear() {
+    while (!lru.empty())
+        erase(lru.begin());
+}
+
+void FileCache::processEvents() {
+    if (inotifyFd < 0)
+        return;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(inotifyFd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        for (char* p = buf; p < buf + n;) {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                LOG_WARN("file cache: inotify queue overflow, dropping every entry");
+                clear();
+                continue;
+            }
+            std::map<int, std::string>::iterator watch = watchDirs.find(ev->wd);
+            if (watch == watchDirs.end())
+                continue;
+            const std::string& dir = watch->second;
+            if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // The path no longer names this directory; forget the watch
+                // so a directory created there later is watched afresh
+                dropTree(dir);
+                if (!(ev->mask & IN_IGNORED))
+                    inotify_rm_watch(inotifyFd, ev->wd);
+                dirWatches.erase(dir);
+                watchDirs.erase(watch);
+                continue;
+            }
+            if (ev->len == 0)
+                continue;
+            std::string name(ev->name);
+            std::string path = (dir == "/") ? dir + name : dir + "/" + name;
+            dropPath(path);
+            // A renamed or removed subdirectory takes its files with it
+            if (ev->mask & IN_ISDIR)
+                dropTree(path);
+        }
+    }
+}
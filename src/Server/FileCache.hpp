@@ -0,0 +1,111 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <ctime>
+#include <sys/types.h>
+#include "OutputQueue.hpp"
+
+/**
+ * @brief Size-bounded LRU cache of static files, one per event loop
+ *
+ * Entries hold a heap copy of the file content as a SharedBlock that output
+ * queues reference directly, plus the pre-rendered Content-Type,
+ * Content-Length, Last-Modified, ETag and Accept-Ranges header lines. A hit therefore costs a map lookup and the
+ * socket write.
+ *
+ * Staleness is handled by inotify: the directory holding each cached file
+ * is watched (inotify is not recursive, so watching only the document
+ * roots would miss files in subdirectories) and any change to a name in
+ * it drops the matching entries. A file and its .br/.gz sidecars count as
+ * one name, since either may be what a key was answered with. Files
+ * reached through a symlink below the root are not inserted, as re-pointing
+ * the link would go unheard. Without inotify the cache stays empty.
+ */
+class FileCache {
+public:
+    /**
+     * @brief A cached file
+     */
+    struct Entry {
+        std::string key;            // Lookup key chosen by the caller
+        std::string path;           // File the content was read from
+        std::string headers;        // Pre-rendered header lines, each ending in CRLF
+        std::string contentType;
+        std::string contentEncoding;    // "br"/"gzip" when read from a sidecar, else ""
+        std::string etag;           // Quoted entity tag
+        std::string lastModified;   // HTTP date of mtime
+        time_t mtime;
+        SharedBlock* body;          // Content; queued ranges keep their own reference
+    };
+
+    /**
+     * @brief Constructor
+     * @param maxBytes Total content size kept (0 disables the cache)
+     * @param maxFileSize Largest file that is cached
+     */
+    FileCache(size_t maxBytes, size_t maxFileSize);
+
+    /**
+     * @brief Destructor - releases every entry and closes the inotify descriptor
+     */
+    ~FileCache();
+
+    /**
+     * @brief Descriptor to watch for POLLIN; call processEvents() then
+     * @return inotify descriptor, or -1 when the cache is disabled
+     */
+    int notifyFd() const { return inotifyFd; }
+
+    /**
+     * @brief Turns the cache off for good (e.g. notifyFd() cannot be watched)
+     */
+    void disable();
+
+    /**
+     * @brief Finds an entry; a hit becomes the most recently used
+     * @param key Key given to insert()
+     * @return The entry, or NULL
+     */
+    const Entry* lookup(const std::string& key);
+
+    /**
+     * @brief Reads an open file into the cache
+     * @param key Lookup key
+     * @param path Path of the file (its directory gets watched)
+     * @param fd Open descriptor of that file (left open)
+     * @param contentType Value of the Content-Type header
+     * @param contentEncoding Content-Encoding of a .br/.gz sidecar ("" for none)
+     * @return The new entry, or NULL if the file is not cacheable
+     */
+    const Entry* insert(const std::string& key, const std::string& path, int fd,
+                        const std::string& contentType, const std::string& contentEncoding = "");
+
+    /**
+     * @brief Drains pending inotify events and drops the entries they affect
+     */
+    void processEvents();
+
+private:
+    typedef std::list<Entry> EntryList;
+
+    int inotifyFd;
+    size_t maxBytes;
+    size_t maxFileSize;
+    size_t usedBytes;
+    EntryList lru;                                  // Most recently used first
+    std::map<std::string, EntryList::iterator> index;
+    std::map<int, std::string> watchDirs;           // Watch descriptor -> directory
+    std::map<std::string, int> dirWatches;          // Directory -> watch descriptor
+
+    bool watchDirectory(const std::string& dir);
+    void erase(EntryList::iterator it);
+    void dropPath(const std::string& path);
+    void dropTree(const std::string& dir);
+    void clear();
+
+    FileCache(const FileCache&);
+    FileCache& operator=(const FileCache&);
+};
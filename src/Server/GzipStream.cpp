@@ -0,0 +1,75 @@
+#include "GzipStream.hpp"
+#include "../HTTP/Utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+GzipStream::GzipStream(int level) : ready(false) {
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: largest window, gzip header and trailer instead of zlib's
+    ready = deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+GzipStream::~GzipStream() {
+    if (ready)
+        deflateEnd(&zs);
+}
+
+void GzipStream::write(const char* data, size_t length, OutputQueue& out) {
+    if (!ready || length == 0)
+        return;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(length);
+    drain(Z_NO_FLUSH, out);
+}
+
+void GzipStream::finish(OutputQueue& out) {
+    if (ready) {
+        zs.next_in = NULL;
+        zs.avail_in = 0;
+        drain(Z_FINISH, out);
+    }
+    std::string last = "0\r\n\r\n";
+    out.pushMemory(last);
+}
+
+void GzipStream::drain(int flush, OutputQueue& out) {
+    unsigned char buf[CHUNK];
+    do {
+        zs.next_out = buf;
+        zs.avail_out = CHUNK;
+        if (deflate(&zs, flush) == Z_STREAM_ERROR)
+            return;
+        size_t produced = CHUNK - zs.avail_out;
+        if (produced == 0)
+            continue;
+        char size[16];
+        int n = snprintf(size, sizeof(size), "%lx\r\n", static_cast<unsigned long>(produced));
+        std::string chunk;
+        chunk.reserve(static_cast<size_t>(n) + produced + 2);
+        chunk.append(size, static_cast<size_t>(n));
+        chunk.append(reinterpret_cast<const char*>(buf), produced);
+        chunk.append("\r\n", 2);
+        out.pushMemory(chunk);
+    } while (zs.avail_out == 0 || zs.avail_in != 0);
+}
+
+bool shouldGzip(const Request& request, const std::string& contentType, size_t length) {
+    const Config::RouteConfig* route = request.route.route;
+    if (!route || !route->gzip || length < route->gzip_min_length)
+        return false;
+    if (request.getVersion() != "HTTP/1.1")
+        return false;
+    const Request::StringMap& h = request.getAllHeaders();
+    Request::StringMap::const_iterator it = h.find("accept-encoding");
+    if (it == h.end() || !acceptsCoding(it->second.data(), it->second.size(), "gzip"))
+        return false;
+    std::string type = contentType.substr(0, contentType.find(';'));
+    size_t end = type.find_last_not_of(" \t");
+    type.erase(end == std::string::npos ? 0 : end + 1);
+    stringToLower(type);
+    for (size_t i = 0; i < route->gzip_types.size(); ++i)
+        if (route->gzip_types[i] == type || route->gzip_types[i] == "*")
+            return true;
+    return false;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <zlib.h>
+#include "OutputQueue.hpp"
+#include "../HTTP/Request.hpp"
+
+/**
+ * @brief Compresses a response body on the fly into gzip, framed as chunked
+ *
+ * The body is fed in pieces as it becomes available; each piece is
+ * deflated and whatever output zlib has ready is queued as one chunk, so
+ * the compressed length never has to be known up front. finish() flushes
+ * the deflate stream and queues the last chunk.
+ */
+class GzipStream {
+public:
+    /**
+     * @brief Constructor
+     * @param level zlib compression level (1 fastest .. 9 smallest)
+     */
+    explicit GzipStream(int level = 6);
+
+    /**
+     * @brief Destructor - frees the deflate state
+     */
+    ~GzipStream();
+
+    /**
+     * @brief Tells whether zlib could be set up; if not, send the body as is
+     */
+    bool ok() const { return ready; }
+
+    /**
+     * @brief Compresses a piece of the body and queues the output produced so far
+     * @param data Body bytes
+     * @param length Number of bytes
+     * @param out Output queue of the connection
+     */
+    void write(const char* data, size_t length, OutputQueue& out);
+
+    /**
+     * @brief Flushes the stream and queues the remaining output and the last chunk
+     */
+    void finish(OutputQueue& out);
+
+private:
+    static const size_t CHUNK = 16384;  // Compressed bytes per chunk at most
+
+    z_stream zs;
+    bool ready;
+
+    void drain(int flush, OutputQueue& out);
+
+    GzipStream(const GzipStream&);
+    GzipStream& operator=(const GzipStream&);
+};
+
+/**
+ * @brief Tells whether a generated body should be gzip-compressed
+ *
+ * The route must have gzip on, the client must be HTTP/1.1 (chunked
+ * framing) and accept gzip, the body must reach gzip_min_length and its
+ * media type must be listed in gzip_types.
+ * @param request Routed request
+ * @param contentType Content-Type of the body
+ * @param length Body length, when known up front
+ */
+bool shouldGzip(const Request& request, const std::string& contentType, size_t length);
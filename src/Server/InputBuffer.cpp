@@ -0,0 +1,132 @@
+#include "InputBuffer.hpp"
+
+#include <sys/uio.h>
+
+BlockPool::BlockPool(size_t maxFree) : maxFree(maxFree) {}
+
+BlockPool::~BlockPool() {
+    for (size_t i = 0; i < freeBlocks.size(); i++)
+        delete[] freeBlocks[i];
+}
+
+char* BlockPool::acquire() {
+    if (freeBlocks.empty())
+        return new char[BLOCK_SIZE];
+    char* block = freeBlocks.back();
+    freeBlocks.pop_back();
+    return block;
+}
+
+void BlockPool::release(char* block) {
+    if (freeBlocks.size() < maxFree)
+        freeBlocks.push_back(block);
+    else
+        delete[] block;
+}
+
+InputBuffer::InputBuffer()
+    : pool(NULL), head(0), tail(0), length(0) {}
+
+InputBuffer::~InputBuffer() {
+    clear();
+}
+
+void InputBuffer::setPool(BlockPool* pool) {
+    this->pool = pool;
+}
+
+ssize_t InputBuffer::readFrom(int fd) {
+    const size_t BLOCK = BlockPool::BLOCK_SIZE;
+    char* spare = pool->acquire();
+
+    // Fill what is left of the last block, then continue into a fresh one
+    struct iovec iov[2];
+    int count = 0;
+    size_t tailRoom = blocks.empty() ? 0 : BLOCK - tail;
+    if (tailRoom > 0) {
+        iov[count].iov_base = blocks.back() + tail;
+        iov[count].iov_len = tailRoom;
+        count++;
+    }
+    iov[count].iov_base = spare;
+    iov[count].iov_len = BLOCK;
+    count++;
+
+    ssize_t r = readv(fd, iov, count);
+    if (r <= 0) {
+        pool->release(spare);
+        return r;
+    }
+    size_t got = static_cast<size_t>(r);
+    size_t intoTail = got < tailRoom ? got : tailRoom;
+    tail += intoTail;
+    if (got > intoTail) {
+        blocks.push_back(spare);
+        if (blocks.size() == 1)
+            head = 0;
+        tail = got - intoTail;
+    } else {
+        pool->release(spare);
+    }
+    length += got;
+    return r;
+}
+
+const char* InputBuffer::span(size_t pos, size_t& len) const {
+    const size_t BLOCK = BlockPool::BLOCK_SIZE;
+    size_t offset = head + pos;
+    size_t index = offset / BLOCK;
+    size_t inBlock = offset % BLOCK;
+    size_t end = (index + 1 == blocks.size()) ? tail : BLOCK;
+    len = end - inBlock;
+    return blocks[index] + inBlock;
+}
+
+std::string InputBuffer::copy(size_t pos, size_t len) const {
+    std::string out;
+    if (pos >= length)
+        return out;
+    if (len > length - pos)
+        len = length - pos;
+    out.reserve(len);
+    while (len > 0) {
+        size_t run;
+        const char* p = span(pos, run);
+        if (run > len)
+            run = len;
+        out.append(p, run);
+        pos += run;
+        len -= run;
+    }
+    return out;
+}
+
+void InputBuffer::consume(size_t len) {
+    const size_t BLOCK = BlockPool::BLOCK_SIZE;
+    if (len > length)
+        len = length;
+    length -= len;
+    while (len > 0) {
+        size_t avail = ((blocks.size() == 1) ? tail : BLOCK) - head;
+        if (len < avail) {
+            head += len;
+            break;
+        }
+        len -= avail;
+        pool->release(blocks.front());
+        blocks.pop_front();
+        head = 0;
+    }
+    if (blocks.empty())
+        tail = 0;
+}
+
+void InputBuffer::clear() {
+    while (!blocks.empty()) {
+        pool->release(blocks.front());
+        blocks.pop_front();
+    }
+    head = 0;
+    tail = 0;
+    length = 0;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @brief Free list of fixed-size I/O blocks shared by one event loop
+ *
+ * Connections take blocks while they buffer input and give them back when
+ * the bytes are consumed, so steady-state reading never hits malloc. Up to
+ * maxFree idle blocks are kept; extra ones are freed.
+ */
+class BlockPool {
+public:
+    static const size_t BLOCK_SIZE = 16384;     // Bytes per block
+
+    /**
+     * @brief Constructor
+     * @param maxFree Idle blocks kept for reuse
+     */
+    explicit BlockPool(size_t maxFree = 256);
+
+    /**
+     * @brief Destructor - frees the idle blocks
+     */
+    ~BlockPool();
+
+    /**
+     * @brief Takes a block (from the free list when possible)
+     * @return BLOCK_SIZE bytes of storage
+     */
+    char* acquire();
+
+    /**
+     * @brief Returns a block to the pool
+     * @param block Block obtained from acquire()
+     */
+    void release(char* block);
+
+private:
+    std::vector<char*> freeBlocks;
+    size_t maxFree;
+
+    BlockPool(const BlockPool&);
+    BlockPool& operator=(const BlockPool&);
+};
+
+/**
+ * @brief Received bytes of one connection, stored as a chain of pool blocks
+ *
+ * readFrom() reads straight into the free tail of the last block plus one
+ * spare block with a single readv(), so socket data is copied once (kernel
+ * to block). Consumed bytes are dropped from the front in O(1) per block.
+ */
+class InputBuffer {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    InputBuffer();
+
+    /**
+     * @brief Destructor - returns every block to the pool
+     */
+    ~InputBuffer();
+
+    /**
+     * @brief Sets the pool blocks are taken from (before the first read)
+     * @param pool Pool of the owning event loop
+     */
+    void setPool(BlockPool* pool);
+
+    /**
+     * @brief Reads once from a socket into the chain
+     * @param fd Non-blocking descriptor
+     * @return Bytes read, 0 on EOF, -1 on error (errno set, EAGAIN included)
+     */
+    ssize_t readFrom(int fd);
+
+    /**
+     * @brief Gives the contiguous run of bytes starting at an offset
+     * @param pos Offset from the first unconsumed byte (< size())
+     * @param len Receives the run length (up to the end of its block)
+     * @return Pointer to the bytes
+     */
+    const char* span(size_t pos, size_t& len) const;
+
+    /**
+     * @brief Copies a range into a string
+     * @param pos Offset of the first byte
+     * @param len Maximum number of bytes (clamped to the buffered data)
+     * @return The copied bytes
+     */
+    std::string copy(size_t pos, size_t len = npos) const;
+
+    /**
+     * @brief Drops bytes from the front
+     * @param len Number of bytes to drop (clamped to size())
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief Drops everything
+     */
+    void clear();
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+private:
+    BlockPool* pool;
+    std::deque<char*> blocks;   // Oldest first
+    size_t head;                // First unconsumed byte in blocks.front()
+    size_t tail;                // Bytes filled in blocks.back()
+    size_t length;              // Unconsumed bytes in the chain
+
+    InputBuffer(const InputBuffer&);
+    InputBuffer& operator=(const InputBuffer&);
+};
@@ -0,0 +1,148 @@
+#include "MasterProcess.hpp"
+#include "monitorClient.hpp"
+#include "../Socket/socket.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+static void setDefaultStopSignals() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+MasterProcess::MasterProcess(sock& listeners, size_t count) : listeners(listeners) {
+    Worker w;
+    w.pid = -1;
+    w.startedAt = 0;
+    workers.assign(count, w);
+    sigemptyset(&supervised);
+    sigaddset(&supervised, SIGINT);
+    sigaddset(&supervised, SIGTERM);
+    sigaddset(&supervised, SIGCHLD);
+    sigemptyset(&savedMask);
+}
+
+int MasterProcess::slotOf(pid_t pid) const {
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].pid == pid)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool MasterProcess::spawn(size_t slot) {
+    // Buffered output would otherwise be written twice (by master and child);
+    // the logger drains its own rings in a pthread_atfork handler
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if (pid == -1) {
+        LOG_ERROR("fork failed for worker " << slot << ": " << strerror(errno));
+        return false;
+    }
+    if (pid > 0) {
+        workers[slot].pid = pid;
+        workers[slot].startedAt = time(NULL);
+        LOG_INFO("Worker process " << slot << " started (pid=" << pid << ")");
+        return true;
+    }
+
+    // Child: default signal dispositions and mask, and die together with the master
+    setDefaultStopSignals();
+    sigprocmask(SIG_SETMASK, &savedMask, NULL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master)
+        _exit(1);
+
+    int code = 0;
+    try {
+        monitorClient mc(listeners);
+        mc.startEventLoop();
+    } catch (const std::exception& e) {
+        LOG_ERROR("worker process " << slot << " stopped: " << e.what());
+        code = 1;
+    }
+    Logger::flush();
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(code);
+}
+
+void MasterProcess::stopWorkers() {
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].pid > 0)
+            kill(workers[i].pid, SIGTERM);
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].pid > 0) {
+            while (waitpid(workers[i].pid, NULL, 0) == -1 && errno == EINTR)
+                ;
+            workers[i].pid = -1;
+        }
+    }
+}
+
+void MasterProcess::reap() {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        int slot = slotOf(pid);
+        if (slot == -1)
+            continue;
+        workers[slot].pid = -1;
+        if (WIFSIGNALED(status))
+            LOG_WARN("worker process " << slot << " (pid=" << pid << ") killed by signal "
+                     << WTERMSIG(status) << ", restarting");
+        else
+            LOG_WARN("worker process " << slot << " (pid=" << pid << ") exited with status "
+                     << WEXITSTATUS(status) << ", restarting");
+    }
+}
+
+int MasterProcess::run() {
+    // Stop requests and child exits stay pending until sigtimedwait() takes
+    // them, so one arriving between two checks is never missed
+    sigprocmask(SIG_BLOCK, &supervised, &savedMask);
+
+    bool started = false;
+    for (size_t i = 0; i < workers.size(); i++)
+        started = spawn(i) || started;
+    if (!started) {
+        sigprocmask(SIG_SETMASK, &savedMask, NULL);
+        return 1;
+    }
+
+    bool stopping = false;
+    while (!stopping) {
+        reap();
+        // Refill empty slots; a worker that died within a second of starting
+        // is restarted at most once per second to avoid a fork storm
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i].pid == -1 && time(NULL) - workers[i].startedAt >= 1)
+                spawn(i);
+        }
+
+        // Wake on a signal, or after a second to retry throttled slots
+        struct timespec tick;
+        tick.tv_sec = 1;
+        tick.tv_nsec = 0;
+        int sig = sigtimedwait(&supervised, NULL, &tick);
+        if (sig == SIGINT || sig == SIGTERM)
+            stopping = true;
+    }
+
+    LOG_INFO("Stopping worker processes");
+    stopWorkers();
+    sigprocmask(SIG_SETMASK, &savedMask, NULL);
+    return 0;
+}
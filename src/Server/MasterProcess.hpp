@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <ctime>
+#include <csignal>
+#include <sys/types.h>
+
+class sock;
+
+/**
+ * @brief Pre-fork supervisor: one master process, N worker processes
+ *
+ * The master binds the listeners once and forks workers that inherit them.
+ * Each worker runs its own monitorClient event loop; the kernel hands every
+ * new connection to whichever worker accepts it first. The master only
+ * waits for its children and re-forks any worker that exits, so a crash or
+ * leak in one worker (or in a CGI it spawned) never takes down the node.
+ * SIGINT/SIGTERM on the master stop every worker and then the master.
+ */
+class MasterProcess {
+private:
+    /**
+     * @brief Bookkeeping for one worker slot
+     */
+    struct Worker {
+        pid_t pid;          // Running worker, or -1 when the slot is empty
+        time_t startedAt;   // Spawn time, used to throttle crash loops
+    };
+
+    sock& listeners;                // Listener set inherited by every worker
+    std::vector<Worker> workers;    // One entry per configured worker
+    sigset_t supervised;            // SIGINT, SIGTERM, SIGCHLD: blocked and taken by sigtimedwait()
+    sigset_t savedMask;             // Mask before run(), restored in workers
+
+    /**
+     * @brief Forks the worker for a slot
+     * @param slot Index in workers
+     * @return true if the child was created
+     * The child never returns: it runs the event loop and _exit()s
+     */
+    bool spawn(size_t slot);
+
+    /**
+     * @brief Finds the slot of an exited child
+     * @param pid Child pid returned by waitpid()
+     * @return Slot index, or -1 if the pid is not a worker
+     */
+    int slotOf(pid_t pid) const;
+
+    /**
+     * @brief Collects every exited worker and empties its slot
+     */
+    void reap();
+
+    /**
+     * @brief Sends SIGTERM to every worker and reaps them all
+     */
+    void stopWorkers();
+
+    MasterProcess(const MasterProcess&);
+    MasterProcess& operator=(const MasterProcess&);
+
+public:
+    /**
+     * @brief Constructor
+     * @param listeners Bound listening sockets (created once by the master)
+     * @param count Number of worker processes to keep running
+     */
+    MasterProcess(sock& listeners, size_t count);
+
+    /**
+     * @brief Forks all workers and supervises them until SIGINT/SIGTERM
+     * @return 0 on orderly shutdown, 1 if no worker could be started
+     */
+    int run();
+};
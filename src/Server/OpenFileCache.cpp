@@ -0,0 +1,99 @@
+#include "OpenFileCache.hpp"
+
+#include <unistd.h>
+
+/**
+ * @brief Keeps a cached descriptor open until no response sends from it
+ */
+class CachedFd : public SharedBlock {
+public:
+    explicit CachedFd(int fd) : fd(fd) {}
+
+protected:
+    ~CachedFd() { close(fd); }
+
+private:
+    int fd;
+};
+
+OpenFileCache::OpenFileCache(size_t maxEntries) : maxEntries(maxEntries) {}
+
+OpenFileCache::~OpenFileCache() {
+    while (!lru.empty())
+        erase(lru.begin());
+}
+
+const OpenFileCache::Entry* OpenFileCache::lookup(const std::string& key, time_t now) {
+    std::map<std::string, EntryList::iterator>::iterator it = index.find(key);
+    if (it == index.end())
+        return NULL;
+    if (now >= it->second->expires) {
+        erase(it->second);
+        return NULL;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    return &*it->second;
+}
+
+OpenFileCache::Entry& OpenFileCache::add(const std::string& key, Kind kind, time_t expires) {
+    std::map<std::string, EntryList::iterator>::iterator old = index.find(key);
+    if (old != index.end())
+        erase(old->second);
+    while (!lru.empty() && lru.size() >= maxEntries)
+        erase(--lru.end());
+
+    lru.push_front(Entry());
+    Entry& entry = lru.front();
+    entry.key = key;
+    entry.kind = kind;
+    entry.fd = -1;
+    entry.ino = 0;
+    entry.size = 0;
+    entry.mtime = 0;
+    entry.handle = NULL;
+    entry.expires = expires;
+    index[key] = lru.begin();
+    return entry;
+}
+
+const OpenFileCache::Entry* OpenFileCache::addFile(const std::string& key, const std::string& path,
+                                                   const std::string& typePath, int fd,
+                                                   const struct stat& st, time_t expires,
+                                                   const std::string& encoding) {
+    Entry& entry = add(key, OF_FILE, expires);
+    entry.path = path;
+    entry.typePath = typePath;
+    entry.encoding = encoding;
+    entry.fd = fd;
+    entry.ino = st.st_ino;
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    entry.handle = new CachedFd(fd);
+    return &entry;
+}
+
+void OpenFileCache::addDirectory(const std::string& key, const std::string& path, time_t expires) {
+    add(key, OF_DIRECTORY, expires).path = path;
+}
+
+void OpenFileCache::addMissing(const std::string& key, time_t expires) {
+    add(key, OF_MISSING, expires);
+}
+
+void OpenFileCache::forget(const std::string& path) {
+    // Keys start with the routed path, so everything below it shares the prefix
+    std::map<std::string, EntryList::iterator>::iterator it = index.lower_bound(path);
+    while (it != index.end() && it->first.compare(0, path.size(), path) == 0) {
+        std::map<std::string, EntryList::iterator>::iterator next = it;
+        ++next;
+        erase(it->second);
+        it = next;
+    }
+}
+
+void OpenFileCache::erase(EntryList::iterator it) {
+    if (it->handle)
+        it->handle->release();
+    index.erase(it->key);
+    lru.erase(it);
+}
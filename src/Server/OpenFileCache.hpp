@@ -0,0 +1,113 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "OutputQueue.hpp"
+
+/**
+ * @brief Cache of path lookups and open descriptors, like nginx's open_file_cache
+ *
+ * Remembers, for a routed path, what the filesystem said about it: an
+ * open descriptor with its size and mtime, a directory without an index
+ * file, or that it does not exist. While an entry is valid the
+ * realpath/stat/open sequence is skipped. Entries are trusted for a fixed
+ * number of seconds rather than watched, so changes made by other
+ * processes show up within that period. One instance per server and
+ * event loop, bounded by an entry count and evicted least recently used.
+ */
+class OpenFileCache {
+public:
+    /**
+     * @brief What a lookup found
+     */
+    enum Kind {
+        OF_MISSING,     // Nothing servable (absent, or outside the root)
+        OF_FILE,        // Regular file, kept open
+        OF_DIRECTORY    // Directory without an index file
+    };
+
+    /**
+     * @brief One remembered lookup
+     */
+    struct Entry {
+        std::string key;
+        Kind kind;
+        std::string path;       // Resolved file or directory
+        std::string typePath;   // Name whose extension selects the Content-Type
+        std::string encoding;   // Content-Encoding of a .br/.gz sidecar, else ""
+        int fd;                 // OF_FILE: descriptor shared by every response
+        ino_t ino;
+        off_t size;
+        time_t mtime;
+        SharedBlock* handle;    // OF_FILE: owns fd; queued ranges retain it
+        time_t expires;
+    };
+
+    /**
+     * @brief Constructor
+     * @param maxEntries Entries kept before the least recently used is dropped
+     */
+    explicit OpenFileCache(size_t maxEntries);
+
+    /**
+     * @brief Destructor - releases every descriptor not still being sent
+     */
+    ~OpenFileCache();
+
+    /**
+     * @brief Finds a valid entry; expired ones are dropped on the way
+     * @param key Key given when the entry was added
+     * @param now Current time
+     * @return The entry, or NULL
+     */
+    const Entry* lookup(const std::string& key, time_t now);
+
+    /**
+     * @brief Remembers an open regular file
+     * @param key Lookup key
+     * @param path Resolved path of the file
+     * @param typePath Name used for the Content-Type
+     * @param fd Open descriptor; ownership passes to the cache
+     * @param st fstat() of fd
+     * @param expires Time the entry stops being trusted
+     * @param encoding Content-Encoding when fd is a sidecar ("" for none)
+     * @return The new entry
+     */
+    const Entry* addFile(const std::string& key, const std::string& path, const std::string& typePath,
+                         int fd, const struct stat& st, time_t expires,
+                         const std::string& encoding = "");
+
+    /**
+     * @brief Remembers a directory that has no index file
+     */
+    void addDirectory(const std::string& key, const std::string& path, time_t expires);
+
+    /**
+     * @brief Remembers that a path cannot be served
+     */
+    void addMissing(const std::string& key, time_t expires);
+
+    /**
+     * @brief Drops every entry at or below a path (after a POST or DELETE)
+     * @param path Routed filesystem path that changed
+     */
+    void forget(const std::string& path);
+
+private:
+    typedef std::list<Entry> EntryList;
+
+    size_t maxEntries;
+    EntryList lru;                                  // Most recently used first
+    std::map<std::string, EntryList::iterator> index;
+
+    Entry& add(const std::string& key, Kind kind, time_t expires);
+    void erase(EntryList::iterator it);
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+};
@@ -0,0 +1,169 @@
+#include "OutputQueue.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+
+SharedBlock::SharedBlock() : bytes(NULL), length(0), refs(1) {}
+
+SharedBlock::~SharedBlock() {}
+
+OutputQueue::OutputQueue() : pending(0) {}
+
+OutputQueue::~OutputQueue() {
+    clear();
+}
+
+void OutputQueue::pushMemory(std::string& data) {
+    if (data.empty())
+        return;
+    segments.push_back(Segment());
+    Segment& seg = segments.back();
+    seg.data.swap(data);
+    seg.shared = NULL;
+    seg.mem = seg.data.data();
+    seg.memLen = seg.data.size();
+    seg.offset = 0;
+    seg.fd = -1;
+    seg.fileOffset = 0;
+    seg.fileEnd = 0;
+    seg.ownsFd = false;
+    pending += seg.memLen;
+}
+
+void OutputQueue::pushShared(SharedBlock* block, size_t offset, size_t length) {
+    if (length == 0)
+        return;
+    block->retain();
+    segments.push_back(Segment());
+    Segment& seg = segments.back();
+    seg.shared = block;
+    seg.mem = block->data() + offset;
+    seg.memLen = length;
+    seg.offset = 0;
+    seg.fd = -1;
+    seg.fileOffset = 0;
+    seg.fileEnd = 0;
+    seg.ownsFd = false;
+    pending += length;
+}
+
+void OutputQueue::pushFile(int fd, off_t offset, off_t length, bool ownsFd) {
+    if (length <= 0) {
+        if (ownsFd)
+            close(fd);
+        return;
+    }
+    segments.push_back(Segment());
+    Segment& seg = segments.back();
+    seg.shared = NULL;
+    seg.mem = NULL;
+    seg.memLen = 0;
+    seg.offset = 0;
+    seg.fd = fd;
+    seg.fileOffset = offset;
+    seg.fileEnd = offset + length;
+    seg.ownsFd = ownsFd;
+    pending += static_cast<size_t>(length);
+}
+
+void OutputQueue::pushFile(SharedBlock* holder, int fd, off_t offset, off_t length) {
+    if (length <= 0)
+        return;
+    pushFile(fd, offset, length, false);
+    holder->retain();
+    segments.back().shared = holder;
+}
+
+void OutputQueue::popFront() {
+    Segment& seg = segments.front();
+    if (seg.fd >= 0) {
+        pending -= static_cast<size_t>(seg.fileEnd - seg.fileOffset);
+        if (seg.ownsFd)
+            close(seg.fd);
+    } else {
+        pending -= seg.memLen - seg.offset;
+    }
+    if (seg.shared)
+        seg.shared->release();
+    segments.pop_front();
+}
+
+void OutputQueue::consumeMemory(size_t bytes) {
+    while (bytes > 0) {
+        Segment& seg = segments.front();
+        size_t left = seg.memLen - seg.offset;
+        if (bytes < left) {
+            seg.offset += bytes;
+            pending -= bytes;
+            return;
+        }
+        bytes -= left;
+        popFront();
+    }
+}
+
+OutputQueue::FlushResult OutputQueue::flush(int sockFd) {
+    while (!segments.empty()) {
+        Segment& front = segments.front();
+
+        if (front.fd < 0) {
+            // Gather the run of memory blocks at the head of the queue
+            struct iovec iov[MAX_IOV];
+            size_t count = 0;
+            bool fileFollows = false;
+            for (std::deque<Segment>::iterator it = segments.begin();
+                 it != segments.end() && count < MAX_IOV; ++it) {
+                if (it->fd >= 0) {
+                    fileFollows = true;
+                    break;
+                }
+                iov[count].iov_base = const_cast<char*>(it->mem) + it->offset;
+                iov[count].iov_len = it->memLen - it->offset;
+                count++;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            // MSG_MORE holds the head back until the file body joins it, so a
+            // small file still leaves in a single segment
+            ssize_t w = sendmsg(sockFd, &msg, MSG_NOSIGNAL | (fileFollows ? MSG_MORE : 0));
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return FLUSH_AGAIN;
+                return FLUSH_ERROR;
+            }
+            consumeMemory(static_cast<size_t>(w));
+            continue;
+        }
+
+        // File range: the kernel copies page cache -> socket
+        off_t left = front.fileEnd - front.fileOffset;
+        size_t chunk = static_cast<size_t>(left > SENDFILE_CHUNK ? SENDFILE_CHUNK : left);
+        ssize_t sent = sendfile(sockFd, front.fd, &front.fileOffset, chunk);
+        if (sent > 0) {
+            pending -= static_cast<size_t>(sent);
+            if (front.fileOffset >= front.fileEnd)
+                popFront();
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return FLUSH_AGAIN;
+        // Error, or the file shrank: the announced length cannot be met
+        return FLUSH_ERROR;
+    }
+    return FLUSH_DONE;
+}
+
+void OutputQueue::clear() {
+    while (!segments.empty())
+        popFront();
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @brief Reference-counted read-only bytes that several queues can send
+ *
+ * Also used with no bytes as the owner of a shared file descriptor. The
+ * creator holds the first reference; every queued range takes another
+ * and the block deletes itself when the last one is released. Counts are
+ * plain integers, so a block must stay inside one event loop.
+ */
+class SharedBlock {
+public:
+    SharedBlock();
+
+    void retain() { refs++; }
+    void release() { if (--refs == 0) delete this; }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+protected:
+    const char* bytes;
+    size_t length;
+
+    virtual ~SharedBlock();
+
+private:
+    int refs;
+
+    SharedBlock(const SharedBlock&);
+    SharedBlock& operator=(const SharedBlock&);
+};
+
+/**
+ * @brief Ordered chain of response bytes waiting for a client socket
+ *
+ * Each segment is either a memory block (status line and headers, an
+ * in-memory body, or a range of a SharedBlock) or a range of an open file. Memory blocks are moved in by
+ * swap and consumed by advancing an offset, so nothing is copied or shifted
+ * after a partial write. Consecutive memory blocks leave in one sendmsg()
+ * (writev semantics), file ranges with sendfile(). Several responses may be
+ * queued back to back on the same connection.
+ */
+class OutputQueue {
+public:
+    /**
+     * @brief Outcome of flush()
+     */
+    enum FlushResult {
+        FLUSH_ERROR = -1,   // Connection is unusable (reset, EPIPE, short file)
+        FLUSH_DONE = 0,     // Everything queued has been handed to the kernel
+        FLUSH_AGAIN = 1     // Socket buffer full; wait for POLLOUT
+    };
+
+    OutputQueue();
+
+    /**
+     * @brief Destructor - closes the descriptors still owned by the queue
+     */
+    ~OutputQueue();
+
+    /**
+     * @brief Queues a memory block, taking its contents
+     * @param data Bytes to send; left empty on return
+     */
+    void pushMemory(std::string& data);
+
+    /**
+     * @brief Queues a range of a shared block without copying it
+     * @param block Block to send from; retained until the range is sent
+     * @param offset First byte to send
+     * @param length Number of bytes to send
+     */
+    void pushShared(SharedBlock* block, size_t offset, size_t length);
+
+    /**
+     * @brief Queues a range of a file
+     * @param fd Open file descriptor
+     * @param offset First byte to send
+     * @param length Number of bytes to send
+     * @param ownsFd Close fd once this range is sent (or the queue dropped);
+     *        pass false for all but the last range of a shared descriptor
+     */
+    void pushFile(int fd, off_t offset, off_t length, bool ownsFd);
+
+    /**
+     * @brief Queues a range of a file whose descriptor is shared
+     * @param holder Keeps fd open; retained until the range is sent
+     * @param fd Open file descriptor (not closed by the queue)
+     * @param offset First byte to send
+     * @param length Number of bytes to send
+     */
+    void pushFile(SharedBlock* holder, int fd, off_t offset, off_t length);
+
+    /**
+     * @brief Sends as much as the socket accepts
+     * @param sockFd Non-blocking client socket
+     * @return FLUSH_DONE, FLUSH_AGAIN or FLUSH_ERROR
+     */
+    FlushResult flush(int sockFd);
+
+    /**
+     * @brief Checks whether anything is left to send
+     * @return true if the queue is empty
+     */
+    bool empty() const { return segments.empty(); }
+
+    /**
+     * @brief Bytes still queued (memory and file ranges)
+     */
+    size_t pendingBytes() const { return pending; }
+
+    /**
+     * @brief Drops everything queued and closes owned descriptors
+     */
+    void clear();
+
+private:
+    struct Segment {
+        std::string data;       // Owned memory block (pushMemory)
+        SharedBlock* shared;    // Referenced block or descriptor holder, else NULL
+        const char* mem;        // Start of the memory bytes (data or shared)
+        size_t memLen;          // Number of memory bytes
+        size_t offset;          // Memory bytes already sent
+        int fd;                 // File descriptor, or -1 for a memory block
+        off_t fileOffset;       // Next byte of the file range
+        off_t fileEnd;          // End of the file range
+        bool ownsFd;            // Close fd when the segment is dropped
+    };
+
+    static const size_t MAX_IOV = 64;           // Memory blocks per sendmsg()
+    static const off_t SENDFILE_CHUNK = 1 << 20; // Max bytes per sendfile() call
+
+    std::deque<Segment> segments;
+    size_t pending;
+
+    void popFront();
+    void consumeMemory(size_t bytes);
+
+    OutputQueue(const OutputQueue&);
+    OutputQueue& operator=(const OutputQueue&);
+};
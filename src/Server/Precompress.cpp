@@ -0,0 +1,184 @@
+#include "Precompress.hpp"
+#include "../Log/Logger.hpp"
+
+#include <set>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+static const off_t MIN_SIZE = 256;              // Smaller files gain nothing
+static const off_t MAX_SIZE = 64 << 20;         // Larger ones are left alone
+static const int MAX_DEPTH = 32;
+
+bool isCompressibleName(const std::string& path) {
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string::npos || path[dot] != '.')
+        return false;
+    std::string ext = path.substr(dot + 1);
+    return ext == "html" || ext == "htm" || ext == "css" || ext == "js" || ext == "json"
+        || ext == "xml" || ext == "svg" || ext == "txt";
+}
+
+static bool readWhole(const std::string& path, off_t size, std::vector<unsigned char>& data) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    data.resize(static_cast<size_t>(size));
+    size_t got = 0;
+    while (got < data.size()) {
+        ssize_t n = read(fd, &data[got], data.size() - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += static_cast<size_t>(n);
+    }
+    close(fd);
+    return got == data.size();
+}
+
+static bool gzipData(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits + 16 writes a gzip header and trailer instead of zlib's
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = const_cast<Bytef*>(&in[0]);
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = &out[0];
+    zs.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+static bool brotliData(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+    size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    if (size == 0)
+        return false;
+    out.resize(size);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               in.size(), &in[0], &size, &out[0]))
+        return false;
+    out.resize(size);
+    return true;
+}
+
+/**
+ * @brief Writes a sidecar through a temporary name so readers never see half of it
+ */
+static bool writeSidecar(const std::string& path, const std::vector<unsigned char>& data) {
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, &data[done], data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    bool ok = (close(fd) == 0) && done == data.size();
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool sidecarIsFresh(const struct stat& sidecar, const struct stat& original) {
+    if (sidecar.st_mtim.tv_sec != original.st_mtim.tv_sec)
+        return sidecar.st_mtim.tv_sec > original.st_mtim.tv_sec;
+    return sidecar.st_mtim.tv_nsec > original.st_mtim.tv_nsec;
+}
+
+static bool isFresh(const std::string& sidecar, const struct stat& original) {
+    struct stat st;
+    return stat(sidecar.c_str(), &st) == 0 && S_ISREG(st.st_mode) && sidecarIsFresh(st, original);
+}
+
+/**
+ * @brief Compresses one file into whichever sidecars are missing or stale
+ * @return Number of sidecars written
+ */
+static size_t compressFile(const std::string& path, const struct stat& st) {
+    std::string gz = path + ".gz";
+    std::string br = path + ".br";
+    bool needGz = !isFresh(gz, st);
+    bool needBr = !isFresh(br, st);
+    if (!needGz && !needBr)
+        return 0;
+
+    std::vector<unsigned char> data;
+    if (!readWhole(path, st.st_size, data))
+        return 0;
+    size_t written = 0;
+    std::vector<unsigned char> packed;
+    if (needGz && gzipData(data, packed) && packed.size() < data.size() && writeSidecar(gz, packed))
+        written++;
+    if (needBr && brotliData(data, packed) && packed.size() < data.size() && writeSidecar(br, packed))
+        written++;
+    return written;
+}
+
+static size_t walk(const std::string& dir, int depth) {
+    if (depth > MAX_DEPTH)
+        return 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return 0;
+    std::vector<std::string> subdirs;
+    size_t written = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string path = (dir == "/") ? dir + name : dir + "/" + name;
+        struct stat st;
+        // Symlinks are not followed: they could loop or leave the root
+        if (lstat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            subdirs.push_back(path);
+        else if (S_ISREG(st.st_mode) && isCompressibleName(name)
+                 && st.st_size >= MIN_SIZE && st.st_size <= MAX_SIZE)
+            written += compressFile(path, st);
+    }
+    closedir(d);
+    for (size_t i = 0; i < subdirs.size(); i++)
+        written += walk(subdirs[i], depth + 1);
+    return written;
+}
+
+void buildSidecars(const Config& config) {
+    std::set<std::string> roots;
+    for (size_t i = 0; i < config.servers.size(); i++) {
+        const Config::ServerConfig& server = config.servers[i];
+        for (size_t r = 0; r < server.routes.size(); r++) {
+            const Config::RouteConfig& route = server.routes[r];
+            if (!route.precompressed)
+                continue;
+            std::string root = route.root.empty() ? server.root : route.root;
+            while (root.size() > 1 && root[root.size() - 1] == '/')
+                root.erase(root.size() - 1);
+            roots.insert(root.empty() ? "." : root);
+        }
+    }
+    size_t written = 0;
+    for (std::set<std::string>::iterator it = roots.begin(); it != roots.end(); ++it)
+        written += walk(*it, 0);
+    LOG_INFO("precompress: wrote " << written << " sidecar(s) under " << roots.size() << " root(s)");
+}
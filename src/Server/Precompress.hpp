@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <sys/stat.h>
+#include "../Config/ConfigParser.hpp"
+
+/**
+ * @brief Tells whether a file name has a type worth compressing (text, scripts, markup)
+ * @param path File name or path; only the extension is looked at
+ */
+bool isCompressibleName(const std::string& path);
+
+/**
+ * @brief Tells whether a sidecar was written after its file last changed
+ * @param sidecar stat() of the .br/.gz file
+ * @param original stat() of the file it was built from
+ * Compares to the nanosecond and requires strictly newer, so an edit made
+ * in the same second (or instant) the sidecar was built makes it stale.
+ */
+bool sidecarIsFresh(const struct stat& sidecar, const struct stat& original);
+
+/**
+ * @brief Writes the .gz and .br sidecars missing (or older than their file)
+ *        under the root of every precompressed route
+ *
+ * Runs once at startup, before any listener exists, so the compression
+ * cost is never paid while serving. Sidecars that would not be smaller
+ * than their file are not written.
+ */
+void buildSidecars(const Config& config);
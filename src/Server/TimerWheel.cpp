@@ -0,0 +1,137 @@
+#include "TimerWheel.hpp"
+#include <climits>
+
+TimerWheel::Timer::Timer() : prev(NULL), next(NULL), expires(0), fd(-1) {}
+
+TimerWheel::TimerWheel(unsigned long long nowMs) : current(nowMs / TICK_MS), count(0) {
+    for (unsigned int level = 0; level < LEVELS; level++) {
+        for (unsigned int slot = 0; slot < SLOTS; slot++) {
+            heads[level][slot].prev = &heads[level][slot];
+            heads[level][slot].next = &heads[level][slot];
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    for (unsigned int level = 0; level < LEVELS; level++) {
+        for (unsigned int slot = 0; slot < SLOTS; slot++) {
+            Timer& head = heads[level][slot];
+            while (head.next != &head)
+                unlink(*head.next);
+        }
+    }
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = NULL;
+    timer.next = NULL;
+}
+
+void TimerWheel::insert(Timer& timer) {
+    unsigned long long tick = (timer.expires + TICK_MS - 1) / TICK_MS;
+    if (tick < current)
+        tick = current;
+
+    // Pick the lowest level whose span still reaches the deadline; deadlines
+    // past the top level are parked at its far end and re-filed on cascade
+    unsigned long long delta = tick - current;
+    const unsigned long long span = 1ULL << (SLOT_BITS * LEVELS);
+    if (delta >= span)
+        tick = current + span - 1;
+    unsigned int level = 0;
+    while (level < LEVELS - 1 && (delta >> (SLOT_BITS * (level + 1))) != 0)
+        level++;
+
+    Timer& head = heads[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    timer.next = &head;
+    timer.prev = head.prev;
+    head.prev->next = &timer;
+    head.prev = &timer;
+}
+
+void TimerWheel::schedule(Timer& timer, unsigned long long expiresMs) {
+    cancel(timer);
+    // The slot of the current tick was already processed, so the earliest
+    // a new timer can fire is the next tick
+    unsigned long long minimum = (current + 1) * TICK_MS;
+    timer.expires = (expiresMs < minimum) ? minimum : expiresMs;
+    insert(timer);
+    count++;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (!timer.armed())
+        return;
+    unlink(timer);
+    count--;
+}
+
+void TimerWheel::advance(unsigned long long nowMs, std::vector<int>& expired) {
+    unsigned long long target = nowMs / TICK_MS;
+    while (current < target) {
+        if (count == 0) {
+            current = target;
+            break;
+        }
+        current++;
+
+        // Entering a new window of a higher level: re-file its slot one level down
+        for (unsigned int level = 1; level < LEVELS; level++) {
+            if ((current & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+                break;
+            Timer& head = heads[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)];
+            while (head.next != &head) {
+                Timer* timer = head.next;
+                unlink(*timer);
+                insert(*timer);
+            }
+        }
+
+        Timer& head = heads[0][current & (SLOTS - 1)];
+        while (head.next != &head) {
+            Timer* timer = head.next;
+            unlink(*timer);
+            count--;
+            expired.push_back(timer->fd);
+        }
+    }
+}
+
+int TimerWheel::nextTimeout(unsigned long long nowMs) const {
+    if (count == 0)
+        return -1;
+
+    unsigned long long best = ~0ULL;
+    for (unsigned int j = 1; j <= SLOTS; j++) {
+        const Timer& head = heads[0][(current + j) & (SLOTS - 1)];
+        if (head.next != &head) {
+            best = current + j;
+            break;
+        }
+    }
+    // A pending cascade must run before anything it holds can expire
+    for (unsigned int level = 1; level < LEVELS; level++) {
+        unsigned long long base = current >> (SLOT_BITS * level);
+        for (unsigned int j = 1; j <= SLOTS; j++) {
+            const Timer& head = heads[level][(base + j) & (SLOTS - 1)];
+            if (head.next != &head) {
+                unsigned long long tick = (base + j) << (SLOT_BITS * level);
+                if (tick < best)
+                    best = tick;
+                break;
+            }
+        }
+    }
+
+    unsigned long long wakeMs = best * TICK_MS;
+    if (wakeMs <= nowMs)
+        return 0;
+    unsigned long long delay = wakeMs - nowMs;
+    return (delay > static_cast<unsigned long long>(INT_MAX)) ? INT_MAX : static_cast<int>(delay);
+}
+
+size_t TimerWheel::size() const {
+    return count;
+}
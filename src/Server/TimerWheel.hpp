@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Hierarchical timing wheel for connection deadlines
+ *
+ * Four levels of 64 slots; level 0 advances every TICK_MS, each higher level
+ * covers 64 times the span of the one below (~0.6s, ~41s, ~44min, ~47h).
+ * Timers are intrusive list nodes embedded in their owner, so scheduling,
+ * rescheduling and cancelling are O(1) and never allocate. A timer is moved
+ * down one level at most once per level, so expiry is O(1) amortized.
+ * Times are milliseconds of a monotonic clock supplied by the caller.
+ */
+class TimerWheel {
+public:
+    /**
+     * @brief Intrusive timer node, embedded in the object it times out
+     */
+    struct Timer {
+        Timer* prev;                // Previous node in the slot list (NULL when idle)
+        Timer* next;                // Next node in the slot list
+        unsigned long long expires; // Absolute deadline in milliseconds
+        int fd;                     // Descriptor reported when the timer fires
+
+        Timer();
+
+        /**
+         * @brief Whether the timer is currently scheduled
+         * @return true if linked into a slot
+         */
+        bool armed() const { return prev != NULL; }
+    };
+
+    static const unsigned int TICK_MS = 10;     // Resolution of level 0
+
+    /**
+     * @brief Constructor
+     * @param nowMs Current time; the wheel starts at this tick
+     */
+    explicit TimerWheel(unsigned long long nowMs);
+
+    /**
+     * @brief Destructor - unlinks every timer still scheduled
+     */
+    ~TimerWheel();
+
+    /**
+     * @brief Schedules (or reschedules) a timer
+     * @param timer Timer node to arm
+     * @param expiresMs Absolute deadline; never fires before it
+     */
+    void schedule(Timer& timer, unsigned long long expiresMs);
+
+    /**
+     * @brief Cancels a timer; no-op if it is not armed
+     * @param timer Timer node to disarm
+     */
+    void cancel(Timer& timer);
+
+    /**
+     * @brief Advances the wheel to nowMs and collects expired timers
+     * @param nowMs Current time
+     * @param expired Output: fd of every timer that fired (timers are disarmed)
+     */
+    void advance(unsigned long long nowMs, std::vector<int>& expired);
+
+    /**
+     * @brief Milliseconds until the wheel next needs to advance
+     * @param nowMs Current time
+     * @return -1 when no timer is armed, otherwise the delay until the
+     *         earliest deadline (or the cascade that precedes it)
+     */
+    int nextTimeout(unsigned long long nowMs) const;
+
+    /**
+     * @brief Number of armed timers
+     * @return Count
+     */
+    size_t size() const;
+
+private:
+    static const unsigned int LEVELS = 4;
+    static const unsigned int SLOT_BITS = 6;
+    static const unsigned int SLOTS = 1u << SLOT_BITS;
+
+    Timer heads[LEVELS][SLOTS];     // Sentinel nodes of circular slot lists
+    unsigned long long current;     // Last processed tick
+    size_t count;                   // Armed timers
+
+    /**
+     * @brief Links a timer into the slot matching its deadline
+     * @param timer Unlinked timer
+     */
+    void insert(Timer& timer);
+
+    /**
+     * @brief Unlinks a timer from its slot list
+     * @param timer Linked timer
+     */
+    static void unlink(Timer& timer);
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+};
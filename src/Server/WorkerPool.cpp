@@ -0,0 +1,67 @@
+#include "WorkerPool.hpp"
+#include "monitorClient.hpp"
+#include "../Socket/socket.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <unistd.h>
+
+WorkerPool::WorkerPool(const ConfigParser& config_parser, size_t workers) {
+    try {
+        // Every listener set (and so every worker) shares one config snapshot
+        for (size_t i = 0; i < workers; i++)
+            listenerSets.push_back(new sock(config_parser, true));
+    } catch (...) {
+        for (size_t i = 0; i < listenerSets.size(); i++) {
+            std::vector<int> fds = listenerSets[i]->getFDs();
+            for (size_t j = 0; j < fds.size(); j++)
+                close(fds[j]);
+            delete listenerSets[i];
+        }
+        listenerSets.clear();
+        throw;
+    }
+}
+
+void* WorkerPool::workerMain(void* arg) {
+    sock* listeners = static_cast<sock*>(arg);
+    try {
+        monitorClient mc(*listeners);
+        delete listeners;
+        listeners = NULL;
+        mc.startEventLoop();
+    } catch (const std::exception& e) {
+        LOG_ERROR("worker thread stopped: " << e.what());
+    }
+    delete listeners;
+    return NULL;
+}
+
+void WorkerPool::run() {
+    for (size_t i = 0; i < listenerSets.size(); i++) {
+        pthread_t tid;
+        int err = pthread_create(&tid, NULL, &WorkerPool::workerMain, listenerSets[i]);
+        if (err != 0) {
+            LOG_ERROR("pthread_create failed: " << strerror(err));
+            continue;
+        }
+        // Ownership of the listener set moved to the worker
+        listenerSets[i] = NULL;
+        threads.push_back(tid);
+        LOG_INFO("Worker thread " << i << " started");
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+    threads.clear();
+}
+
+WorkerPool::~WorkerPool() {
+    for (size_t i = 0; i < listenerSets.size(); i++) {
+        if (!listenerSets[i])
+            continue;
+        std::vector<int> fds = listenerSets[i]->getFDs();
+        for (size_t j = 0; j < fds.size(); j++)
+            close(fds[j]);
+        delete listenerSets[i];
+    }
+}
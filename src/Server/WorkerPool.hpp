@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <pthread.h>
+#include "../Config/ConfigParser.hpp"
+
+class sock;
+
+/**
+ * @brief Runs several independent event loops, one per worker thread
+ *
+ * Each worker owns its own SO_REUSEPORT listener set, its own monitorClient
+ * and therefore its own connection table. The kernel spreads incoming
+ * connections across the listener sets, so workers never share state or
+ * locks on the request path.
+ */
+class WorkerPool {
+private:
+    std::vector<sock*> listenerSets;    // One SO_REUSEPORT listener set per worker
+    std::vector<pthread_t> threads;     // Running worker threads
+
+    /**
+     * @brief Thread entry point - runs one event loop until it fails
+     * @param arg Listener set (sock*) owned by this worker
+     * @return Always NULL
+     */
+    static void* workerMain(void* arg);
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+public:
+    /**
+     * @brief Constructor - binds one listener set per worker up front
+     * @param config_parser Parsed configuration
+     * @param workers Number of worker threads to run
+     * Binding happens on the calling thread so port conflicts surface
+     * as a sock::sockException before any worker starts
+     */
+    WorkerPool(const ConfigParser& config_parser, size_t workers);
+
+    /**
+     * @brief Starts all workers and blocks until every one of them exits
+     */
+    void run();
+
+    /**
+     * @brief Destructor - releases listener sets not handed to a worker
+     */
+    ~WorkerPool();
+};
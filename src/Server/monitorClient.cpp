@@ -1,441 +1,580 @@
 #include "monitorClient.hpp"
 #include "../Socket/socket.hpp"
 #include "../CGI/CGIHandler.hpp"
+#include "GzipStream.hpp"
 
 #include <unistd.h>
 #include <cstring>
+#include <strings.h>
+#include <cerrno>
 #include <iostream>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <ctime>
 #include <sstream>
 
 
-#define CHUNK_SIZE 8192
+monitorClient::monitorClient(const sock& serverSockets)
+    : config(serverSockets.getConfig()), timers(monotonicMs()),
+      fileCache(config->global.file_cache_size, config->global.file_cache_max_file),
+      loopNow(monotonicMs()) {
 
-monitorClient::monitorClient(sock serverSockets) : ServerConfig(serverSockets.getConfig()) {
+    const Config::GlobalConfig& global = config->global;
+    phaseTimeout[PHASE_HEADER] = global.header_timeout * 1000ULL;
+    phaseTimeout[PHASE_BODY] = global.body_timeout * 1000ULL;
+    phaseTimeout[PHASE_KEEPALIVE] = global.keepalive_timeout * 1000ULL;
+    phaseTimeout[PHASE_SEND] = global.send_timeout * 1000ULL;
+    phaseTimeout[PHASE_CGI] = global.cgi_timeout * 1000ULL;
+
+    this->backend = EventBackend::create(global.event_backend);
+    this->edgeTriggered = global.edge_triggered && backend->supportsEdgeTriggered();
+    if (global.event_backend != backend->name())
+        LOG_WARN(global.event_backend << " backend unavailable, falling back to " << backend->name());
+    LOG_INFO("Event backend: " << backend->name() << (edgeTriggered ? " (edge-triggered clients)" : ""));
 
     std::vector<int> serverFDs = serverSockets.getFDs();
 
-    pollfd serverPollFd;
     for (size_t i = 0; i < serverFDs.size(); i++) {
-        memset(&serverPollFd, 0, sizeof(serverPollFd));
-        serverPollFd.fd = serverFDs[i];
-        serverPollFd.events = POLLIN;
-        fds.push_back(serverPollFd);
-        // Informational log
-        std::ostringstream ss;
-        ss << "[INFO] " << "Server: listening socket added (fd=" << serverFDs[i] << ")";
-        std::cout << ss.str() << std::endl;
+        if (backend->addListener(serverFDs[i]) == -1) {
+            delete backend;
+            throw monitorexception("[ERROR] failed to watch listening socket");
+        }
+        listenFDs.push_back(serverFDs[i]);
+        claimFd(serverFDs[i], FD_LISTENER, serverFDs[i], NULL);
+        // Accepted connections take their port from the listener, which
+        // selects the virtual host together with the Host name
+        sockaddr_in local;
+        socklen_t localLen = sizeof(local);
+        if (getsockname(serverFDs[i], reinterpret_cast<sockaddr*>(&local), &localLen) == 0)
+            fdSlots[serverFDs[i]].port = ntohs(local.sin_port);
+        LOG_INFO("Server: listening socket added (fd=" << serverFDs[i] << ")");
+    }
+
+    // Cached files are only trusted while their change notifications arrive
+    int notifyFd = fileCache.notifyFd();
+    if (notifyFd >= 0) {
+        if (backend->add(notifyFd, POLLIN, false) == -1) {
+            LOG_WARN("file cache disabled: cannot watch its inotify descriptor");
+            fileCache.disable();
+        } else {
+            claimFd(notifyFd, FD_NOTIFY, notifyFd, NULL);
+        }
     }
-    this->numberOfServers = serverFDs.size();
 }
 
-void monitorClient::acceptNewClient(int serverFD) {
-    int clientFd = accept(serverFD, NULL, NULL);
-    if (clientFd == -1) {
-        std::cerr << "[ERROR] accept failed for serverFD=" << serverFD << std::endl;
-        return;
+monitorClient::FdKind monitorClient::kindOf(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= fdSlots.size())
+        return FD_FREE;
+    return fdSlots[fd].kind;
+}
+
+monitorClient::SocketTracker* monitorClient::trackerOf(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= fdSlots.size())
+        return NULL;
+    return fdSlots[fd].tracker;
+}
+
+void monitorClient::claimFd(int fd, FdKind kind, int owner, SocketTracker* tracker) {
+    if (static_cast<size_t>(fd) >= fdSlots.size()) {
+        FdSlot freeSlot;
+        freeSlot.kind = FD_FREE;
+        freeSlot.owner = -1;
+        freeSlot.index = 0;
+        freeSlot.port = 0;
+        freeSlot.tracker = NULL;
+        fdSlots.resize(fd + 1, freeSlot);
     }
-    
-    if (clientFd < 0) {
-        std::cerr << "Invalid client file descriptor: " << clientFd << std::endl;
+    FdSlot& slot = fdSlots[fd];
+    slot.kind = kind;
+    slot.owner = owner;
+    slot.tracker = tracker;
+    slot.index = 0;
+    slot.port = 0;
+    if (kind == FD_CLIENT) {
+        slot.index = clientFDs.size();
+        clientFDs.push_back(fd);
+    }
+}
+
+void monitorClient::releaseFd(int fd) {
+    if (kindOf(fd) == FD_FREE)
         return;
+    FdSlot& slot = fdSlots[fd];
+    if (slot.kind == FD_CLIENT) {
+        // Swap-remove: move the last client into the freed position
+        int last = clientFDs.back();
+        clientFDs[slot.index] = last;
+        fdSlots[last].index = slot.index;
+        clientFDs.pop_back();
     }
-    
-    if (fcntl(clientFd, F_SETFL, O_NONBLOCK) < 0) {
-        std::cerr << "[ERROR] fcntl failed for clientFd=" << clientFd << std::endl;
+    slot.kind = FD_FREE;
+    slot.owner = -1;
+    slot.index = 0;
+    slot.port = 0;
+    slot.tracker = NULL;
+}
+
+void monitorClient::acceptNewClient(int serverFD) {
+    for (size_t n = 0; n < ACCEPT_BATCH; n++) {
+        sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        int clientFd = accept4(serverFD, reinterpret_cast<sockaddr*>(&addr), &addrLen,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd == -1) {
+            // Queue drained, or another worker sharing this listener won the race
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            // The peer gave up before we got to it; keep draining
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            LOG_ERROR("accept failed for serverFD=" << serverFD << ": " << strerror(errno));
+            return;
+        }
+        if (!addClient(clientFd, addr, serverFD))
+            continue;
+        // Optimistic first read: the request usually arrives together with
+        // the handshake, so this saves a wait() round trip per connection
+        handleClientReadable(clientFd);
+    }
+}
+
+bool monitorClient::addClient(int clientFd, const sockaddr_in& addr, int serverFD) {
+    if (kindOf(clientFd) != FD_FREE) {
+        LOG_WARN("Client " << clientFd << " already exists in tracker");
         close(clientFd);
-        return;
+        return false;
     }
 
-    pollfd serverPollFd;
-    memset(&serverPollFd, 0, sizeof(serverPollFd));
-    serverPollFd.fd = clientFd; 
-    serverPollFd.events = POLLIN;
-    serverPollFd.revents = 0;
-    
     try {
-        fds.push_back(serverPollFd);
-        SocketTracker st;
-        std::pair<TrackerIt, bool> result = this->fdsTracker.insert(
-            std::pair<int, SocketTracker>(clientFd, st)
-        );
-        
-        if (!result.second) {
-            std::cerr << "Warning: Client " << clientFd << " already exists in tracker" << std::endl;
-            fds.pop_back();
+        SocketTracker* tracker = new SocketTracker();
+        if (backend->add(clientFd, POLLIN, edgeTriggered) == -1) {
+            LOG_ERROR("failed to watch clientFd=" << clientFd);
+            delete tracker;
             close(clientFd);
-            return;
+            return false;
         }
+        tracker->events = POLLIN;
+        tracker->timer.fd = clientFd;
+        tracker->input.setPool(&inputPool);
+        tracker->request_obj.setClientFD(clientFd);
+        tracker->request_obj.setClientAddr(addr);
+        tracker->request_obj.setLocalPort(fdSlots[serverFD].port);
+        claimFd(clientFd, FD_CLIENT, clientFd, tracker);
+        setPhase(*tracker, PHASE_HEADER);
         
-        // Log accepted connection with client FD and server FD
-        std::ostringstream ss;
-        ss << "[INFO] " << "Server (listen_fd=" << serverFD << ") accepted new connection (client_fd=" << clientFd << ")";
-        std::cout << ss.str() << std::endl;
+        LOG_DEBUG("Server (listen_fd=" << serverFD << ") accepted new connection (client_fd=" << clientFd << ")");
     } catch (const std::exception& e) {
-        std::cerr << "Exception while adding client " << clientFd << ": " << e.what() << std::endl;
+        LOG_ERROR("Exception while adding client " << clientFd << ": " << e.what());
         close(clientFd);
-        return;
+        return false;
     }
+    return true;
 }
 
-void monitorClient::removeClient(int index) {
-    if (index < 0 || index >= static_cast<int>(fds.size()) || index < static_cast<int>(numberOfServers)) {
-        std::cerr << "Invalid index " << index << " for removeClient (size: " << fds.size() << ", servers: " << numberOfServers << ")" << std::endl;
+void monitorClient::removeClient(int clientFd) {
+    if (kindOf(clientFd) != FD_CLIENT) {
+        LOG_WARN("Invalid fd " << clientFd << " for removeClient");
         return;
     }
-    
-    int clientFd = fds[index].fd;
+    SocketTracker* tracker = fdSlots[clientFd].tracker;
+
+    // A CGI still running for this client owns a pipe registered with the backend
+    if (tracker->cgiOutputFd >= 0) {
+        backend->remove(tracker->cgiOutputFd);
+        releaseFd(tracker->cgiOutputFd);
+    }
+    backend->remove(clientFd);
     close(clientFd);
-    fds.erase(fds.begin() + index);
-    fdsTracker.erase(clientFd);
-    
-    std::cout << "Client " << clientFd << " removed from index " << index << std::endl;
+    releaseFd(clientFd);
+    timers.cancel(tracker->timer);
+    delete tracker;
+
+    LOG_DEBUG("Client " << clientFd << " removed");
+}
+
+void monitorClient::setClientEvents(int clientFd, SocketTracker& tracker, short events) {
+    if (tracker.events == events)
+        return;
+    tracker.events = events;
+    backend->modify(clientFd, events);
 }
 
 void monitorClient::startEventLoop() {
-    int ready = 0;
-    initializeTimeouts();
+    std::vector<EventBackend::Event> ready;
     
     while (1) {   
-        time_t now = time(NULL);
-        if (shouldCheckTimeouts(now)) {
-            checkTimeouts();
-            lastTimeoutCheck = now;
-        }
+        loopNow = monotonicMs();
+        expireTimers();
         
-        ready = poll(fds.data(), fds.size(), 100);
-        if (ready == -1) {
-            perror("[ERROR] poll fail");
-            throw monitorexception("[ERROR] poll fail");
+        // Sleep until the next deadline (forever when nothing is pending)
+        if (backend->wait(ready, timers.nextTimeout(loopNow)) == -1) {
+            LOG_ERROR("event wait fail: " << strerror(errno));
+            throw monitorexception("[ERROR] event wait fail");
         }
         
-        for (size_t i = 0; i < numberOfServers; i++) {
-            if (fds[i].revents & POLLIN) {
-                acceptNewClient(fds[i].fd);
-            }
-        }
-        
-        for (int i = static_cast<int>(fds.size()) - 1; i >= static_cast<int>(numberOfServers); i--) {
-            if (i >= static_cast<int>(fds.size())) continue;
-            
-            pollfd& currentFd = fds[i];
-            
-            // If this client is currently waiting on a CGI, skip reading from it
-            TrackerIt waitCgiIt = fdsTracker.find(currentFd.fd);
-            if (waitCgiIt != fdsTracker.end() && waitCgiIt->second.isCgiRequest && waitCgiIt->second.cgiOutputFd >= 0) {
-                // Ensure we don't read from this socket while CGI is running
-                currentFd.events &= ~POLLIN;
-            }
-            
-            // Check if this is a CGI output fd
-            bool isCgiFd = false;
-            int clientFdForCgi = -1;
-            for (TrackerIt tit = fdsTracker.begin(); tit != fdsTracker.end(); ++tit) {
-                if (tit->second.isCgiRequest && tit->second.cgiOutputFd == currentFd.fd) {
-                    isCgiFd = true;
-                    clientFdForCgi = tit->first;
-                    break;
-                }
-            }
-            
-            // Also handle POLLHUP/POLLERR to finalize short-lived scripts that close quickly
-            if (isCgiFd && (currentFd.revents & (POLLIN | POLLHUP | POLLERR))) {
-                // Handle CGI output
-                TrackerIt cgiTracker = fdsTracker.find(clientFdForCgi);
-                if (cgiTracker != fdsTracker.end() && cgiTracker->second.cgiHandler) {
-                    // Any activity from the CGI should keep the client connection alive
-                    updateClientActivity(clientFdForCgi);
-                    int cgiStatus = cgiTracker->second.cgiHandler->processCGIOutput();
-                    
-                    if (cgiStatus == 0) {
-                        // CGI completed successfully
-                        std::cout << "[CGI] CGI completed for client " << clientFdForCgi << std::endl;
-                        
-                        // Remove CGI fd from poll
-                        fds.erase(fds.begin() + i);
-                        
-                        // Generate response from CGI result
-                        CGIHandler::Result result = cgiTracker->second.cgiHandler->getResult();
-                        std::ostringstream resp;
-                        resp << "HTTP/1.1 " << result.status_code << " " << result.status_text << "\r\n";
-                        bool hasConn = false;
-                        size_t bodyLen = result.body.size();
-                        for (std::map<std::string,std::string>::const_iterator hit = result.headers.begin(); 
-                             hit != result.headers.end(); ++hit) {
-                            if (hit->first == "Connection") hasConn = true;
-                            resp << hit->first << ": " << hit->second << "\r\n";
-                        }
-                        // Add Content-Length if CGI didn't provide it (so we can close immediately)
-                        if (result.headers.find("Content-Length") == result.headers.end()) {
-                            resp << "Content-Length: " << bodyLen << "\r\n";
-                        }
-                        // Force close to avoid 60s keep-alive wait after CGI
-                        if (!hasConn) resp << "Connection: close\r\n";
-                        resp << "\r\n" << result.body;
-                        cgiTracker->second.response = resp.str();
-                        
-                        // Clean up CGI state
-                        delete cgiTracker->second.cgiHandler;
-                        cgiTracker->second.cgiHandler = NULL;
-                        cgiTracker->second.isCgiRequest = false;
-                        cgiTracker->second.cgiOutputFd = -1;
-                        // Mark activity on completion to avoid any race with timeout checker
-                        updateClientActivity(clientFdForCgi);
-                        
-                        // Enable POLLOUT for client to send response
-                        for (size_t j = numberOfServers; j < fds.size(); j++) {
-                            if (fds[j].fd == clientFdForCgi) {
-                                fds[j].events |= POLLOUT;
-                                break;
-                            }
-                        }
-                    } else if (cgiStatus == -1) {
-                        // CGI error or timeout
-                        std::cout << "[CGI] CGI failed for client " << clientFdForCgi << std::endl;
-                        
-                        // Remove CGI fd from poll
-                        fds.erase(fds.begin() + i);
-                        
-                        // Generate error response
-                        CGIHandler::Result result = cgiTracker->second.cgiHandler->getResult();
-                        std::ostringstream resp;
-                        resp << "HTTP/1.1 " << result.status_code << " " << result.status_text << "\r\n";
-                        // Ensure minimal headers
-                        resp << "Content-Type: text/html\r\n";
-                        resp << "Content-Length: " << result.body.size() << "\r\n";
-                        resp << "Connection: close\r\n\r\n";
-                        resp << result.body;
-                        cgiTracker->second.response = resp.str();
-                        
-                        // Clean up CGI state
-                        delete cgiTracker->second.cgiHandler;
-                        cgiTracker->second.cgiHandler = NULL;
-                        cgiTracker->second.isCgiRequest = false;
-                        cgiTracker->second.cgiOutputFd = -1;
-                        // Mark activity to reflect we produced a response
-                        updateClientActivity(clientFdForCgi);
-                        
-                        // Enable POLLOUT for client to send response
-                        for (size_t j = numberOfServers; j < fds.size(); j++) {
-                            if (fds[j].fd == clientFdForCgi) {
-                                fds[j].events |= POLLOUT;
-                                // Mark write error so loop will close client after sending
-                                cgiTracker->second.WError = 1;
-                                break;
-                            }
-                        }
-                    }
-                    // cgiStatus == 1 means still reading, continue polling
-                }
-                continue;
-            }
-            
-            // Handle incoming data (POLLIN) - regular client socket
-            if (currentFd.revents & POLLIN) {
-                // If there's already a fully-parsed request and a pending response,
-                // avoid reading further from this socket until the response is sent.
-                std::map<int, SocketTracker>::iterator it_check = fdsTracker.find(currentFd.fd);
-                if (it_check != fdsTracker.end()) {
-                    if (it_check->second.request_obj.isComplete() && !it_check->second.response.empty()) {
-                        // Ensure POLLOUT is enabled so we can continue writing the response
-                        currentFd.events |= POLLOUT;
-                        // Skip reading for now
-                        continue;
-                    }
-                }
-
-                (void)readClientRequest(currentFd.fd);
-                updateClientActivity(currentFd.fd);
-
-                std::map<int, SocketTracker>::iterator it = fdsTracker.find(currentFd.fd);
-                if (it != fdsTracker.end()) {
-                    // Generate response if request complete and none queued yet
-                    if (it->second.request_obj.isComplete()) {
-                        if (!it->second.error.empty()) {
-                            generateErrorResponse(it->second);
-                        } else {
-                            // Detect CGI before generating normal response
-                            std::string scriptPath, interpreterPath;
-                            if (shouldHandleAsCGI(it->second, scriptPath, interpreterPath)) {
-                                if (!it->second.isCgiRequest) {
-                                    it->second.isCgiRequest = true;
-                                    startAsyncCGI(it->second, currentFd.fd, scriptPath, interpreterPath);
-                                    // Stop reading from client while CGI is running
-                                    currentFd.events &= ~POLLIN;
-                                }
-                                // Do not generate response now; wait for CGI completion
-                            } else {
-                                generateSuccessResponse(it->second);
-                            }
-                        }
-                    }
-                    // Arm writer if we have any response data queued (pipelining supported)
-                    if (!it->second.response.empty()) {
-                        currentFd.events |= POLLOUT;
-                    } else {
-                        // Ensure we are not arming POLLOUT when CGI is running
-                        if (it->second.isCgiRequest) {
-                            // Keep events as POLLIN; CGI pipe fd will trigger POLLIN when ready
-                            currentFd.events &= ~POLLOUT;
-                        }
-                    }
-                }
-            }
-            
-            // Handle outgoing data (POLLOUT) - WRITE RESPONSE HERE
-            if (currentFd.revents & POLLOUT) {
-                int wr = writeClientResponse(currentFd.fd);
-
-                // If write is still pending (partial write), keep POLLOUT enabled
-                if (wr == 1) {
-                    currentFd.events |= POLLOUT;
-                    continue;
-                }
-
-                // On fatal write error, remove client
-                if (wr == -1) {
-                    removeClient(i);
-                    continue;
-                }
-
-                // wr == 0 -> response fully written
-                std::map<int, SocketTracker>::iterator it = fdsTracker.find(currentFd.fd);
-                if (it == fdsTracker.end()) continue;
-
-                // Determine Connection header (case-insensitive value check)
-                const std::string connHdr = it->second.request_obj.getHeader("connection");
-                std::string connVal = connHdr;
-                for (size_t k = 0; k < connVal.size(); ++k) connVal[k] = std::tolower(connVal[k]);
-
-                if (connVal == "close" || it->second.WError || it->second.RError) {
-                    removeClient(i);
-                } else {
-                    // Keep-alive: clear request-specific state and return to POLLIN
-                    it->second.response.clear();
-                    it->second.raw_buffer.clear();
-                    // keep any pipelined bytes in raw_buffer so next request can be parsed
-                    it->second.request_obj.reset();
-                    it->second.headersParsed = false;
-                    it->second.consumedBytes = 0;
-                    it->second.error.clear();
-                    it->second.WError = 0;
-                    it->second.RError = 0;
-                    currentFd.events = POLLIN;
-                }
-            }
-        }
+        loopNow = monotonicMs();
+        for (size_t i = 0; i < ready.size(); i++)
+            handleEvent(ready[i].fd, ready[i].revents);
     }
 }
 
-monitorClient::~monitorClient() {
-    std::cout << "close all fds \n";
-    for (PollFdsIt it = fds.begin(); it != fds.end(); it++) {
-        if (it->fd > 0)
-            close(it->fd);
+void monitorClient::handleEvent(int fd, short revents) {
+    switch (kindOf(fd)) {
+    case FD_LISTENER:
+        if (revents & POLLIN)
+            acceptNewClient(fd);
+        return;
+    case FD_CGI_PIPE:
+        handleCgiEvent(fd, revents);
+        return;
+    case FD_NOTIFY:
+        fileCache.processEvents();
+        return;
+    case FD_CLIENT:
+        break;
+    default:
+        return; // stale event for a descriptor removed earlier in this batch
     }
-}
 
-monitorClient::monitorexception::monitorexception(std::string msg) {
-    this->ErrorMsg = msg;
+    // Hang-ups and errors surface through read() returning 0/-1
+    if (revents & (POLLIN | POLLHUP | POLLERR))
+        handleClientReadable(fd);
+
+    // Handle outgoing data (POLLOUT) - WRITE RESPONSE HERE
+    if (revents & POLLOUT) {
+        SocketTracker* tracker = (kindOf(fd) == FD_CLIENT) ? trackerOf(fd) : NULL;
+        if (tracker && (tracker->events & POLLOUT))
+            handleClientWritable(fd);
+    }
 }
 
-const char *monitorClient::monitorexception::what() const throw() {
-    return ErrorMsg.c_str();
+void monitorClient::handleCgiEvent(int cgiFd, short revents) {
+    // Also handle POLLHUP/POLLERR to finalize short-lived scripts that close quickly
+    if (!(revents & (POLLIN | POLLHUP | POLLERR)))
+        return;
+
+    int clientFdForCgi = fdSlots[cgiFd].owner;
+    SocketTracker& tracker = *fdSlots[cgiFd].tracker;
+    if (!tracker.cgiHandler)
+        return;
+
+    int cgiStatus = tracker.cgiHandler->processCGIOutput();
+    // cgiStatus == 1 means still reading, continue polling
+    if (cgiStatus != 1)
+        finishCgi(clientFdForCgi, tracker, cgiStatus);
 }
 
-monitorClient::monitorexception::~monitorexception() throw() {}
+/**
+ * @brief Tells whether a CGI response may be compressed here
+ *
+ * Not when the script already chose a coding or framing, or for statuses
+ * that carry no body.
+ */
+static bool cgiMayGzip(const CGIHandler::Result& result) {
+    if (result.status_code == 204 || result.status_code == 304 || result.status_code < 200)
+        return false;
+    for (std::map<std::string, std::string>::const_iterator it = result.headers.begin();
+         it != result.headers.end(); ++it) {
+        if (strcasecmp(it->first.c_str(), "Content-Encoding") == 0
+            || strcasecmp(it->first.c_str(), "Transfer-Encoding") == 0)
+            return false;
+    }
+    return true;
+}
 
-monitorClient::SocketTracker::SocketTracker() 
-    : headersParsed(false), consumedBytes(0), WError(0), RError(0), lastActive(time(NULL)),
-      isCgiRequest(false), cgiOutputFd(-1), cgiHandler(NULL) {
-    raw_buffer = "";
-    response = "";
-    error = "";
+/**
+ * @brief Content type of a CGI response
+ *
+ * Header names keep the script's spelling, and CGIHandler adds a default
+ * "Content-Type" when that exact name is missing, so a script's
+ * "Content-type" wins over the default.
+ */
+static std::string cgiContentType(const CGIHandler::Result& result) {
+    std::map<std::string, std::string>::const_iterator fallback = result.headers.find("Content-Type");
+    for (std::map<std::string, std::string>::const_iterator it = result.headers.begin();
+         it != result.headers.end(); ++it) {
+        if (it != fallback && strcasecmp(it->first.c_str(), "Content-Type") == 0)
+            return it->second;
+    }
+    return fallback != result.headers.end() ? fallback->second : std::string();
 }
 
-monitorClient::SocketTracker::~SocketTracker() {
-    if (cgiHandler) {
-        delete cgiHandler;
-        cgiHandler = NULL;
+void monitorClient::finishCgi(int clientFd, SocketTracker& tracker, int cgiStatus) {
+    // Remove CGI fd from the backend
+    backend->remove(tracker.cgiOutputFd);
+    releaseFd(tracker.cgiOutputFd);
+
+    if (cgiStatus == 0) {
+        // CGI completed successfully
+        LOG_INFO("CGI completed for client " << clientFd);
+        
+        // Generate response from CGI result
+        CGIHandler::Result result = tracker.cgiHandler->getResult();
+        std::ostringstream resp;
+        resp << "HTTP/1.1 " << result.status_code << " " << result.status_text << "\r\n";
+        bool hasConn = false;
+        size_t bodyLen = result.body.size();
+        GzipStream* gzip = NULL;
+        if (cgiMayGzip(result) && shouldGzip(tracker.request_obj, cgiContentType(result), bodyLen)) {
+            gzip = new GzipStream();
+            if (!gzip->ok()) {
+                delete gzip;
+                gzip = NULL;
+            }
+        }
+        for (std::map<std::string,std::string>::const_iterator hit = result.headers.begin(); 
+             hit != result.headers.end(); ++hit) {
+            if (hit->first == "Connection") hasConn = true;
+            // The compressed length is not known before it is sent
+            if (gzip && strcasecmp(hit->first.c_str(), "Content-Length") == 0)
+                continue;
+            resp << hit->first << ": " << hit->second << "\r\n";
+        }
+        if (gzip) {
+            resp << "Content-Encoding: gzip\r\nTransfer-Encoding: chunked\r\nVary: Accept-Encoding\r\n";
+        } else if (result.headers.find("Content-Length") == result.headers.end()) {
+            // Add Content-Length if CGI didn't provide it (so we can close immediately)
+            resp << "Content-Length: " << bodyLen << "\r\n";
+        }
+        // Force close to avoid 60s keep-alive wait after CGI
+        if (!hasConn) {
+            resp << "Connection: close\r\n";
+            tracker.WError = 1;
+        }
+        resp << "\r\n";
+        std::string head = resp.str();
+        tracker.output.pushMemory(head);
+        if (tracker.request_obj.getMethod() == "HEAD") {
+            // Same head as GET; the script's body is dropped
+            delete gzip;
+        } else if (gzip) {
+            gzip->write(result.body.data(), result.body.size(), tracker.output);
+            gzip->finish(tracker.output);
+            delete gzip;
+        } else {
+            tracker.output.pushMemory(result.body);
+        }
+    } else {
+        // CGI error or timeout
+        LOG_WARN("CGI failed for client " << clientFd);
+        
+        // Generate error response
+        CGIHandler::Result result = tracker.cgiHandler->getResult();
+        std::ostringstream resp;
+        resp << "HTTP/1.1 " << result.status_code << " " << result.status_text << "\r\n";
+        // Ensure minimal headers
+        resp << "Content-Type: text/html\r\n";
+        resp << "Content-Length: " << result.body.size() << "\r\n";
+        resp << "Connection: close\r\n\r\n";
+        std::string head = resp.str();
+        tracker.output.pushMemory(head);
+        tracker.output.pushMemory(result.body);
+        // Mark write error so loop will close client after sending
+        tracker.WError = 1;
     }
+
+    // Clean up CGI state
+    delete tracker.cgiHandler;
+    tracker.cgiHandler = NULL;
+    tracker.isCgiRequest = false;
+    tracker.cgiOutputFd = -1;
+
+    // Requests pipelined behind the CGI one are answered next
+    finishRequest(tracker);
+    serveRequests(clientFd, tracker);
+    armClient(clientFd, tracker);
 }
 
-bool monitorClient::shouldCheckTimeouts(time_t currentTime) {
-    return (currentTime - lastTimeoutCheck >= TIMEOUT_CHECK_INTERVAL);
+void monitorClient::handleClientReadable(int clientFd) {
+    SocketTracker* tracker = trackerOf(clientFd);
+    if (!tracker)
+        return;
+
+    // Nothing more is read while a CGI answers the current request, after a
+    // response that closes the connection, or while the client is behind on
+    // reading the responses already queued
+    if (tracker->isCgiRequest || tracker->WError
+        || tracker->output.pendingBytes() >= OUTPUT_HIGH_WATERMARK) {
+        return;
+    }
+
+    int rd = readClientRequest(clientFd);
+
+    if (rd == 0 && tracker->error.empty() && !tracker->output.empty()) {
+        // The peer is done sending; answers to its earlier requests still go out
+        tracker->WError = 1;
+        armClient(clientFd, *tracker);
+        return;
+    }
+    if (rd == -1 || (rd == 0 && tracker->error.empty())) {
+        // Peer closed the connection or the read failed
+        removeClient(clientFd);
+        return;
+    }
+    if (rd == 0) {
+        // Malformed or oversized request: answer, then close
+        generateErrorResponse(*tracker);
+        armClient(clientFd, *tracker);
+        return;
+    }
+
+    serveRequests(clientFd, *tracker);
+    armClient(clientFd, *tracker);
 }
 
-void monitorClient::SocketTracker::updateActivity() {
-    lastActive = time(NULL);
+void monitorClient::serveRequests(int clientFd, SocketTracker& tracker) {
+    while (!tracker.isCgiRequest && !tracker.WError
+           && tracker.output.pendingBytes() < OUTPUT_HIGH_WATERMARK) {
+        if (!tracker.request_obj.isComplete()) {
+            // Pipelined bytes behind the previous request are already buffered
+            if (parseClientInput(tracker, false) == 0) {
+                generateErrorResponse(tracker);
+                return;
+            }
+            if (!tracker.request_obj.isComplete())
+                return;
+        }
+
+        if (!tracker.error.empty()) {
+            generateErrorResponse(tracker);
+            return;
+        }
+        // Detect CGI before generating normal response
+        std::string scriptPath, interpreterPath;
+        if (shouldHandleAsCGI(tracker, scriptPath, interpreterPath)) {
+            tracker.isCgiRequest = true;
+            startAsyncCGI(tracker, clientFd, scriptPath, interpreterPath);
+            // finishCgi() queues the response and resumes from there
+            if (tracker.isCgiRequest)
+                return;
+        } else {
+            generateSuccessResponse(tracker);
+        }
+        finishRequest(tracker);
+    }
 }
 
-bool monitorClient::SocketTracker::hasTimedOut(time_t currentTime, time_t timeoutSeconds) const {
-    return (currentTime - lastActive) > timeoutSeconds;
+void monitorClient::finishRequest(SocketTracker& tracker) {
+    // HTTP/1.1 defaults to keep-alive unless the client sent "close"
+    const Request::StringMap& headers = tracker.request_obj.getAllHeaders();
+    Request::StringMap::const_iterator conn = headers.find("connection");
+    if (conn != headers.end() && strcasecmp(conn->second.c_str(), "close") == 0)
+        tracker.WError = 1;
+    if (tracker.WError || tracker.RError) {
+        // Requests pipelined behind a closing response are never answered
+        tracker.input.clear();
+        return;
+    }
+    // The response owns copies of what it needs; the parser starts over on
+    // whatever follows in the input
+    tracker.request_obj.reset();
+    tracker.headersParsed = false;
+    tracker.error.clear();
 }
 
-void monitorClient::checkTimeouts() {
-    time_t now = time(NULL);
-    // Print a per-client debug line including the client FD and current time
-    for (size_t i = numberOfServers; i < fds.size(); i++) {
-        int clientFd = fds[i].fd;
-        std::ostringstream ss;
-        ss << "[DEBUG] " << "Checking client fd=" << clientFd << " for timeout at " << std::ctime(&now);
-        std::cout << ss.str();
+void monitorClient::armClient(int clientFd, SocketTracker& tracker) {
+    bool reading = !tracker.isCgiRequest && !tracker.WError
+                   && tracker.output.pendingBytes() < OUTPUT_HIGH_WATERMARK;
+    short events = reading ? POLLIN : 0;
+    if (!tracker.output.empty())
+        events |= POLLOUT;
+    // With edge-triggered sockets re-adding POLLIN also reports data that
+    // arrived while reads were paused; a read cut short gets no new edge, so
+    // the same mask is registered again to have the rest reported
+    if (reading && tracker.readPending) {
+        tracker.events = events;
+        backend->modify(clientFd, events);
+    } else {
+        setClientEvents(clientFd, tracker, events);
+    }
 
-        TrackerIt it = fdsTracker.find(clientFd);
+    if (!tracker.output.empty()) {
+        if (tracker.phase != PHASE_SEND)
+            setPhase(tracker, PHASE_SEND);
+    } else if (tracker.isCgiRequest) {
+        // The CGI pipe drives progress now
+        setPhase(tracker, PHASE_CGI);
+    } else if (tracker.headersParsed) {
+        // The body deadline is an idle limit: every read restarts it
+        setPhase(tracker, PHASE_BODY);
+    } else if (tracker.request_obj.hasStarted()) {
+        // First bytes of the next request; the head must arrive in full
+        // before header_timeout, however slowly it trickles in
+        if (tracker.phase != PHASE_HEADER)
+            setPhase(tracker, PHASE_HEADER);
+    } else if (tracker.phase != PHASE_HEADER && tracker.phase != PHASE_KEEPALIVE) {
+        setPhase(tracker, PHASE_KEEPALIVE);
+    }
+}
 
-        // Skip timeout enforcement while a CGI is actively running for this client
-        if (it != fdsTracker.end() && it->second.isCgiRequest) {
-            continue;
+void monitorClient::handleClientWritable(int clientFd) {
+    for (;;) {
+        int wr = writeClientResponse(clientFd);
+
+        // On fatal write error, remove client
+        if (wr == -1) {
+            removeClient(clientFd);
+            return;
         }
+        SocketTracker* tracker = trackerOf(clientFd);
+        if (!tracker) return;
 
-        if (it != fdsTracker.end() && it->second.hasTimedOut(now, CLIENT_TIMEOUT)) {
-            std::ostringstream ss2;
-            ss2 << "[WARN] " << "Client fd=" << clientFd << " timed out after " << (now - it->second.lastActive) << " seconds";
-            std::cout << ss2.str() << std::endl;
-            
-            // Decide whether to emit 408 or silently close idle keep-alive
-            bool hasPartialRequest = (!it->second.headersParsed && !it->second.raw_buffer.empty())
-                                   || (it->second.headersParsed && !it->second.request_obj.isComplete());
-
-            if (hasPartialRequest) {
-                // Incomplete request -> send 408
-                it->second.RError = 408;
-                it->second.WError = 1;
-                std::string timeoutHtml = "<html><body><h1>408 Request Timeout</h1>"
-                                         "<p>The server timed out waiting for the Request.</p></body></html>";
-                it->second.response = "HTTP/1.1 408 Request Timeout\r\n";
-                it->second.response += "Connection: close\r\n";
-                it->second.response += "Content-Type: text/html\r\n";
-                {
-                    std::ostringstream tmp;
-                    tmp << timeoutHtml.length();
-                    it->second.response += "Content-Length: " + tmp.str() + "\r\n\r\n";
-                }
-                it->second.response += timeoutHtml;
-                fds[i].events = POLLOUT;
-            } else {
-                // Idle keep-alive connection -> close without sending 408
-                removeClient(static_cast<int>(i));
-                if (i > numberOfServers) {
-                    // Adjust index after removal so we don't skip next fd
-                    --i;
-                }
-            }
+        // Partial write: keep POLLOUT enabled and give the peer another
+        // send_timeout to drain its receive window
+        if (wr == 1)
+            setPhase(*tracker, PHASE_SEND);
+
+        // wr == 0 -> every queued response was written
+        if (wr == 0 && (tracker->WError || tracker->RError)) {
+            removeClient(clientFd);
+            return;
         }
+
+        // Back under the watermark: answer requests already buffered and read again
+        if (!(tracker->events & POLLIN))
+            serveRequests(clientFd, *tracker);
+        // An edge-triggered socket only reports POLLOUT again after a write
+        // hit the full buffer, so what was just queued is sent right away
+        if (wr == 0 && !tracker->output.empty())
+            continue;
+        armClient(clientFd, *tracker);
+        return;
     }
-    lastTimeoutCheck = now;
 }
 
-void monitorClient::initializeTimeouts() {
-    lastTimeoutCheck = time(NULL);
+monitorClient::~monitorClient() {
+    LOG_DEBUG("close all fds");
+    while (!clientFDs.empty())
+        removeClient(clientFDs.back());
+    for (size_t i = 0; i < listenFDs.size(); i++) {
+        backend->remove(listenFDs[i]);
+        close(listenFDs[i]);
+    }
+    for (std::map<const Config::ServerConfig*, OpenFileCache*>::iterator it = openFiles.begin();
+         it != openFiles.end(); ++it)
+        delete it->second;
+    delete backend;
 }
 
-void monitorClient::updateClientActivity(int clientFd) {
-    TrackerIt it = fdsTracker.find(clientFd);
-    if (it != fdsTracker.end()) {
-        it->second.updateActivity();
-    }
+monitorClient::monitorexception::monitorexception(std::string msg) {
+    this->ErrorMsg = msg;
 }
 
+const char *monitorClient::monitorexception::what() const throw() {
+    return ErrorMsg.c_str();
+}
 
+monitorClient::monitorexception::~monitorexception() throw() {}
+
+monitorClient::SocketTracker::SocketTracker() 
+    : headersParsed(false), WError(0), RError(0), phase(PHASE_HEADER), events(0),
+      readPending(false), isCgiRequest(false), cgiOutputFd(-1), cgiHandler(NULL) {
+    error = "";
+}
+
+monitorClient::SocketTracker::~SocketTracker() {
+    if (cgiHandler) {
+        delete cgiHandler;
+        cgiHandler = NULL;
+    }
+}
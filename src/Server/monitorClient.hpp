@@ -1,12 +1,19 @@
 #pragma once
 
 #include <vector>
-#include <map>
 #include <poll.h>
 #include <time.h>
 #include "../HTTP/Common.hpp"
 #include "../HTTP/Request.hpp"
 #include "../Config/ConfigParser.hpp"
+#include "../Log/Logger.hpp"
+#include "EventBackend.hpp"
+#include "TimerWheel.hpp"
+#include "OutputQueue.hpp"
+#include "InputBuffer.hpp"
+#include "FileCache.hpp"
+#include "OpenFileCache.hpp"
+#include <map>
 
 // Forward declaration
 class CGIHandler;
@@ -15,12 +22,24 @@ class sock;
 /**
  * @brief Client connection monitor and event handler class
  * 
- * This class manages multiple client connections using poll() system call,
- * handles client timeouts, request reading, and response writing.
- * It supports non-blocking I/O operations and efficient connection management.
+ * This class manages multiple client connections through an EventBackend
+ * (epoll or poll()), handles client timeouts, request reading, and response
+ * writing. Only descriptors reported ready are touched on each wakeup.
  */
 class monitorClient {
 public:
+    /**
+     * @brief Stage of a connection; each stage has its own deadline
+     */
+    enum Phase {
+        PHASE_HEADER,       // Waiting for the request head
+        PHASE_BODY,         // Receiving the request body
+        PHASE_KEEPALIVE,    // Idle between two requests
+        PHASE_SEND,         // Writing the response
+        PHASE_CGI,          // Waiting for a CGI script
+        PHASE_COUNT
+    };
+
     /**
      * @brief Tracks individual socket connection state and data
      * 
@@ -29,13 +48,15 @@ public:
      */
     struct SocketTracker {
         Request request_obj;      // Parsed HTTP request object
-        std::string response;     // Generated HTTP response
-        std::string raw_buffer;   // Raw incoming data buffer
+        OutputQueue output;       // Response bytes waiting for the socket
+        InputBuffer input;        // Received bytes not consumed yet
         bool headersParsed;       // Whether current request headers are parsed
-        size_t consumedBytes;     // Bytes consumed for the current parsed request
         int WError;              // Write error status
         int RError;              // Read error status  
-        time_t lastActive;       // Last activity timestamp
+        Phase phase;             // Current stage, selects the timeout
+        TimerWheel::Timer timer; // Deadline of the current stage
+        short events;            // Interest mask currently registered with the backend
+        bool readPending;        // Reading stopped before EAGAIN; the socket holds more
         std::string error;       // Error message if any
 
         // CGI-specific fields
@@ -44,7 +65,7 @@ public:
         CGIHandler* cgiHandler;  // Pointer to CGI handler (owned by tracker)
         
         /**
-         * @brief Default constructor - initializes tracker with current time
+         * @brief Default constructor - starts in PHASE_HEADER, timer disarmed
          */
         SocketTracker();
 
@@ -52,62 +73,142 @@ public:
          * @brief Destructor - cleans up CGI handler if present
          */
         ~SocketTracker();
+    };
 
-        /**
-         * @brief Updates the last activity timestamp to current time
-         * Used to prevent timeout for active connections
-         */
-        void updateActivity();
-
-        /**
-         * @brief Checks if connection has exceeded timeout threshold
-         * @param currentTime Current system time
-         * @param timeoutSeconds Timeout threshold in seconds
-         * @return true if connection has timed out
-         */
-        bool hasTimedOut(time_t currentTime, time_t timeoutSeconds) const;
+    /**
+     * @brief What a descriptor slot currently holds
+     */
+    enum FdKind {
+        FD_FREE,        // Not owned by this loop
+        FD_LISTENER,    // Listening socket
+        FD_CLIENT,      // Client connection
+        FD_CGI_PIPE,    // CGI output pipe of a client
+        FD_NOTIFY       // inotify descriptor of the file cache
     };
 
-    // Iterator type definitions for container access
-    typedef std::vector<pollfd>::iterator PollFdsIt;
-    typedef std::map<int, SocketTracker>::iterator TrackerIt;
-    typedef std::vector<pollfd>::const_iterator CPollFdsIt;
-    typedef std::map<int, SocketTracker>::const_iterator CTrackerIt;
+    /**
+     * @brief Slab entry, indexed directly by file descriptor
+     *
+     * Clients and their CGI pipes both point at the client's tracker, so any
+     * ready descriptor resolves to its connection with one array access.
+     */
+    struct FdSlot {
+        FdKind kind;                // Slot content
+        int owner;                  // Client fd (for clients: itself; for CGI pipes: the client)
+        size_t index;               // Position in clientFDs (clients only)
+        int port;                   // Local port (listeners only)
+        SocketTracker* tracker;     // Owning connection (clients and CGI pipes)
+    };
 
 private:
-    ConfigParser ServerConfig;                  // add a object copy  of the parsed config file 
-    std::vector<pollfd> fds;                    // Poll file descriptors array
-    size_t numberOfServers;                     // Number of server sockets
-    std::map<int, SocketTracker> fdsTracker;    // Connection tracking map
-
-
-    // Timeout and chunk size constants
-    static const time_t CLIENT_TIMEOUT = 15;           // Client timeout (15 seconds, reduced from 60)
-    static const time_t TIMEOUT_CHECK_INTERVAL = 10;   // Timeout check interval
-    static const size_t CHUNK_SIZE = 8192;             // Read chunk size (8KB)
-    time_t lastTimeoutCheck;                           // Last timeout check time
+    ConfigSnapshot config;                      // Shared parsed configuration (read-only)
+    EventBackend* backend;                      // Readiness backend (epoll or poll)
+    bool edgeTriggered;                         // Register client sockets edge-triggered
+    std::vector<int> listenFDs;                 // Server socket file descriptors
+    std::vector<FdSlot> fdSlots;                // Descriptor slab, indexed by fd
+    std::vector<int> clientFDs;                 // Dense list of live clients (swap-remove)
+    TimerWheel timers;                          // Per-connection deadlines
+    BlockPool inputPool;                        // Read blocks shared by this loop's clients
+    FileCache fileCache;                        // Static files served by this loop
+    std::map<const Config::ServerConfig*, OpenFileCache*> openFiles; // Per server, made on first use
+    unsigned long long loopNow;                 // Loop clock (ms), refreshed once per wakeup
+    unsigned long long phaseTimeout[PHASE_COUNT]; // Deadline length of each phase (ms)
+
+    static const size_t ACCEPT_BATCH = 64;             // Max accepts per listener wakeup
+    static const size_t OUTPUT_HIGH_WATERMARK = 1 << 20; // Queued response bytes that pause reading
+    static const size_t INPUT_PARSE_BATCH = 256 * 1024;  // Buffered input parsed before reading on
+    static const size_t INPUT_READ_BUDGET = 1 << 20;     // Max bytes read per client wakeup
 
     /**
-     * @brief Accepts new client connection from server socket
+     * @brief Accepts pending connections from a server socket
      * @param serverFD Server socket file descriptor
-     * Sets up non-blocking client socket and adds to monitoring list
+     * Accepts until EAGAIN or ACCEPT_BATCH connections (the listener is
+     * level-triggered, so the rest is reported on the next wait) and tries
+     * to read each new client's request right away
      */
     void acceptNewClient(int serverFD);
 
+    /**
+     * @brief Starts tracking an accepted connection
+     * @param clientFd Non-blocking, close-on-exec client socket
+     * @param addr Peer address returned by accept4()
+     * @param serverFD Listener that accepted it (for logging)
+     * @return true if the client is now watched; false if it was closed
+     */
+    bool addClient(int clientFd, const sockaddr_in& addr, int serverFD);
+
     /**
      * @brief Removes client connection and cleans up resources
-     * @param index Index of client in fds vector
-     * Closes socket, removes from vectors and maps
+     * @param clientFd Client socket file descriptor
+     * Unregisters the socket (and any CGI pipe) from the backend, closes it
+     * and drops its tracker
      */
-    void removeClient(int index);
+    void removeClient(int clientFd);
 
     /**
-     * @brief Reads data chunk from client socket
+     * @brief Gets the slab entry kind of a descriptor
+     * @param fd File descriptor to look up
+     * @return FD_FREE for descriptors this loop does not own
+     */
+    FdKind kindOf(int fd) const;
+
+    /**
+     * @brief Gets the tracker of a client socket or CGI pipe
+     * @param fd Client or CGI pipe file descriptor
+     * @return Owning tracker, or NULL if fd is not a client/CGI pipe
+     */
+    SocketTracker* trackerOf(int fd) const;
+
+    /**
+     * @brief Records a descriptor in the slab
+     * @param fd File descriptor
+     * @param kind Slot kind
+     * @param owner Owning client fd (CGI pipes) or fd itself
+     * @param tracker Owning tracker (clients and CGI pipes), NULL otherwise
+     * Clients are also appended to clientFDs
+     */
+    void claimFd(int fd, FdKind kind, int owner, SocketTracker* tracker);
+
+    /**
+     * @brief Frees a slab entry; clients are swap-removed from clientFDs
+     * @param fd File descriptor to release
+     */
+    void releaseFd(int fd);
+
+    /**
+     * @brief Updates the interest mask of a client socket
+     * @param clientFd Client socket file descriptor
+     * @param tracker Tracker of that client
+     * @param events New POLLIN/POLLOUT mask
+     * Skips the backend call when the mask is unchanged
+     */
+    void setClientEvents(int clientFd, SocketTracker& tracker, short events);
+
+    /**
+     * @brief Dispatches one ready descriptor to the matching handler
+     * @param fd Ready file descriptor
+     * @param revents Events reported by the backend
+     */
+    void handleEvent(int fd, short revents);
+
+    /**
+     * @brief Handles readiness on a CGI output pipe
+     * @param cgiFd CGI pipe file descriptor
+     * @param revents Events reported by the backend
+     */
+    void handleCgiEvent(int cgiFd, short revents);
+
+    /**
+     * @brief Handles a readable client socket: reads, parses, builds a response
      * @param clientFd Client socket file descriptor
-     * @param buffer Reference to buffer to store read data
-     * @return Number of bytes read, 0 for EOF, negative for error/no-data
      */
-    int readChunkFromClient(int clientFd, std::string& buffer);
+    void handleClientReadable(int clientFd);
+
+    /**
+     * @brief Handles a writable client socket: flushes the pending response
+     * @param clientFd Client socket file descriptor
+     */
+    void handleClientWritable(int clientFd);
 
     /**
      * @brief Reads and processes HTTP request from client
@@ -118,27 +219,42 @@ private:
     int readClientRequest(int clientFd);
 
     /**
-     * @brief Checks if HTTP request is complete
-     * @param tracker Reference to socket tracker
-     * @return true if request parsing is complete
+     * @brief Runs the request parser over the bytes already received
+     * @param tracker Tracker of the client
+     * @param peerClosed The peer sent EOF, so an unfinished request is final
+     * @return 1 for continue, 0 for close connection (tracker.error set on a parse error)
      */
-    bool isRequestComplete(SocketTracker& tracker);
+    int parseClientInput(SocketTracker& tracker, bool peerClosed);
 
     /**
-     * @brief Checks request completion after finding headers end
-     * @param tracker Reference to socket tracker
-     * @param headerEnd Position where headers end
-     * @return true if full request is available
+     * @brief Answers every complete request in the input, in order
+     * @param clientFd Client socket file descriptor
+     * @param tracker Tracker of the client
+     * Pipelined requests are parsed from the buffered bytes one after the
+     * other and their responses queued back to back, so they leave together
+     * in one sendmsg(). Stops at a CGI request (finishCgi() resumes), a
+     * response that closes the connection, a request still arriving, or
+     * when the queue passes OUTPUT_HIGH_WATERMARK.
      */
-    bool checkRequestCompletion(SocketTracker& tracker, size_t headerEnd);
+    void serveRequests(int clientFd, SocketTracker& tracker);
 
     /**
-     * @brief Checks if the request body is completely received
-     * @param tracker Reference to socket tracker containing request data
-     * @param headerEnd Position where headers end in the raw buffer
-     * @return true if body is complete, false if more data needed
+     * @brief Ends the current request once its response is queued
+     * @param tracker Tracker of the client
+     * Decides keep-alive from the request's Connection header; a kept
+     * connection gets a fresh parser, a closing one drops what follows.
      */
-    bool isRequestBodyComplete(SocketTracker& tracker, size_t headerEnd);
+    void finishRequest(SocketTracker& tracker);
+
+    /**
+     * @brief Sets a client's interest mask and phase from its state
+     * @param clientFd Client socket file descriptor
+     * @param tracker Tracker of the client
+     * POLLIN stays on while more requests may be read (not during a CGI,
+     * after a closing response, or above the watermark); POLLOUT while
+     * anything is queued.
+     */
+    void armClient(int clientFd, SocketTracker& tracker);
 
     /**
      * @brief Writes HTTP response to client socket
@@ -148,36 +264,38 @@ private:
     int writeClientResponse(int clientFd);
 
     /**
-     * @brief Checks all connections for timeout and handles timeouts
-     * Generates timeout responses for clients that exceed time limit
+     * @brief Reads the monotonic clock
+     * @return Milliseconds since an arbitrary fixed point
      */
-    void checkTimeouts();
+    static unsigned long long monotonicMs();
 
     /**
-     * @brief Removes connections that have timed out
-     * Called after timeout detection to clean up dead connections
+     * @brief Moves a connection into a phase and (re)arms its deadline
+     * @param tracker Tracker of the client
+     * @param phase New phase; its configured timeout starts at the loop clock
      */
-    void removeTimedOutClients();
+    void setPhase(SocketTracker& tracker, Phase phase);
 
     /**
-     * @brief Determines if enough time has passed to check timeouts
-     * @param now Current system time
-     * @return true if timeout check should be performed
+     * @brief Advances the timer wheel to the loop clock and handles expiries
      */
-    bool shouldCheckTimeouts(time_t now);
+    void expireTimers();
 
     /**
-     * @brief Initializes timeout tracking system
-     * Sets up initial timeout check timestamp
+     * @brief Applies the timeout policy of the phase a connection is in
+     * @param clientFd Client whose deadline passed
+     * Partial requests get a 408, a running CGI is killed with a 504,
+     * idle keep-alive and stalled sends are closed
      */
-    void initializeTimeouts();
+    void handleTimeout(int clientFd);
 
     /**
-     * @brief Updates activity timestamp for specific client
+     * @brief Turns a finished (or failed) CGI into the client's response
      * @param clientFd Client socket file descriptor
-     * Prevents timeout for active connections
+     * @param tracker Tracker owning the CGI
+     * @param cgiStatus 0 = completed, -1 = failed or timed out
      */
-    void updateClientActivity(int clientFd);
+    void finishCgi(int clientFd, SocketTracker& tracker, int cgiStatus);
 
     /**
      * @brief Generates an error response for the client
@@ -193,6 +311,13 @@ private:
      */
     void generateSuccessResponse(SocketTracker& tracker);
 
+    /**
+     * @brief Gets this loop's open-file cache for a server
+     * @param server Matched server of a request
+     * @return The cache, or NULL if the server has open_file_cache off
+     */
+    OpenFileCache* openFilesFor(const Config::ServerConfig* server);
+
     /**
      * @brief Generates a simple fallback response
      * @param tracker Reference to socket tracker containing request information
@@ -268,12 +393,12 @@ public:
      * @param serverSockets Copy of the socket class that holds the file descriptors and parsed configuration data
      * Sets up poll structures for all server sockets
      */
-    monitorClient(sock serverSockets); //make the constructor accept a sock  class 
+    monitorClient(const sock& serverSockets);
 
     /**
      * @brief Main event loop - monitors all connections and handles events
      * Runs indefinitely, handling new connections, client requests,
-     * responses, and timeouts using poll() system call
+     * responses, and timeouts using the configured EventBackend
      */
     void startEventLoop();
 
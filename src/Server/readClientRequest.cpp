@@ -8,62 +8,20 @@
 #include <sys/socket.h>
 #include <ctime>
 #include <sys/stat.h>
+#include <cerrno>
 
 // Response handlers
 #include "../methods/ResponseGet.hpp"
 #include "../methods/ResponsePost.hpp"
 #include "../methods/ResponseDelete.hpp"
 
-#define MAX_HEADER_SIZE 8192
-
-static size_t findHeadersEnd(const std::string &buf) {
-    return buf.find("\r\n\r\n");
-}
-
-// (replaced by checkChunkedCompleteAndSize)
-
-// Return: 1 = complete, 0 = incomplete, -1 = malformed/too large
-static int checkChunkedCompleteAndSize(const std::string &body, size_t maxAllowedSize) {
-    // Quick size check: if body already exceeds maxAllowedSize -> error
-    if (maxAllowedSize > 0 && body.size() > maxAllowedSize) return -1;
-
-    // Look for the final 0-length chunk sequence "\r\n0\r\n\r\n"
-    if (body.find("\r\n0\r\n\r\n") != std::string::npos) return 1;
-
-    // Also accept if body ends exactly with "0\r\n\r\n"
-    if (body.size() >= 5) {
-        const std::string tail = body.substr(body.size() - 5);
-        if (tail == "0\r\n\r\n") return 1;
-    }
-
-    // Not complete yet
-    return 0;
-}
-
-int monitorClient::readChunkFromClient(int clientFd, std::string& buffer) {
-    char chunk[CHUNK_SIZE];
-    ssize_t bytesRead = read(clientFd, chunk, CHUNK_SIZE);
-
-    if (bytesRead > 0) {
-        buffer.append(chunk, bytesRead);
-        return bytesRead;
-    } else if (bytesRead == 0) {
-        return 0;
-    } else if (bytesRead == -1) {
-        return -1;
-    } else {
-        return -2;
-    }
-}
-
 int monitorClient::readClientRequest(int clientFd) {
-    TrackerIt it = fdsTracker.find(clientFd);
-    if (it == fdsTracker.end()) {
-        std::cerr << "Client " << clientFd << " not found in tracker" << std::endl;
+    if (kindOf(clientFd) != FD_CLIENT) {
+        LOG_WARN("Client " << clientFd << " not found in tracker");
         return -1;
     }
 
-    SocketTracker& tracker = it->second;
+    SocketTracker& tracker = *fdSlots[clientFd].tracker;
 
     // If this request is already complete (e.g., waiting for CGI), do not re-parse
     if (tracker.request_obj.isComplete()) {
@@ -73,126 +31,87 @@ int monitorClient::readClientRequest(int clientFd) {
     if (tracker.request_obj.getClientFD() != clientFd) {
         tracker.request_obj.setClientFD(clientFd);
     }
-    // 1) Drain reads until no more data available
-    std::string chunk;
+    // 1) Drain reads until no more data available, straight into pool blocks;
+    // a complete request with a batch queued behind it, or a spent budget,
+    // ends the wakeup early and armClient asks for the rest later
+    bool peerClosed = false;
+    size_t readThisWakeup = 0;
     while (true) {
-        int rr = readChunkFromClient(clientFd, chunk);
+        if (readThisWakeup >= INPUT_READ_BUDGET
+            || (tracker.request_obj.isComplete() && tracker.input.size() >= INPUT_PARSE_BATCH)) {
+            tracker.readPending = true;
+            break;
+        }
+        ssize_t rr = tracker.input.readFrom(clientFd);
         if (rr > 0) {
-            tracker.raw_buffer.append(chunk);
-            chunk.clear();
+            readThisWakeup += static_cast<size_t>(rr);
+            // A fast sender keeps the socket readable; hand the body on as it
+            // comes so a streamed upload does not pile up in memory first
+            if (tracker.input.size() >= INPUT_PARSE_BATCH && !tracker.request_obj.isComplete()
+                && parseClientInput(tracker, false) == 0)
+                return 0;
             continue;
-        } else if (rr == 0) {
+        }
+        if (rr == 0) {
+            tracker.readPending = false;
             // peer closed; if no pending data, close, else process what we have
-            if (tracker.raw_buffer.empty()) return 0;
+            if (tracker.input.empty()) return 0;
+            peerClosed = true;
             break;
-        } else if (rr == -1) {
-            // No more data available
-            break;
-        } else {
-            // fatal read error
-            std::cerr << "Error reading from client " << clientFd << std::endl;
-            return -1;
-        }
-    }
-
-    // 2) Enforce header-size cap pre-CRLFCRLF
-    size_t hdrEnd = findHeadersEnd(tracker.raw_buffer);
-    if (hdrEnd == std::string::npos) {
-        if (tracker.raw_buffer.size() > MAX_HEADER_SIZE) {
-            tracker.error = "431 Request Header Fields Too Large";
-            tracker.request_obj.setComplete(false);
-            return 0; // signal close
         }
-        return 1; // need more data
-    }
-
-    // 3) Parse headers once
-    if (!tracker.headersParsed) {
-        // ensure Request is clean for this message only
-        tracker.request_obj.reset();
-        tracker.request_obj.setClientFD(clientFd);
-        // set full server config for matching
-        Config globalConfig = ServerConfig.getConfigs();
-        tracker.request_obj.setServerConfig(globalConfig);
-        std::string headersSection = tracker.raw_buffer.substr(0, hdrEnd);
-        if (!tracker.request_obj.parseHeadersSection(headersSection)) {
-            tracker.error = tracker.request_obj.getErrorCode();
-            tracker.request_obj.setComplete(false);
-            return 0;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            tracker.readPending = false;
+            break; // No more data available
         }
-        // Match and store the server configuration now that Host/Port are known
-        tracker.request_obj.matchServerConfiguration();
-        tracker.headersParsed = true;
-        tracker.consumedBytes = hdrEnd + 4; // include CRLFCRLF
+        // fatal read error
+        LOG_ERROR("Error reading from client " << clientFd << ": " << strerror(errno));
+        return -1;
     }
 
+    // 2) Parse what arrived; bytes of a following request stay queued
+    return parseClientInput(tracker, peerClosed);
+}
 
-
-    // 4) Determine body completeness and enforce per-server max body size
-    const bool isChunked = tracker.request_obj.hasChunkedEncoding();
-    if (isChunked)
-        tracker.request_obj.setChunked(true);
-    size_t bodyAvail = (tracker.raw_buffer.size() > tracker.consumedBytes)
-        ? (tracker.raw_buffer.size() - tracker.consumedBytes) : 0;
-    size_t need = 0;
-
-    // Determine server max body size (fallback to 0 = unlimited)
-    size_t maxBody = 0;
-    if (tracker.request_obj.hasServerConfig()) {
-        maxBody = tracker.request_obj.getCurrentServer()->client_max_body_size;
-    }
-
-    if (isChunked) {
-        std::string bodyView = tracker.raw_buffer.substr(tracker.consumedBytes);
-        int chk = checkChunkedCompleteAndSize(bodyView, maxBody);
-        if (chk == -1) {
-            tracker.error = "413 Request Entity Too Large";
-            tracker.request_obj.setErrorCode("413 Request Entity Too Large");
-            tracker.request_obj.setComplete(false);
-            return 0; // signal error
-        } else if (chk == 0) {
-            tracker.request_obj.setComplete(false);
-            return 1; // need more data
+int monitorClient::parseClientInput(SocketTracker& tracker, bool peerClosed) {
+    // Hand each contiguous run of the input to the parser, which keeps its
+    // place between reads; parsed bytes are released right away and bytes
+    // of a following request stay queued
+    Request& request = tracker.request_obj;
+    while (true) {
+        size_t len = 0;
+        const char* data = tracker.input.empty() ? NULL : tracker.input.span(0, len);
+        size_t used = 0;
+        Request::ParseStatus status = request.feed(data, len, used);
+        tracker.input.consume(used);
+
+        if (status == Request::PARSE_AGAIN) {
+            if (!tracker.input.empty())
+                continue; // the run ended at a block boundary
+            return peerClosed ? 0 : 1;
         }
-        // else chk == 1 -> complete
-    } else {
-        need = tracker.request_obj.expectedContentLength();
-        if (need > 0) {
-            if (maxBody > 0 && need > maxBody) {
-                tracker.error = "413 Request Entity Too Large";
-                tracker.request_obj.setErrorCode("413 Request Entity Too Large");
-                tracker.request_obj.setComplete(false);
-                return 0; // error
-            }
-            if (bodyAvail < need) {
-                tracker.request_obj.setComplete(false);
-                return 1; // wait for more
-            }
+        if (status == Request::PARSE_ERROR) {
+            tracker.error = request.getErrorCode();
+            return 0;
         }
-    }
-
+        if (status == Request::PARSE_DONE)
+            break;
 
-    // 5) We have a complete request; parse body with exactly the slice
-    std::string bodySlice;
-    if (isChunked) {
-        bodySlice = tracker.raw_buffer.substr(tracker.consumedBytes);
-    } else {
-        bodySlice = tracker.raw_buffer.substr(tracker.consumedBytes, need);
-    }
-    if (!tracker.request_obj.parseBodySection(bodySlice)) {
-        tracker.error = tracker.request_obj.getErrorCode();
-        tracker.request_obj.setComplete(false);
-        return 0;
+        // PARSE_HEADERS_DONE: the Host name is known, so the server (and its
+        // body size limit) and the route can be chosen before any body byte
+        // is accepted
+        request.setServerConfig(config.get());
+        request.matchServerConfiguration(config.vhosts());
+        request.resolveRoute();
+        const Config::ServerConfig* server = request.getCurrentServer();
+        request.setBodyLimit(server ? server->client_max_body_size : 0);
+        tracker.headersParsed = true;
     }
-    tracker.request_obj.setComplete(true);
 
-     // Log that the request was fully parsed (include HTTP method)
-     time_t tnow = time(NULL);
-     std::ostringstream ss;
-     ss << "[INFO] " << "Parsed request from client_fd=" << clientFd
-         << " method=" << tracker.request_obj.getMethod()
-         << " at " << std::ctime(&tnow);
-     std::cout << ss.str();
+    LOG_INFO("Parsed request from client_fd=" << request.getClientFD()
+             << " method=" << request.getMethod()
+             << " path=" << request.getPath());
     return 1;
 }
 
@@ -220,8 +139,10 @@ void monitorClient::generateErrorResponse(SocketTracker& tracker) {
     resp << "Content-Length: " << body.str().size() << "\r\n\r\n";
     resp << body.str();
 
-    tracker.response = resp.str();
-    tracker.WError = 0;
+    std::string out = resp.str();
+    tracker.output.pushMemory(out);
+    // The response says Connection: close; nothing after it is answered
+    tracker.WError = 1;
 }
 
 void monitorClient::generateSuccessResponse(SocketTracker& tracker) {
@@ -232,18 +153,19 @@ void monitorClient::generateSuccessResponse(SocketTracker& tracker) {
     Request &req = tracker.request_obj;
     const std::string &method = req.getMethod();
     try {
-        std::cout << "[INFO] Generating response for method: " << method << std::endl;
-        if (method == "GET"){
-            ResponseGet handler(req);
-            tracker.response = handler.generate();
+        LOG_DEBUG("Generating response for method: " << method);
+        // HEAD takes the GET path; the handler leaves the body out
+        if (method == "GET" || method == "HEAD"){
+            ResponseGet handler(req, &fileCache, openFilesFor(req.serverConfig));
+            handler.generate(tracker.output);
         } else if (method == "POST"){
-            ResponsePost handler(req);
-            tracker.response = handler.generate();
+            ResponsePost handler(req, &fileCache, openFilesFor(req.serverConfig));
+            handler.generate(tracker.output);
         } else if (method == "DELETE"){
-            ResponseDelete handler(req);
-            tracker.response = handler.generate();
+            ResponseDelete handler(req, &fileCache, openFilesFor(req.serverConfig));
+            handler.generate(tracker.output);
         } else {
-            std::cerr << "[ERROR] Unsupported HTTP method: " << method << std::endl;
+            LOG_WARN("Unsupported HTTP method: " << method);
             std::ostringstream b;
             b << "<html><body><h1>501 Not Implemented</h1><p>Method " << method << " not implemented.</p></body></html>";
             std::ostringstream resp;
@@ -251,7 +173,8 @@ void monitorClient::generateSuccessResponse(SocketTracker& tracker) {
             resp << "Content-Type: text/html; charset=utf-8\r\n";
             resp << "Content-Length: " << b.str().size() << "\r\n\r\n";
             resp << b.str();
-            tracker.response = resp.str();
+            std::string out = resp.str();
+            tracker.output.pushMemory(out);
         }
     } catch (...) {
         tracker.error = "500 Internal Server Error";
@@ -259,71 +182,40 @@ void monitorClient::generateSuccessResponse(SocketTracker& tracker) {
     }
 }
 
-bool monitorClient::shouldHandleAsCGI(SocketTracker& tracker, std::string& scriptPath, std::string& interpreterPath) {
-    Request &req = tracker.request_obj;
-    const std::string &path = req.getPath();
-
-    // Find matching route
-    const Config::RouteConfig *matched = NULL;
-    const std::vector<Config::RouteConfig> &routes = req.serverConfig.routes;
-    size_t best_len = 0;
-    for (std::vector<Config::RouteConfig>::const_iterator it = routes.begin(); it != routes.end(); ++it){
-        const std::string &rpath = it->path;
-        if (rpath.empty()) continue;
-        if (path.compare(0, rpath.size(), rpath) == 0){
-            if (rpath.size() > best_len){
-                best_len = rpath.size();
-                matched = &(*it);
-            }
-        }
-    }
-
-    if (!matched || !matched->cgi_enabled) return false;
-
-    // Build filesystem path
-    std::string root = req.serverConfig.root;
-    if (matched && !matched->root.empty()) root = matched->root;
-
-    std::string suffix;
-    if (matched && !matched->path.empty() && path.compare(0, matched->path.size(), matched->path) == 0)
-        suffix = path.substr(matched->path.size());
-    else
-        suffix = path;
-
-    std::string fsPath = root;
-    if (!fsPath.empty() && fsPath[fsPath.size() - 1] == '/') fsPath.erase(fsPath.size() - 1);
-    if (!suffix.empty() && suffix[0] != '/') fsPath += "/" + suffix; else fsPath += suffix;
-
-    // Extension check
-    size_t dot = fsPath.find_last_of('.');
-    if (dot == std::string::npos) return false;
-    std::string ext = fsPath.substr(dot);
+OpenFileCache* monitorClient::openFilesFor(const Config::ServerConfig* server) {
+    if (!server || server->open_file_cache == 0)
+        return NULL;
+    std::map<const Config::ServerConfig*, OpenFileCache*>::iterator it = openFiles.find(server);
+    if (it != openFiles.end())
+        return it->second;
+    OpenFileCache* cache = new OpenFileCache(server->open_file_cache);
+    openFiles[server] = cache;
+    return cache;
+}
 
-    bool isCgi = false;
-    for (std::vector<std::string>::const_iterator eit = matched->cgi_extensions.begin(); eit != matched->cgi_extensions.end(); ++eit) {
-        if (ext == *eit) { isCgi = true; break; }
-    }
-    if (!isCgi) return false;
+bool monitorClient::shouldHandleAsCGI(SocketTracker& tracker, std::string& scriptPath, std::string& interpreterPath) {
+    const RouteContext &ctx = tracker.request_obj.route;
+    if (!ctx.isCgi) return false;
 
-    scriptPath = fsPath;
-    interpreterPath = matched->cgi_pass;
+    scriptPath = ctx.fsPath;
+    interpreterPath = ctx.route->cgi_pass;
     return true;
 }
 
 void monitorClient::startAsyncCGI(SocketTracker& tracker, int clientFd, const std::string& scriptPath, const std::string& interpreterPath) {
-    std::cout << "[CGI] Starting async CGI for client " << clientFd << std::endl;
+    LOG_DEBUG("Starting async CGI for client " << clientFd);
     // Preflight: if script file does not exist, return 404 right away
     struct stat st;
     if (stat(scriptPath.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
-        std::cerr << "[CGI] Script not found: " << scriptPath << std::endl;
+        LOG_WARN("CGI script not found: " << scriptPath);
         tracker.error = "404 [CGI] Not Found";
         tracker.isCgiRequest = false;
         generateErrorResponse(tracker);
         return;
     }
-    tracker.cgiHandler = new CGIHandler(tracker.request_obj, tracker.request_obj.serverConfig);
+    tracker.cgiHandler = new CGIHandler(tracker.request_obj, *tracker.request_obj.serverConfig);
     if (!tracker.cgiHandler->startCGI(scriptPath, interpreterPath)) {
-        std::cerr << "[CGI] Failed to start CGI process" << std::endl;
+        LOG_ERROR("Failed to start CGI process");
         delete tracker.cgiHandler;
         tracker.cgiHandler = NULL;
         tracker.isCgiRequest = false;
@@ -334,92 +226,36 @@ void monitorClient::startAsyncCGI(SocketTracker& tracker, int clientFd, const st
 
     tracker.cgiOutputFd = tracker.cgiHandler->getCGIOutputFd();
 
-    // Add CGI output fd to poll
-    pollfd cgiPollFd;
-    memset(&cgiPollFd, 0, sizeof(cgiPollFd));
-    cgiPollFd.fd = tracker.cgiOutputFd;
-    // Watch for POLLHUP to catch short-lived scripts that close immediately
-    // Also watch POLLERR to finalize on errors
-    cgiPollFd.events = POLLIN | POLLERR;
-    cgiPollFd.revents = 0;
-    fds.push_back(cgiPollFd);
-}
-
-bool monitorClient::isRequestBodyComplete(SocketTracker& tracker, size_t headerEnd) {
-    // Calculate body start position (after "\r\n\r\n")
-    size_t bodyStart = headerEnd + 4;
-    size_t bodyReceived = 0;
-    
-    if (bodyStart < tracker.raw_buffer.size()) {
-        bodyReceived = tracker.raw_buffer.size() - bodyStart;
-    }
-    
-    // Check Content-Length header
-    const std::string& contentLengthHeader = tracker.request_obj.getHeader("content-length");
-    if (contentLengthHeader != "content-length") { // getHeader returns key if not found
-        char *endptr = NULL;
-        unsigned long expectedLength = strtoul(contentLengthHeader.c_str(), &endptr, 10);
-        if (endptr == contentLengthHeader.c_str()) {
-            // Invalid Content-Length, assume no body expected
-            return true;
-        }
-        return bodyReceived >= expectedLength;
-    }
-    
-    // Check for chunked transfer encoding
-    const std::string& transferEncoding = tracker.request_obj.getHeader("transfer-encoding");
-    if (transferEncoding != "transfer-encoding" && 
-        transferEncoding.find("chunked") != std::string::npos) {
-        // For chunked encoding, look for the final chunk (0\r\n\r\n)
-        std::string bodyData = tracker.raw_buffer.substr(bodyStart);
-        return bodyData.find("0\r\n\r\n") != std::string::npos;
-    }
-    
-    // For GET/DELETE requests or requests without body indicators, consider complete
-    const std::string& method = tracker.request_obj.getMethod();
-    if (method == "GET" || method == "DELETE") {
-        return true;
+    // Watch the CGI output pipe; POLLHUP/POLLERR are always reported and
+    // catch short-lived scripts that close immediately
+    if (backend->add(tracker.cgiOutputFd, POLLIN, false) == -1) {
+        LOG_ERROR("Failed to watch CGI output pipe");
+        delete tracker.cgiHandler;
+        tracker.cgiHandler = NULL;
+        tracker.cgiOutputFd = -1;
+        tracker.isCgiRequest = false;
+        tracker.error = "500 Internal Server Error";
+        generateErrorResponse(tracker);
+        return;
     }
-    
-    // For POST without Content-Length or Transfer-Encoding, assume no body
-    return true;
+    claimFd(tracker.cgiOutputFd, FD_CGI_PIPE, clientFd, &tracker);
 }
 
 int monitorClient::writeClientResponse(int clientFd) {
-    TrackerIt it = fdsTracker.find(clientFd);
-    if (it == fdsTracker.end()) return -1;
-    SocketTracker& tracker = it->second;
-
-    if (tracker.response.empty()) return 0; // nothing to send
-
-    // Attempt to write as much as possible (non-blocking)
-    ssize_t w = write(clientFd, tracker.response.c_str(), tracker.response.size());
-    if (w > 0) {
-        tracker.response.erase(0, static_cast<size_t>(w));
-        // If there's still data remaining, ask caller to keep POLLOUT enabled
-        if (!tracker.response.empty()) return 1; // partial remain
-        // else fall-through: all data sent
-    } else if (w == -1) {
-        // Use fcntl to check if socket is non-blocking and would block
-        int flags = fcntl(clientFd, F_GETFL, 0);
-        if (flags != -1 && (flags & O_NONBLOCK)) {
-            // Assume would block if non-blocking
-            return 1; // still pending
-        }
-        // fatal write error
+    if (kindOf(clientFd) != FD_CLIENT) return -1;
+    SocketTracker& tracker = *fdSlots[clientFd].tracker;
+
+    // Flushes until the queue is empty or the socket is full; edge-triggered
+    // sockets only report POLLOUT again after a write hit the full buffer
+    OutputQueue::FlushResult fr = tracker.output.flush(clientFd);
+    if (fr == OutputQueue::FLUSH_AGAIN)
+        return 1; // still pending
+    if (fr == OutputQueue::FLUSH_ERROR) {
         tracker.WError = 1;
         return -1;
     }
 
-    // If we reach here, the full response was sent (tracker.response empty)
-    // Check Connection header: HTTP/1.1 defaults to keep-alive unless "close"
-    const std::string& connHdr = tracker.request_obj.getHeader("connection");
-    std::string connVal = connHdr;
-    for (size_t k = 0; k < connVal.size(); ++k) connVal[k] = std::tolower(connVal[k]);
-    if (connVal == "close") {
-        tracker.WError = 1; // signal caller to remove client
-        return 0; // complete, but marked for close
-    }
-
-    return 0; // complete, keep-alive
+    // Everything queued was sent; whether the connection stays open was
+    // decided when the last response was built (WError)
+    return 0;
 }
@@ -0,0 +1,69 @@
+#include "monitorClient.hpp"
+#include "../CGI/CGIHandler.hpp"
+
+#include <sstream>
+#include <ctime>
+
+unsigned long long monitorClient::monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+void monitorClient::setPhase(SocketTracker& tracker, Phase phase) {
+    tracker.phase = phase;
+    timers.schedule(tracker.timer, loopNow + phaseTimeout[phase]);
+}
+
+void monitorClient::expireTimers() {
+    std::vector<int> expired;
+    timers.advance(loopNow, expired);
+    for (size_t i = 0; i < expired.size(); i++)
+        handleTimeout(expired[i]);
+}
+
+void monitorClient::handleTimeout(int clientFd) {
+    if (kindOf(clientFd) != FD_CLIENT)
+        return;
+    SocketTracker* tracker = fdSlots[clientFd].tracker;
+
+    static const char* phaseNames[PHASE_COUNT] = { "header", "body", "keep-alive", "send", "cgi" };
+    LOG_WARN("Client fd=" << clientFd << " timed out in " << phaseNames[tracker->phase] << " phase");
+
+    switch (tracker->phase) {
+    case PHASE_CGI:
+        if (tracker->cgiHandler) {
+            finishCgi(clientFd, *tracker, tracker->cgiHandler->abortOnTimeout());
+            return;
+        }
+        break;
+    case PHASE_HEADER:
+    case PHASE_BODY:
+        // A connection that never sent a byte is closed silently
+        if (tracker->phase == PHASE_BODY || tracker->request_obj.hasStarted()) {
+            // Incomplete request -> send 408
+            tracker->RError = 408;
+            tracker->WError = 1;
+            std::string timeoutHtml = "<html><body><h1>408 Request Timeout</h1>"
+                                     "<p>The server timed out waiting for the Request.</p></body></html>";
+            std::string head = "HTTP/1.1 408 Request Timeout\r\n";
+            head += "Connection: close\r\n";
+            head += "Content-Type: text/html\r\n";
+            {
+                std::ostringstream tmp;
+                tmp << timeoutHtml.length();
+                head += "Content-Length: " + tmp.str() + "\r\n\r\n";
+            }
+            tracker->output.pushMemory(head);
+            tracker->output.pushMemory(timeoutHtml);
+            setPhase(*tracker, PHASE_SEND);
+            setClientEvents(clientFd, *tracker, POLLOUT);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    // Idle keep-alive connection or stalled send -> close without a response
+    removeClient(clientFd);
+}
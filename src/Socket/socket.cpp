@@ -15,16 +15,23 @@ const char* sock::sockException::what() const throw() {
 
 sock::sockException::~sockException() throw() {}
 
-sock::sock(ConfigParser config_parser) : config_parser(config_parser) {
+sock::sock(const ConfigParser& config_parser, bool reusePort) : config(config_parser.getSnapshot()) {
     hosts = config_parser.getServerListenAddresses();
+    backlogs = config_parser.getServerListenBacklogs();
     int fd, op;
     for (size_t i = 0; i < hosts.size(); i++) {
         fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
         if (fd < 0)
             closeFDs("[ERROR]: fail to create socket ");
         op = 1;
-        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &op, sizeof(op)) < 0)
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &op, sizeof(op)) < 0) {
+            close(fd);
             closeFDs("[ERROR] setsockopt fail");
+        }
+        if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &op, sizeof(op)) < 0) {
+            close(fd);
+            closeFDs("[ERROR] setsockopt SO_REUSEPORT fail");
+        }
         sockFDs.push_back(fd);
     }
     std::cout << "Server: socket created successfully \n";
@@ -40,7 +47,9 @@ void sock::bindINET() {
             closeFDs("[ERROR] inet_pton fail");
         if (bind(sockFDs[i], (sockaddr *)&bindSocket, sizeof(bindSocket)) < 0)
             closeFDs("[ERROR] fail to bound the socket");
-        if (listen(sockFDs[i], 100) == -1)
+        // The kernel silently caps the backlog at net.core.somaxconn
+        int backlog = (i < backlogs.size()) ? backlogs[i] : 511;
+        if (listen(sockFDs[i], backlog) == -1)
             closeFDs("[ERROR] fail to listen in  the server");
         std::cout << "Server: Socket bound successfully and start listening on port " << hosts[i].second << std::endl;
     }
@@ -49,9 +58,9 @@ void sock::bindINET() {
 std::vector<int> sock::getFDs() const {
     return this->sockFDs;
 }
-ConfigParser sock::getConfig()
+ConfigSnapshot sock::getConfig() const
 {
-    return this->config_parser;
+    return this->config;
 }
 void sock::closeFDs(const char *msg) {
     for (size_t i = 0; i < this->sockFDs.size(); i++)
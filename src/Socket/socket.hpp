@@ -17,25 +17,33 @@ struct testSocketData;
  */
 class sock {
 private:
-    ConfigParser config_parser; // object of the parsed config file
+    ConfigSnapshot config;                              // Shared parsed configuration
     std::vector<int> sockFDs;                           // Server socket file descriptors
     std::vector<std::pair<std::string, int> > hosts;    // Host:port combinations
+    std::vector<int> backlogs;                          // listen() backlog of each host:port
 
 public:
        /**
      * @brief Constructor - creates sockets for specified host:port pairs
-     * @param config_parser Copy of the ConfigParser class that holds all the data needed to create the server sockets
+     * @param config_parser Parsed configuration (listen addresses and the shared snapshot)
+     * @param reusePort Also set SO_REUSEPORT so several listener sets (one per
+     *        worker thread) can bind the same host:port and share accepts
      * Creates non-blocking TCP sockets with SO_REUSEADDR option
      */
-    sock(ConfigParser config_parser); //change this constructor to accept a object insted of vector of hosts 
+    sock(const ConfigParser& config_parser, bool reusePort = false);
 
     /**
      * @brief Binds sockets to their respective addresses and starts listening
      * Binds each socket to its host:port and puts it in listening state
-     * with a backlog of 100 connections
+     * with the listen_backlog configured for that address (default 511)
      */
     void bindINET();
-    ConfigParser getConfig();
+
+    /**
+     * @brief Gets the configuration these sockets were created from
+     * @return Handle on the shared snapshot
+     */
+    ConfigSnapshot getConfig() const;
 
     /**
      * @brief Closes all socket file descriptors and throws exception
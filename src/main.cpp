@@ -3,11 +3,22 @@
 #include "Socket/socket.hpp"
 #include "Server/monitorClient.hpp"
 #include "Config/ConfigParser.hpp"
-#include <ctime>
+#include "Server/WorkerPool.hpp"
+#include "Server/MasterProcess.hpp"
+#include "Server/Precompress.hpp"
+#include <csignal>
 
 void printConfig(const Config& config) {
     std::cout << "\n========== CONFIGURATION SUMMARY ==========\n";
-    std::cout << "Total servers: " << config.servers.size() << "\n\n";
+    std::cout << "Total servers: " << config.servers.size() << "\n";
+    std::cout << "Event backend: " << config.global.event_backend
+              << (config.global.edge_triggered ? " (edge-triggered)" : "") << "\n";
+    std::cout << "Worker threads: " << config.global.worker_threads << "\n";
+    std::cout << "Worker processes: " << config.global.worker_processes << "\n";
+    std::cout << "Timeouts (s): header " << config.global.header_timeout << ", body " << config.global.body_timeout
+              << ", keep-alive " << config.global.keepalive_timeout << ", send " << config.global.send_timeout
+              << ", cgi " << config.global.cgi_timeout << "\n";
+    std::cout << "Log file: " << (config.global.log_file.empty() ? "stderr" : config.global.log_file) << "\n\n";
     
     for (size_t i = 0; i < config.servers.size(); i++) {
         const Config::ServerConfig& server = config.servers[i];
@@ -86,6 +97,9 @@ void printConfig(const Config& config) {
 }
 
 int main(int argc, char** argv) {
+    // A peer that resets mid-response must fail the write (EPIPE), not kill
+    // the server; sendfile() has no MSG_NOSIGNAL equivalent
+    signal(SIGPIPE, SIG_IGN);
     try {
         ConfigParser config_parser;
         const char* config_file = "src/config.conf";
@@ -99,21 +113,53 @@ int main(int argc, char** argv) {
             printConfig(config_parser.getConfigs());
             
 
+            const Config::GlobalConfig& global = config_parser.getConfigs().global;
+            if (Logger::configure(global.log_level, global.log_file) == -1)
+                LOG_WARN("cannot open log_file " << global.log_file << ", logging to stderr");
+            if (global.precompress_build)
+                buildSidecars(config_parser.getConfigs());
+            if (global.worker_processes > 1) {
+                // Listeners are bound once here and inherited by every worker
+                sock socketCreate(config_parser);
+
+                LOG_INFO("Sockets created successfully");
+                if (global.worker_threads > 1)
+                    LOG_WARN("worker_threads is ignored when worker_processes is set");
+                LOG_INFO("Starting " << global.worker_processes << " worker processes");
+                MasterProcess master(socketCreate, global.worker_processes);
+                int status = master.run();
+                Logger::shutdown();
+                return status;
+            }
+
+            size_t workers = global.worker_threads;
+            if (workers > 1) {
+                // One SO_REUSEPORT listener set and event loop per thread
+                WorkerPool pool(config_parser, workers);
+
+                LOG_INFO("Sockets created successfully");
+                LOG_INFO("Starting " << workers << " event loop threads");
+                pool.run();
+                Logger::shutdown();
+                return 1;
+            }
+
             // make sock constructor  accept a object of the config parser  class 
             sock socketCreate(config_parser);
 
-            time_t tnow = time(NULL);
-            std::cout << "[INFO] " << "Sockets created successfully at " << std::ctime(&tnow);
+            LOG_INFO("Sockets created successfully");
 
             monitorClient mc(socketCreate);
-            std::cout << "[INFO] " << "Starting event loop" << std::endl;
+            LOG_INFO("Starting event loop");
             mc.startEventLoop();
         } else {
             std::cerr << "Error parsing configuration file." << std::endl;
         }
     } catch (const std::exception& e) {
-        std::cerr << "Exception: " << e.what() << std::endl;
+        LOG_ERROR("Exception: " << e.what());
+        Logger::shutdown();
         return 1;
     }
+    Logger::shutdown();
     return 0;
 }
\ No newline at end of file
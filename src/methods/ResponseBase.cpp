@@ -1,13 +1,30 @@
 #include "ResponseBase.hpp"
+#include "../HTTP/Utils.hpp"
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <ctime>
+#include <cstdio>
+#include <strings.h>
 
-ResponseBase::ResponseBase(Request& request)
+ResponseBase::ResponseBase(Request& request, FileCache* cache, OpenFileCache* openFiles)
     : request(request),
     statusCode(200),
     statusText("ok"),
-    finalized(false)
+    finalized(false),
+    headOnly(request.getMethod() == "HEAD"),
+    bodyFd(-1),
+    bodyFileSize(0),
+    cache(cache),
+    openFiles(openFiles),
+    bodyBlock(NULL),
+    bodyFdOwner(NULL),
+    gzip(NULL)
 
 {}
 
@@ -15,6 +32,7 @@ void ResponseBase::buildError(int code,  std::string text){
     if (!finalized){
         this->statusCode = code;
         this->statusText = text;
+        dropBodyFile();
         this->body = buildDefaultBodyError(code);
         finalize();
     }
@@ -24,7 +42,7 @@ void ResponseBase::buildError(int code,  std::string text){
 std::string ResponseBase::buildDefaultBodyError(int code){
 
     statusCode = code;
-    const Config::ServerConfig & srv = request.serverConfig;
+    const Config::ServerConfig & srv = *request.serverConfig;
     const Config::ServerConfig::ConstErrorPagesIterator it = srv.error_pages.find(code);
     if (it != srv.error_pages.end()){
         std::string path = it->second;
@@ -36,6 +54,21 @@ std::string ResponseBase::buildDefaultBodyError(int code){
 }
 
 std::string ResponseBase::ReadFromFile(const std::string &path){
+    // Error pages are read on every error response; serve them from the cache
+    if (cache){
+        const FileCache::Entry *entry = cache->lookup(path);
+        if (!entry){
+            char resolved[PATH_MAX];
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0){
+                if (realpath(path.c_str(), resolved))
+                    entry = cache->insert(path, resolved, fd, "text/html; charset=utf-8");
+                close(fd);
+            }
+        }
+        if (entry)
+            return std::string(entry->body->data(), entry->body->size());
+    }
     std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
     if (!ifs)
         return std::string();
@@ -44,6 +77,283 @@ std::string ResponseBase::ReadFromFile(const std::string &path){
     return ss.str();
 }
 
+/**
+ * @brief Uses a regular file as the response body without reading it
+ * @return false if the file cannot be opened or is not a regular file
+ */
+bool ResponseBase::setBodyFile(const std::string &path){
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    return setBodyFile(fd);
+}
+
+/**
+ * @brief Same, from a descriptor the response takes over (closed on failure)
+ */
+bool ResponseBase::setBodyFile(int fd){
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        return false;
+    }
+    dropBodyFile();
+    bodyFd = fd;
+    bodyFileSize = st.st_size;
+    body.clear();
+    return true;
+}
+
+void ResponseBase::dropBodyFile(){
+    if (bodyFdOwner)
+        bodyFdOwner->release();
+    else if (bodyFd >= 0)
+        close(bodyFd);
+    bodyFdOwner = NULL;
+    bodyFd = -1;
+    bodyFileSize = 0;
+    if (bodyBlock)
+        bodyBlock->release();
+    bodyBlock = NULL;
+}
+
+/**
+ * @brief Uses a descriptor held by the open-file cache as the body
+ */
+void ResponseBase::setSharedBodyFile(const OpenFileCache::Entry &entry){
+    dropBodyFile();
+    body.clear();
+    bodyFd = entry.fd;
+    bodyFileSize = entry.size;
+    bodyFdOwner = entry.handle;
+    bodyFdOwner->retain();
+}
+
+/**
+ * @brief Answers 200 with a cached file: pre-rendered headers, shared body
+ *
+ * Headers added beforehand (e.g. the cache policy) follow the cached ones.
+ */
+void ResponseBase::setCachedFile(const FileCache::Entry &entry){
+    dropBodyFile();
+    body.clear();
+    bodyBlock = entry.body;
+    bodyBlock->retain();
+    statusCode = 200;
+    statusText = "OK";
+    response = "HTTP/1.1 200 OK\r\n";
+    response += entry.headers;
+    for (std::map<std::string,std::string>::iterator it = headers.begin(); it != headers.end(); ++it)
+        response += it->first + ": " + it->second + "\r\n";
+    response += "\r\n";
+    finalized = true;
+}
+
+/**
+ * @brief Tells whether one entity tag of an If-None-Match list matches
+ *
+ * Uses the weak comparison of RFC 9110: a W/ prefix is ignored.
+ */
+template <typename String>
+static bool etagListMatches(const String &list, const std::string &etag){
+    size_t pos = 0;
+    while (pos < list.size()){
+        size_t comma = list.find(',', pos);
+        if (comma == String::npos) comma = list.size();
+        size_t b = pos, e = comma;
+        while (b < e && (list[b] == ' ' || list[b] == '\t')) b++;
+        while (e > b && (list[e-1] == ' ' || list[e-1] == '\t')) e--;
+        if (e - b == 1 && list[b] == '*')
+            return true;
+        if (e - b > 2 && list.compare(b, 2, "W/") == 0)
+            b += 2;
+        if (list.compare(b, e - b, etag.data(), etag.size()) == 0)
+            return true;
+        pos = comma + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Evaluates If-None-Match, else If-Modified-Since, for a file version
+ * @return true if the client's copy is current and 304 is the answer
+ */
+bool ResponseBase::isNotModified(const std::string &etag, time_t mtime){
+    const Request::StringMap &h = request.getAllHeaders();
+    Request::StringMap::const_iterator it = h.find("if-none-match");
+    if (it != h.end())
+        return etagListMatches(it->second, etag);
+    it = h.find("if-modified-since");
+    time_t since;
+    if (it != h.end() && parseHttpDate(it->second.c_str(), since))
+        return mtime <= since;
+    return false;
+}
+
+/**
+ * @brief Answers 304 with the validators and cache policy, without a body
+ */
+void ResponseBase::setNotModified(const std::string &etag, const std::string &lastModified){
+    dropBodyFile();
+    body.clear();
+    setStatus(304, "Not Modified");
+    addHeader("ETag", etag);
+    addHeader("Last-Modified", lastModified);
+    addCachePolicy();
+}
+
+static const size_t MAX_RANGES = 16;  // More parts than this are answered with the whole file
+
+/**
+ * @brief Reads a decimal offset; at most 18 digits so it cannot overflow
+ */
+template <typename String>
+static bool parseOffset(const String &s, size_t b, size_t e, off_t &value){
+    if (b == e || e - b > 18)
+        return false;
+    value = 0;
+    for (size_t i = b; i < e; i++){
+        if (!isdigit(static_cast<unsigned char>(s[i])))
+            return false;
+        value = value * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a Range value ("bytes=0-99, 200-, -50") against a body size
+ * @param out Receives the satisfiable ranges, clamped to the body
+ * @return false if the value is malformed (the header is then ignored)
+ */
+template <typename String>
+static bool parseRanges(const String &value, off_t size, std::vector<std::pair<off_t, off_t> > &out){
+    if (value.size() < 6 || strncasecmp(value.c_str(), "bytes=", 6) != 0)
+        return false;
+    size_t pos = 6;
+    bool any = false;
+    while (pos <= value.size()){
+        size_t comma = value.find(',', pos);
+        if (comma == String::npos) comma = value.size();
+        size_t b = pos, e = comma;
+        pos = comma + 1;
+        while (b < e && (value[b] == ' ' || value[b] == '\t')) b++;
+        while (e > b && (value[e-1] == ' ' || value[e-1] == '\t')) e--;
+        if (b == e)
+            continue;
+        size_t dash = value.find('-', b);
+        if (dash == String::npos || dash >= e)
+            return false;
+        off_t first, last;
+        any = true;
+        if (dash == b){
+            // Suffix range: the last N bytes
+            if (!parseOffset(value, dash + 1, e, last))
+                return false;
+            if (last == 0 || size == 0)
+                continue;
+            first = (last >= size) ? 0 : size - last;
+            out.push_back(std::make_pair(first, size - first));
+            continue;
+        }
+        if (!parseOffset(value, b, dash, first))
+            return false;
+        if (dash + 1 == e)
+            last = size - 1;
+        else if (!parseOffset(value, dash + 1, e, last) || last < first)
+            return false;
+        if (first >= size)
+            continue;
+        if (last >= size)
+            last = size - 1;
+        out.push_back(std::make_pair(first, last - first + 1));
+    }
+    return any;
+}
+
+/**
+ * @brief Turns the prepared 200 into a 206 or 416 when the request has a usable Range
+ * @param etag Entity tag of the body, for If-Range
+ * @param lastModified HTTP date of the body, for If-Range
+ * @param size Length of the body (bodyBlock or bodyFd)
+ * @param contentType Type of the body, repeated in each multipart part
+ * @return false if the whole body should be sent (no Range, stale If-Range, malformed)
+ */
+bool ResponseBase::applyRange(const std::string &etag, const std::string &lastModified,
+                              off_t size, const std::string &contentType){
+    const Request::StringMap &h = request.getAllHeaders();
+    Request::StringMap::const_iterator range = h.find("range");
+    if (range == h.end())
+        return false;
+    // If-Range: ranges only apply to the version the client already has
+    Request::StringMap::const_iterator ifRange = h.find("if-range");
+    if (ifRange != h.end() && etag != ifRange->second.c_str() && lastModified != ifRange->second.c_str())
+        return false;
+
+    std::vector<std::pair<off_t, off_t> > wanted;
+    if (!parseRanges(range->second, size, wanted) || wanted.size() > MAX_RANGES)
+        return false;
+
+    std::ostringstream total;
+    total << size;
+    if (wanted.empty()){
+        dropBodyFile();
+        headers.erase("ETag");
+        headers.erase("Last-Modified");
+        headers.erase("Content-Encoding");
+        addHeader("Content-Range", "bytes */" + total.str());
+        addHeader("Content-Type", "text/html; charset=utf-8");
+        setStatus(416, "Range Not Satisfiable");
+        body = buildDefaultBodyError(416);
+        return true;
+    }
+
+    ranges.resize(wanted.size());
+    for (size_t i = 0; i < wanted.size(); i++){
+        ranges[i].start = wanted[i].first;
+        ranges[i].length = wanted[i].second;
+    }
+    if (ranges.size() == 1){
+        std::ostringstream cr;
+        cr << "bytes " << ranges[0].start << "-" << (ranges[0].start + ranges[0].length - 1) << "/" << size;
+        addHeader("Content-Range", cr.str());
+    } else {
+        // The boundary only has to be absent from the part headers and
+        // unlikely in the body; a per-process counter is enough
+        static unsigned long sequence = 0;
+        char boundary[48];
+        snprintf(boundary, sizeof(boundary), "%08lx%08lx", static_cast<unsigned long>(getpid()),
+                 __sync_add_and_fetch(&sequence, 1));
+        for (size_t i = 0; i < ranges.size(); i++){
+            std::ostringstream part;
+            part << "\r\n--" << boundary << "\r\nContent-Type: " << contentType
+                 << "\r\nContent-Range: bytes " << ranges[i].start << "-"
+                 << (ranges[i].start + ranges[i].length - 1) << "/" << size << "\r\n\r\n";
+            ranges[i].head = part.str();
+        }
+        rangeTail = std::string("\r\n--") + boundary + "--\r\n";
+        addHeader("Content-Type", std::string("multipart/byteranges; boundary=") + boundary);
+    }
+    setStatus(206, "Partial Content");
+    return true;
+}
+
+/**
+ * @brief Adds the route's expires / cache_control headers for a static file
+ */
+void ResponseBase::addCachePolicy(){
+    const Config::RouteConfig *route = request.route.route;
+    if (!route)
+        return;
+    if (route->expires >= 0){
+        std::ostringstream maxAge;
+        maxAge << "max-age=" << route->expires;
+        addHeader("Cache-Control", maxAge.str());
+        addHeader("Expires", httpDate(time(NULL) + route->expires));
+    }
+    if (!route->cache_control.empty())
+        addHeader("Cache-Control", route->cache_control);
+}
+
 std::string ResponseBase::GenerateDefaultError(int code){
     std::ostringstream ss;
     ss << "<html><head><title>" << code << "</title></head>\n";
@@ -129,35 +439,8 @@ std::string ResponseBase::GenerateDefaultError(int code){
 }
 
 bool ResponseBase::isMethodAllowed(){
-    const std::string &m = request.method;
-    const std::vector<Config::RouteConfig> &routes = request.serverConfig.routes;
-
-    // Find best matching route using longest-prefix matching (nginx-style)
-    const Config::RouteConfig *matched = NULL;
-    size_t best_len = 0;
-    for (std::vector<Config::RouteConfig>::const_iterator it = routes.begin(); it != routes.end(); ++it){
-        const std::string &route_path = it->path;
-        if (route_path.empty()) continue;
-        if (request.path.compare(0, route_path.size(), route_path) == 0){
-            if (route_path.size() > best_len){
-                best_len = route_path.size();
-                matched = &(*it);
-            }
-        }
-    }
-
-    if (matched){
-        const std::vector<std::string> &allowed = matched->accepted_methods;
-        if (allowed.empty())
-            return true; // no explicit restriction means all methods allowed at this level
-        for (std::vector<std::string>::const_iterator mit = allowed.begin(); mit != allowed.end(); ++mit){
-            if (*mit == m) return true;
-        }
-        return false; // matched but method not allowed
-    }
-
-    // No matching route: fall back to allow (server-level rules may apply elsewhere)
-    return true;
+    // Decided once by the routing stage (Request::resolveRoute)
+    return request.route.methodAllowed;
 }
 
 void ResponseBase::setStatus(int code, const std::string& text){
@@ -189,26 +472,70 @@ void ResponseBase::finalize(){
     std::ostringstream ss;
     ss << "HTTP/1.1 " << statusCode << " " << statusText << "\r\n";
 
-    // Ensure Content-Length and Content-Type
-    std::ostringstream len;
-    len << body.size();
-    headers["Content-Length"] = len.str();
-    if (headers.find("Content-Type") == headers.end())
-        headers["Content-Type"] = detectContentType();
+    // Ensure Content-Length and Content-Type; a 304 describes the body it omits
+    if (statusCode != 304){
+        std::ostringstream len;
+        if (!ranges.empty()){
+            off_t total = static_cast<off_t>(rangeTail.size());
+            for (size_t i = 0; i < ranges.size(); i++)
+                total += static_cast<off_t>(ranges[i].head.size()) + ranges[i].length;
+            len << total;
+        } else if (bodyBlock)
+            len << bodyBlock->size();
+        else if (bodyFd >= 0)
+            len << bodyFileSize;
+        else
+            len << body.size();
+        headers["Content-Length"] = len.str();
+        if (headers.find("Content-Type") == headers.end())
+            headers["Content-Type"] = detectContentType();
+        startGzip();
+    }
 
     for (std::map<std::string,std::string>::iterator it = headers.begin(); it != headers.end(); ++it){
         ss << it->first << ": " << it->second << "\r\n";
     }
     ss << "\r\n";
-    ss << body;
 
     response = ss.str();
     finalized = true;
 }
 
+/**
+ * @brief Switches an in-memory body to gzip with chunked framing when the route asks for it
+ *
+ * Files are left alone: they are sent with sendfile, or as a .gz sidecar
+ * on precompressed routes.
+ */
+void ResponseBase::startGzip(){
+    if (!ranges.empty() || bodyBlock || bodyFd >= 0 || statusCode == 204)
+        return;
+    if (headers.find("Content-Encoding") != headers.end())
+        return;
+    if (!shouldGzip(request, headers["Content-Type"], body.size()))
+        return;
+    gzip = new GzipStream();
+    if (!gzip->ok()){
+        delete gzip;
+        gzip = NULL;
+        return;
+    }
+    headers.erase("Content-Length");
+    headers["Content-Encoding"] = "gzip";
+    headers["Transfer-Encoding"] = "chunked";
+    std::map<std::string,std::string>::iterator vary = headers.find("Vary");
+    if (vary == headers.end())
+        headers["Vary"] = "Accept-Encoding";
+    else if (vary->second.find("Accept-Encoding") == std::string::npos)
+        vary->second += ", Accept-Encoding";
+}
 
-ResponseBase::~ResponseBase(){ }
-const std::string & ResponseBase::generate(){
+
+ResponseBase::~ResponseBase(){
+    dropBodyFile();
+    delete gzip;
+}
+void ResponseBase::generate(OutputQueue &out){
     if (!finalized){
         try{
             handle();
@@ -217,6 +544,58 @@ const std::string & ResponseBase::generate(){
             buildError(500, "Internal Server Error");
         }
     }
-    return response;
+    out.pushMemory(response);
+    if (headOnly){
+        // The head already describes the body; nothing of it is sent
+        dropBodyFile();
+        body.clear();
+        return;
+    }
+    if (!ranges.empty()){
+        pushRanges(out);
+    } else if (bodyBlock){
+        out.pushShared(bodyBlock, 0, bodyBlock->size());
+    } else if (bodyFd >= 0){
+        if (bodyFdOwner){
+            out.pushFile(bodyFdOwner, bodyFd, 0, bodyFileSize);
+            dropBodyFile();
+        } else {
+            out.pushFile(bodyFd, 0, bodyFileSize, true);
+            bodyFd = -1;
+            bodyFileSize = 0;
+        }
+    } else if (gzip){
+        gzip->write(body.data(), body.size(), out);
+        gzip->finish(out);
+        body.clear();
+    } else {
+        out.pushMemory(body);
+    }
+}
 
-}
\ No newline at end of file
+/**
+ * @brief Queues the selected ranges straight from the body source
+ */
+void ResponseBase::pushRanges(OutputQueue &out){
+    bool ownedFd = !bodyBlock && !bodyFdOwner && bodyFd >= 0;
+    for (size_t i = 0; i < ranges.size(); i++){
+        const ByteRange &r = ranges[i];
+        if (!r.head.empty()){
+            std::string head = r.head;
+            out.pushMemory(head);
+        }
+        if (bodyBlock)
+            out.pushShared(bodyBlock, static_cast<size_t>(r.start), static_cast<size_t>(r.length));
+        else if (bodyFdOwner)
+            out.pushFile(bodyFdOwner, bodyFd, r.start, r.length);
+        else if (bodyFd >= 0)
+            // Segments leave in order, so the last one closes the descriptor
+            out.pushFile(bodyFd, r.start, r.length, i + 1 == ranges.size());
+    }
+    if (ownedFd){
+        bodyFd = -1;
+        bodyFileSize = 0;
+    }
+    if (!rangeTail.empty())
+        out.pushMemory(rangeTail);
+}
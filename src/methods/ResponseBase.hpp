@@ -3,7 +3,12 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <sys/types.h>
 #include "../HTTP/Request.hpp"
+#include "../Server/OutputQueue.hpp"
+#include "../Server/FileCache.hpp"
+#include "../Server/OpenFileCache.hpp"
+#include "../Server/GzipStream.hpp"
 
 class ResponseBase
 {
@@ -13,12 +18,41 @@ protected:
     std::string statusText;
     std::map<std::string, std::string>  headers;
     std::string body;
-    std::string response;
+    std::string response;   // Status line and headers, built by finalize()
     bool finalized;
+    bool headOnly;          // HEAD: same head as GET, no body sent or read
+    int bodyFd;             // File sent as the body instead of `body` (-1 = none)
+    off_t bodyFileSize;     // Length of the file body
+    FileCache* cache;       // Static file cache of the event loop (may be NULL)
+    OpenFileCache* openFiles; // Lookup/descriptor cache of the server (may be NULL)
+    SharedBlock* bodyBlock; // Cached content sent as the body (retained), or NULL
+    SharedBlock* bodyFdOwner; // Holder of a shared bodyFd (retained), NULL if bodyFd is ours
+    GzipStream* gzip;       // Compresses `body` on the way out (gzip route), or NULL
+
+    /**
+     * @brief One part of a 206 response, sent from the body source at an offset
+     */
+    struct ByteRange {
+        off_t start;
+        off_t length;
+        std::string head;   // multipart/byteranges part header ("" for a single range)
+    };
+    std::vector<ByteRange> ranges;  // Parts sent instead of the whole body (206)
+    std::string rangeTail;          // Closing multipart boundary
 
     virtual void handle() = 0;
     std::string buildDefaultBodyError(int code);
     std::string ReadFromFile(const std::string &path);
+    bool setBodyFile(const std::string &path);
+    bool setBodyFile(int fd);
+    void dropBodyFile();
+    void setCachedFile(const FileCache::Entry &entry);
+    void setSharedBodyFile(const OpenFileCache::Entry &entry);
+    bool isNotModified(const std::string &etag, time_t mtime);
+    void setNotModified(const std::string &etag, const std::string &lastModified);
+    void addCachePolicy();
+    bool applyRange(const std::string &etag, const std::string &lastModified,
+                    off_t size, const std::string &contentType);
     std::string GenerateDefaultError(int code);
 
     bool isMethodAllowed();
@@ -27,13 +61,22 @@ protected:
     void addHeader(const std::string& key, const std::string& value);
     std::string detectContentType();
     void finalize();
+    void startGzip();
+    void pushRanges(OutputQueue &out);
 
 
 
 
 public:
-    ResponseBase(Request& request);
-    const std::string & generate();
+    ResponseBase(Request& request, FileCache* cache = NULL, OpenFileCache* openFiles = NULL);
+
+    /**
+     * @brief Builds the response and queues it for sending
+     * The head and an in-memory body are moved into the queue; a file body
+     * is queued as a file range (the queue takes over its descriptor).
+     * @param out Output queue of the connection
+     */
+    void generate(OutputQueue &out);
     void buildError(int code, std::string text); // it most get the Error page if the server config provide  ones or use the defaults one tha comes with the server  
     virtual ~ResponseBase();
 };
@@ -4,7 +4,7 @@
 
 class ResponseDelete : public ResponseBase {
 public:
-    ResponseDelete(Request& request);
+    ResponseDelete(Request& request, FileCache* cache = NULL, OpenFileCache* openFiles = NULL);
     virtual ~ResponseDelete();
 protected:
     virtual void handle();
@@ -1,16 +1,21 @@
 #include "ResponseGet.hpp"
 #include "../CGI/CGIHandler.hpp"
+#include "../HTTP/Utils.hpp"
+#include "../Server/Precompress.hpp"
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <fstream>
 #include <sstream>
 #include <dirent.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctime>
 #include <iostream>
 
-ResponseGet::ResponseGet(Request& request)
-    : ResponseBase(request)
+ResponseGet::ResponseGet(Request& request, FileCache* cache, OpenFileCache* openFiles)
+    : ResponseBase(request, cache, openFiles)
 {
 }
 
@@ -20,25 +25,10 @@ ResponseGet::~ResponseGet()
 
 
 void ResponseGet::handle(){
-    // Find the best matching route using longest-prefix matching (nginx-style)
-
-    const Config::RouteConfig *matched = NULL;
-    const std::vector<Config::RouteConfig> &routes = request.serverConfig.routes;
-    size_t best_len = 0;
-    for (std::vector<Config::RouteConfig>::const_iterator it = routes.begin(); it != routes.end(); ++it){
-        const std::string &rpath = it->path;
-        if (rpath.empty()) continue;
-        // ensure rpath is a prefix of request.path
-        if (request.path.compare(0, rpath.size(), rpath) == 0){
-            // prefer longer (more specific) prefix
-            if (rpath.size() > best_len){
-                best_len = rpath.size();
-                matched = &(*it);
-                // Continue checking all routes to find the longest match, don't break
-            }
-        }
-    }
-    
+    // The route, filesystem path and CGI flag were resolved with the head
+    const RouteContext &ctx = request.route;
+    const Config::RouteConfig *matched = ctx.route;
+    std::string fsPath = ctx.fsPath;
 
     // If route matched, ensure GET is allowed; if the route defines no methods, treat as disallow-all
     if (matched){
@@ -48,17 +38,7 @@ void ResponseGet::handle(){
             body = buildDefaultBodyError(matched->redirect_code);
             return;
         }
-        const std::vector<std::string> &allowed = matched->accepted_methods;
-        bool okmethod = false;
-        if (!allowed.empty()){
-            for (std::vector<std::string>::const_iterator mit = allowed.begin(); mit != allowed.end(); ++mit){
-                if (*mit == "GET") { okmethod = true; break; }
-            }
-        } else {
-            // Empty accepted_methods means none are allowed for this route
-            okmethod = false;
-        }
-        if (!okmethod){
+        if (!isMethodAllowed()){
             std::string stxt = "Method Not Allowed";
             setStatus(405, stxt);
             body = buildDefaultBodyError(405);
@@ -66,62 +46,89 @@ void ResponseGet::handle(){
         }
     }
 
-    // Resolve root and produce filesystem path compatible with prefix routes
-    std::string root = request.serverConfig.root;
-    if (matched && !matched->root.empty()) root = matched->root;
+    // Index file served when the target is a directory
+    std::string indexFile;
+    if (matched && !matched->index.empty()) indexFile = matched->index;
+    else indexFile = "index.html";
 
-    // Compute the path suffix after the matched route prefix
-    std::string suffix;
-    if (matched && !matched->path.empty() && request.path.compare(0, matched->path.size(), matched->path) == 0)
-        suffix = request.path.substr(matched->path.size());
-    else
-        suffix = request.path;
-
-    // For exact file matches like /auto/file, don't append anything extra
-    if (matched && matched->path == request.path && matched->index.empty()) {
-        suffix = "";
+    // Static files (and directory indexes) already in the cache skip the
+    // filesystem entirely. The key holds the index name because two routes
+    // may share a root with different index files; paths cannot hold '\0'.
+    // Precompressed routes answer with a .br/.gz sidecar the client accepts
+    std::vector<std::string> wantEncodings;
+    if (matched && matched->precompressed && !ctx.isCgi){
+        addHeader(std::string("Vary"), std::string("Accept-Encoding"));
+        size_t dot = fsPath.find_last_of("./");
+        if (dot == std::string::npos || fsPath[dot] != '.' || isCompressibleName(fsPath))
+            wantEncodings = acceptedEncodings();
     }
 
-    // Normalize root (remove trailing slash) and ensure suffix begins with '/'
-    std::string fsPath = root;
-    // C++98-compatible trimming of trailing slash
-    if (!fsPath.empty() && fsPath[fsPath.size() - 1] == '/') fsPath.erase(fsPath.size() - 1);
-    if (!suffix.empty() && suffix[0] != '/') fsPath += "/" + suffix; else fsPath += suffix;
-
-
-
-    // Canonicalize fsPath and ensure it stays inside the root to prevent traversal
-    char resolved_root[PATH_MAX];
-    char resolved_target[PATH_MAX];
-    if (realpath(root.c_str(), resolved_root) == NULL){
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
-        return;
+    std::string cacheKey;
+    if ((cache || openFiles) && !ctx.isCgi){
+        cacheKey = fsPath;
+        cacheKey += '\0';
+        cacheKey += indexFile;
+        for (size_t i = 0; i < wantEncodings.size(); i++){
+            cacheKey += '\0';
+            cacheKey += wantEncodings[i];
+        }
     }
-    if (realpath(fsPath.c_str(), resolved_target) == NULL){
-        // target does not exist
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
-        return;
+    if (cache && !cacheKey.empty()){
+        const FileCache::Entry *entry = cache->lookup(cacheKey);
+        if (entry){
+            answerCached(*entry);
+            return;
+        }
     }
 
-    // Ensure resolved_target is inside resolved_root
-    std::string rr(resolved_root);
-    std::string rt(resolved_target);
-    if (rt.compare(0, rr.size(), rr) != 0){
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
-        return;
+    // Next, what the filesystem said about this path a moment ago
+    int valid = 0;
+    bool cacheErrors = false;
+    time_t now = 0;
+    if (openFiles && !cacheKey.empty()){
+        valid = request.serverConfig->open_file_cache_valid;
+        cacheErrors = request.serverConfig->open_file_cache_errors;
+        if (matched && matched->open_file_cache_valid >= 0) valid = matched->open_file_cache_valid;
+        if (matched && matched->open_file_cache_errors >= 0) cacheErrors = matched->open_file_cache_errors != 0;
+    }
+    if (valid > 0){
+        now = time(NULL);
+        const OpenFileCache::Entry *known = openFiles->lookup(cacheKey, now);
+        if (known){
+            if (known->kind == OpenFileCache::OF_FILE){
+                setSharedBodyFile(*known);
+                contentEncoding = known->encoding;
+                std::string ct = contentTypeFromPath(known->typePath);
+                if (cacheFile(cacheKey, known->path, ct))
+                    return;
+                answerFile(known->ino, known->size, known->mtime, ct);
+            } else if (known->kind == OpenFileCache::OF_DIRECTORY && matched && matched->directory_listing){
+                int dirFd = RootDirectories::openBeneath(ctx.rootFd, ctx.relPath(),
+                                                         O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (dirFd >= 0)
+                    listDirectory(dirFd);
+                else
+                    notFound();
+            } else {
+                notFound();
+            }
+            return;
+        }
     }
 
+    // Open the target beneath the route root; the kernel refuses any
+    // lookup that would leave it ("..", absolute or /proc symlinks)
+    std::string relPath = ctx.relPath();
+    int fd = RootDirectories::openBeneath(ctx.rootFd, relPath, openFlags());
     struct stat st;
-    if (stat(resolved_target, &st) != 0){
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
+    if (fd >= 0 && fstat(fd, &st) != 0){
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0){
+        if (valid > 0 && cacheErrors)
+            openFiles->addMissing(cacheKey, now + valid);
+        notFound();
         return;
     }
 
@@ -138,79 +145,62 @@ void ResponseGet::handle(){
     //         return;
     //     }
         // Try index from matched route, then default index.html
-        std::string indexFile;
-        if (matched && !matched->index.empty()) indexFile = matched->index;
-        else indexFile = "index.html";
-
-        std::string indexPath = fsPath;
-        if (indexPath.size() == 0 || indexPath[indexPath.size()-1] != '/') indexPath += "/";
-        indexPath += indexFile;
-
-        if (stat(indexPath.c_str(), &st) == 0 && ((st.st_mode & S_IFMT) != S_IFDIR)){
-            std::string content = ReadFromFile(indexPath);
-            if (!content.empty()){
-                body = content;
-                addHeader(std::string("Content-Type"), contentTypeFromPath(indexPath));
-                std::string ok = "OK";
-                setStatus(200, ok);
+        std::string indexRel = relPath;
+        if (!indexRel.empty() && indexRel[indexRel.size()-1] != '/') indexRel += "/";
+        indexRel += indexFile;
+
+        int indexFd = RootDirectories::openBeneath(ctx.rootFd, indexRel, openFlags());
+        if (indexFd >= 0 && !wantEncodings.empty() && fstat(indexFd, &st) == 0 && S_ISREG(st.st_mode))
+            indexFd = openSidecar(indexRel, wantEncodings, indexFd, st);
+        if (indexFd >= 0 && setBodyFile(indexFd)){
+            close(fd);
+            std::string ct = contentTypeFromPath(indexFile);
+            if (cache || valid > 0){
+                std::string indexPath = RootDirectories::pathOf(bodyFd);
+                if (reachedDirectly(indexRel, indexPath)){
+                    if (valid > 0 && !headOnly)
+                        rememberBodyFile(cacheKey, indexPath, indexFile, now + valid);
+                    if (cacheFile(cacheKey, indexPath, ct))
+                        return;
+                }
+            }
+            if (fstat(bodyFd, &st) != 0){
+                notFound();
                 return;
             }
+            answerFile(st.st_ino, st.st_size, st.st_mtime, ct);
+            return;
         }
 
+        if (valid > 0)
+            openFiles->addDirectory(cacheKey, fsPath, now + valid);
         // If directory listing allowed in route, generate simple listing
         if (matched && matched->directory_listing){
-            DIR *dir = opendir(fsPath.c_str());
-            if (!dir){
-                std::string stxt = "Not Found";
-                setStatus(404, stxt);
-                body = buildDefaultBodyError(404);
-                return;
-            }
-            std::ostringstream ss;
-            ss << "<html><head><title>Index of " << request.path << "</title></head>\n";
-            ss << "<body><h1>Index of " << request.path << "</h1><ul>\n";
-            struct dirent *entry;
-            while ((entry = readdir(dir)) != NULL){
-                std::string name = entry->d_name;
-                if (name == "." || name == "..") continue;
-                std::string href = request.path;
-                if (href.empty() || href[0] != '/') href = "/" + href;
-                if (href[href.size()-1] != '/') href += "/";
-                ss << "<li><a href=\"" << href << name << "\">" << name << "</a></li>\n";
+            if (headOnly){
+                // An O_PATH descriptor cannot be read; the listing gives Content-Length
+                close(fd);
+                fd = RootDirectories::openBeneath(ctx.rootFd, relPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd < 0){
+                    notFound();
+                    return;
+                }
             }
-            closedir(dir);
-            ss << "</ul></body></html>\n";
-            body = ss.str();
-            addHeader(std::string("Content-Type"), std::string("text/html; charset=utf-8"));
-            std::string ok = "OK";
-            setStatus(200, ok);
+            listDirectory(fd);
             return;
         }
+        close(fd);
 
         // Not allowed and no index -> 404
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
+        notFound();
         return;
     }
 
     // If CGI is enabled on the matched route and the file extension matches, execute CGI
     // NOTE: We still use synchronous CGI execution here for backwards compatibility
     // The async CGI integration is handled at the monitorClient level
-     bool isCgi = false;
-    if (matched && matched->cgi_enabled) {
-        size_t dot = fsPath.find_last_of('.');
-        if (dot != std::string::npos) {
-            std::string ext = fsPath.substr(dot);
-            for (std::vector<std::string>::const_iterator eit = matched->cgi_extensions.begin(); eit != matched->cgi_extensions.end(); ++eit) {
-                if (ext == *eit){
-                     isCgi = true; break; 
-                }
-            }
-        }
-    }
-    if (isCgi) {
-        CGIHandler cgi(request, request.serverConfig);
+    if (ctx.isCgi) {
+        close(fd);
+        CGIHandler cgi(request, *request.serverConfig);
         CGIHandler::Result r = cgi.run(fsPath, matched->cgi_pass);
         setStatus(r.status_code, r.status_text);
         for (std::map<std::string,std::string>::const_iterator it = r.headers.begin(); it != r.headers.end(); ++it){
@@ -220,21 +210,232 @@ void ResponseGet::handle(){
         return;
     }
 
-    std::string content = ReadFromFile(fsPath);
-    if (content.empty()){
-        std::string stxt = "Not Found";
-        setStatus(404, stxt);
-        body = buildDefaultBodyError(404);
+    if (!wantEncodings.empty() && S_ISREG(st.st_mode))
+        fd = openSidecar(relPath, wantEncodings, fd, st);
+
+    // The body is streamed from the file by the event loop (sendfile)
+    if (!setBodyFile(fd)){
+        notFound();
         return;
     }
 
-    body = content;
     std::string ct = contentTypeFromPath(fsPath);
-    addHeader(std::string("Content-Type"), ct);
+    if (cache || valid > 0){
+        // Caches record the real path: inotify watches its directory
+        std::string realPath = RootDirectories::pathOf(bodyFd);
+        if (reachedDirectly(relPath, realPath)){
+            if (valid > 0 && !headOnly)
+                rememberBodyFile(cacheKey, realPath, fsPath, now + valid);
+            if (cacheFile(cacheKey, realPath, ct))
+                return;
+        }
+    }
+    answerFile(st.st_ino, st.st_size, st.st_mtime, ct);
+}
+
+/**
+ * @brief Flags for opening the body file: HEAD only needs fstat(), so it
+ *        takes an O_PATH descriptor that cannot read the content
+ */
+int ResponseGet::openFlags() const{
+    if (headOnly)
+        return O_PATH | O_CLOEXEC;
+    return O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+}
+
+/**
+ * @brief Moves the open body file into the cache and answers from there
+ * @return false if the cache is off or does not take the file
+ */
+bool ResponseGet::cacheFile(const std::string &key, const std::string &path, const std::string &contentType){
+    // HEAD holds an O_PATH descriptor, and caching would read the file anyway
+    if (!cache || key.empty() || headOnly)
+        return false;
+    const FileCache::Entry *entry = cache->insert(key, path, bodyFd, contentType, contentEncoding);
+    if (!entry)
+        return false;
+    answerCached(*entry);
+    return true;
+}
+
+/**
+ * @brief Tells whether the body file is the one its routed path names
+ * @param rel Path below the root that was opened
+ * @param realPath Where the descriptor actually points
+ *
+ * Cache entries are invalidated through the directory of the real path,
+ * which hears nothing when a symlink along rel is re-pointed; files
+ * reached through one are therefore not cached.
+ */
+bool ResponseGet::reachedDirectly(const std::string &rel, const std::string &realPath) const{
+    std::string named = RootDirectories::pathOf(request.route.rootFd);
+    if (named.empty() || realPath.empty())
+        return false;
+    if (named != "/")
+        named += "/";
+    named += rel;
+    if (contentEncoding == "br")
+        named += ".br";
+    else if (contentEncoding == "gzip")
+        named += ".gz";
+    return named == realPath;
+}
+
+/**
+ * @brief Answers from a cache entry: 304 if the client's copy is current
+ */
+void ResponseGet::answerCached(const FileCache::Entry &entry){
+    if (isNotModified(entry.etag, entry.mtime)){
+        setNotModified(entry.etag, entry.lastModified);
+        return;
+    }
+    addCachePolicy();
+    const Request::StringMap &h = request.getAllHeaders();
+    if (h.find("range") == h.end()){
+        setCachedFile(entry);
+        return;
+    }
+    // Ranges are cut from the cached content; the headers are built afresh
+    dropBodyFile();
+    body.clear();
+    bodyBlock = entry.body;
+    bodyBlock->retain();
+    contentEncoding = entry.contentEncoding;
+    answerBody(entry.etag, entry.lastModified, static_cast<off_t>(entry.body->size()), entry.contentType);
+}
+
+/**
+ * @brief Answers with bodyFd and its validators: 304 if the client's copy is current
+ */
+void ResponseGet::answerFile(ino_t ino, off_t size, time_t mtime, const std::string &contentType){
+    std::string etag = entityTag(ino, size, mtime);
+    std::string lastModified = httpDate(mtime);
+    if (isNotModified(etag, mtime)){
+        setNotModified(etag, lastModified);
+        return;
+    }
+    addCachePolicy();
+    answerBody(etag, lastModified, size, contentType);
+}
+
+/**
+ * @brief Sends the prepared body whole (200) or the requested ranges (206/416)
+ */
+void ResponseGet::answerBody(const std::string &etag, const std::string &lastModified,
+                             off_t size, const std::string &contentType){
+    addHeader(std::string("ETag"), etag);
+    addHeader(std::string("Last-Modified"), lastModified);
+    addHeader(std::string("Accept-Ranges"), std::string("bytes"));
+    addHeader(std::string("Content-Type"), contentType);
+    if (!contentEncoding.empty())
+        addHeader(std::string("Content-Encoding"), contentEncoding);
+    if (applyRange(etag, lastModified, size, contentType))
+        return;
+    std::string ok = "OK";
+    setStatus(200, ok);
+}
+
+/**
+ * @brief Lists the sidecar encodings Accept-Encoding takes, br first, then gzip
+ * @return Encodings in the order their sidecars are tried (empty if neither)
+ */
+std::vector<std::string> ResponseGet::acceptedEncodings(){
+    std::vector<std::string> encodings;
+    const Request::StringMap &h = request.getAllHeaders();
+    Request::StringMap::const_iterator it = h.find("accept-encoding");
+    if (it == h.end())
+        return encodings;
+    if (acceptsCoding(it->second.data(), it->second.size(), "br"))
+        encodings.push_back("br");
+    if (acceptsCoding(it->second.data(), it->second.size(), "gzip"))
+        encodings.push_back("gzip");
+    return encodings;
+}
+
+/**
+ * @brief Swaps an open file for the first .br/.gz sidecar that is present and current
+ * @param rel Path of the file below the root
+ * @param encodings Encodings the client accepts, in order of preference
+ * @param fd Open file (closed here if a sidecar replaces it)
+ * @param st fstat() of fd; replaced by the sidecar's
+ * @return The descriptor to send from
+ */
+int ResponseGet::openSidecar(const std::string &rel, const std::vector<std::string> &encodings,
+                             int fd, struct stat &st){
+    if (!isCompressibleName(rel))
+        return fd;
+    for (size_t i = 0; i < encodings.size(); i++){
+        std::string sidecar = rel + (encodings[i] == "br" ? ".br" : ".gz");
+        int sfd = RootDirectories::openBeneath(request.route.rootFd, sidecar, openFlags());
+        if (sfd < 0)
+            continue;
+        struct stat sst;
+        // A sidecar not newer than its file was not rebuilt after an edit
+        if (fstat(sfd, &sst) != 0 || !S_ISREG(sst.st_mode) || !sidecarIsFresh(sst, st)){
+            close(sfd);
+            continue;
+        }
+        close(fd);
+        st = sst;
+        contentEncoding = encodings[i];
+        return sfd;
+    }
+    return fd;
+}
+
+/**
+ * @brief Hands the open body file to the open-file cache and sends from its copy
+ */
+void ResponseGet::rememberBodyFile(const std::string &key, const std::string &path,
+                                   const std::string &typePath, time_t expires){
+    struct stat st;
+    if (fstat(bodyFd, &st) != 0)
+        return;
+    const OpenFileCache::Entry *entry = openFiles->addFile(key, path, typePath, bodyFd, st, expires,
+                                                           contentEncoding);
+    // The cache owns the descriptor now; keep a reference instead
+    bodyFd = -1;
+    bodyFileSize = 0;
+    setSharedBodyFile(*entry);
+}
+
+/**
+ * @brief Answers 200 with a simple HTML listing of a directory
+ * @param dirFd Open directory, closed here
+ */
+void ResponseGet::listDirectory(int dirFd){
+    DIR *dir = fdopendir(dirFd);
+    if (!dir){
+        close(dirFd);
+        notFound();
+        return;
+    }
+    std::ostringstream ss;
+    ss << "<html><head><title>Index of " << request.path << "</title></head>\n";
+    ss << "<body><h1>Index of " << request.path << "</h1><ul>\n";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL){
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string href = request.path;
+        if (href.empty() || href[0] != '/') href = "/" + href;
+        if (href[href.size()-1] != '/') href += "/";
+        ss << "<li><a href=\"" << href << name << "\">" << name << "</a></li>\n";
+    }
+    closedir(dir);
+    ss << "</ul></body></html>\n";
+    body = ss.str();
+    addHeader(std::string("Content-Type"), std::string("text/html; charset=utf-8"));
     std::string ok = "OK";
     setStatus(200, ok);
 }
 
+void ResponseGet::notFound(){
+    std::string stxt = "Not Found";
+    setStatus(404, stxt);
+    body = buildDefaultBodyError(404);
+}
+
 std::string ResponseGet::contentTypeFromPath(const std::string &path){
     size_t pos = path.find_last_of('.');
     if (pos == std::string::npos) return std::string("application/octet-stream");
@@ -246,5 +447,9 @@ std::string ResponseGet::contentTypeFromPath(const std::string &path){
     if (ext == "png") return std::string("image/png");
     if (ext == "jpg" || ext == "jpeg") return std::string("image/jpeg");
     if (ext == "gif") return std::string("image/gif");
+    if (ext == "json") return std::string("application/json");
+    if (ext == "xml") return std::string("application/xml");
+    if (ext == "svg") return std::string("image/svg+xml");
+    if (ext == "txt") return std::string("text/plain; charset=utf-8");
     return std::string("application/octet-stream");
 }
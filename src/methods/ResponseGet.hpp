@@ -1,13 +1,30 @@
 #pragma once
 
 #include "ResponseBase.hpp"
+#include <sys/stat.h>
 
 class ResponseGet : public ResponseBase {
 public:
-    ResponseGet(Request& request);
+    ResponseGet(Request& request, FileCache* cache = NULL, OpenFileCache* openFiles = NULL);
     virtual ~ResponseGet();
 protected:
     virtual void handle();
 private:
     std::string contentTypeFromPath(const std::string &path);
+    int openFlags() const;
+    bool cacheFile(const std::string &key, const std::string &path, const std::string &contentType);
+    bool reachedDirectly(const std::string &rel, const std::string &realPath) const;
+    void answerCached(const FileCache::Entry &entry);
+    void answerFile(ino_t ino, off_t size, time_t mtime, const std::string &contentType);
+    void answerBody(const std::string &etag, const std::string &lastModified,
+                    off_t size, const std::string &contentType);
+    void rememberBodyFile(const std::string &key, const std::string &path,
+                          const std::string &typePath, time_t expires);
+    void listDirectory(int dirFd);
+    void notFound();
+    std::vector<std::string> acceptedEncodings();
+    int openSidecar(const std::string &rel, const std::vector<std::string> &encodings,
+                    int fd, struct stat &st);
+
+    std::string contentEncoding;    // Encoding of the sidecar being sent, "" for the file itself
 };
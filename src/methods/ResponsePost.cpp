@@ -1,17 +1,77 @@
 #include "ResponsePost.hpp"
 #include "../CGI/CGIHandler.hpp"
 #include <sys/stat.h>
-#include <fstream>
+#include <fcntl.h>
+#include <cerrno>
 #include <sstream>
 #include <dirent.h>
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctime>
 
-ResponsePost::ResponsePost(Request& request)
-    : ResponseBase(request)
+/**
+ * @brief Writes a whole buffer, retrying short writes
+ */
+static bool writeAll(int fd, const std::string &data){
+    size_t done = 0;
+    while (done < data.size()){
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Keeps the last path component of a client file name
+ */
+static std::string uploadName(const std::string &filename){
+    size_t slash = filename.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    if (name.empty() || name == "." || name == "..") {
+        std::ostringstream ts;
+        ts << "upload_" << time(NULL);
+        name = ts.str();
+    }
+    return name;
+}
+
+/**
+ * @brief Gives a streamed upload its final name
+ *
+ * A named temporary file is simply renamed. linkat() refuses to replace a
+ * file, so for an unnamed O_TMPFILE an existing name is overwritten by
+ * linking under a temporary name and renaming over it.
+ */
+static bool linkUpload(const FilePart &fp, int dirFd, const std::string &name){
+    if (!fp.tmpName.empty())
+        return renameat(dirFd, fp.tmpName.c_str(), dirFd, name.c_str()) == 0;
+    int fd = fp.fd;
+    std::ostringstream proc;
+    proc << "/proc/self/fd/" << fd;
+    if (linkat(AT_FDCWD, proc.str().c_str(), dirFd, name.c_str(), AT_SYMLINK_FOLLOW) == 0)
+        return true;
+    if (errno != EEXIST)
+        return false;
+    std::ostringstream tmp;
+    tmp << "." << name << "." << getpid() << "." << fd << ".tmp";
+    if (linkat(AT_FDCWD, proc.str().c_str(), dirFd, tmp.str().c_str(), AT_SYMLINK_FOLLOW) != 0)
+        return false;
+    if (renameat(dirFd, tmp.str().c_str(), dirFd, name.c_str()) != 0) {
+        unlinkat(dirFd, tmp.str().c_str(), 0);
+        return false;
+    }
+    return true;
+}
+
+ResponsePost::ResponsePost(Request& request, FileCache* cache, OpenFileCache* openFiles)
+    : ResponseBase(request, cache, openFiles)
 {
 }
 
@@ -20,93 +80,47 @@ ResponsePost::~ResponsePost()
 }
 
 void ResponsePost::handle(){
-    // Find best matching route (longest-prefix)
-    const Config::RouteConfig *matched = NULL;
-    const std::vector<Config::RouteConfig> &routes = request.serverConfig.routes;
-    size_t best_len = 0;
-    for (std::vector<Config::RouteConfig>::const_iterator it = routes.begin(); it != routes.end(); ++it){
-        const std::string &rpath = it->path;
-        if (rpath.empty()) continue;
-        if (request.path.compare(0, rpath.size(), rpath) == 0){
-            if (rpath.size() > best_len){
-                best_len = rpath.size();
-                matched = &(*it);
-            }
-        }
-    }
+    // The route, filesystem path and CGI flag were resolved with the head
+    const RouteContext &ctx = request.route;
+    const Config::RouteConfig *matched = ctx.route;
+    std::string fsPath = ctx.fsPath;
 
     // Method check for POST (empty accepted_methods means disallow all)
-    if (matched){
-        const std::vector<std::string> &allowed = matched->accepted_methods;
-        bool ok = false;
-        if (!allowed.empty()){
-            for (std::vector<std::string>::const_iterator mit = allowed.begin(); mit != allowed.end(); ++mit){
-                if (*mit == "POST") { ok = true; break; }
-            }
-        } else {
-            ok = false; // No methods defined -> none allowed
-        }
-        if (!ok){
-            setStatus(405, "Method Not Allowed");
-            addHeader("Allow", "");
-            body = buildDefaultBodyError(405);
-            return;
-        }
+    if (!isMethodAllowed()){
+        setStatus(405, "Method Not Allowed");
+        addHeader("Allow", "");
+        body = buildDefaultBodyError(405);
+        return;
     }
 
-    // Resolve root + suffix
-    std::string root = request.serverConfig.root;
-    if (matched && !matched->root.empty()) root = matched->root;
-    std::string suffix;
-    if (matched && !matched->path.empty() && request.path.compare(0, matched->path.size(), matched->path) == 0)
-        suffix = request.path.substr(matched->path.size());
-    else
-        suffix = request.path;
-    std::string fsPath = root;
-    // C++98-compatible trimming of trailing slash
-    if (!fsPath.empty() && fsPath[fsPath.size() - 1] == '/')
-        fsPath.erase(fsPath.size() - 1);
-    // Ensure single slash between root and suffix
-    if (!suffix.empty() && suffix[0] != '/') fsPath += "/" + suffix; else fsPath += suffix;
-
-    // Canonicalize and containment check
-    char resolved_root[PATH_MAX];
-    char resolved_target[PATH_MAX];
-    if (realpath(root.c_str(), resolved_root) == NULL){ setStatus(404, "Not Found"); body = buildDefaultBodyError(404); return; }
-    if (realpath(fsPath.c_str(), resolved_target) == NULL){ setStatus(404, "Not Found"); body = buildDefaultBodyError(404); return; }
-    std::string rr(resolved_root), rt(resolved_target);
-    if (rt.compare(0, rr.size(), rr) != 0){ setStatus(404, "Not Found"); body = buildDefaultBodyError(404); return; }
-
-    // If resolved target is a directory and there were no parsed multipart uploads,
+    // The target must exist beneath the root; the kernel enforces containment
+    std::string relPath = ctx.relPath();
+    int targetFd = RootDirectories::openBeneath(ctx.rootFd, relPath, O_PATH | O_CLOEXEC);
+    if (targetFd < 0){ setStatus(404, "Not Found"); body = buildDefaultBodyError(404); return; }
+
+    // If the target is a directory and there were no parsed multipart uploads,
     // adjust fsPath to point to a new file inside that directory to avoid opening a directory as a file.
     struct stat st_target;
-    if (stat(resolved_target, &st_target) == 0) {
+    if (fstat(targetFd, &st_target) == 0) {
         if ((st_target.st_mode & S_IFMT) == S_IFDIR) {
-            const std::map<std::string, FilePart>& uploads = request.getUploads();
+            const Request::UploadMap& uploads = request.getUploads();
             if (uploads.empty()) {
                 // create a filename using timestamp and pid
                 std::ostringstream name;
                 name << "upload_" << time(NULL) << "_" << getpid();
-                std::string newPath = std::string(resolved_target) + "/" + name.str();
-                fsPath = newPath;
+                if (!relPath.empty() && relPath[relPath.size() - 1] != '/') relPath += "/";
+                relPath += name.str();
+                fsPath += "/" + name.str();
             }
         }
     }
+    close(targetFd);
 
     //If route enables CGI and the target path points to a CGI script, execute CGI with request body
-    bool tryCgi = false;
-    if (matched && matched->cgi_enabled)
-     {
-        size_t dot = fsPath.find_last_of('.');
-        if (dot != std::string::npos) {
-            std::string ext = fsPath.substr(dot);
-            for (std::vector<std::string>::const_iterator eit = matched->cgi_extensions.begin(); eit != matched->cgi_extensions.end(); ++eit) {
-                if (ext == *eit) { tryCgi = true; break; }
-            }
-        }
-    }
+    // A directory target was renamed above and is never a script
+    bool tryCgi = ctx.isCgi && fsPath == ctx.fsPath;
     if (tryCgi) {
-        CGIHandler cgi(request, request.serverConfig);
+        CGIHandler cgi(request, *request.serverConfig);
         CGIHandler::Result r = cgi.run(fsPath, matched->cgi_pass);
         setStatus(r.status_code, r.status_text);
         for (std::map<std::string,std::string>::const_iterator it = r.headers.begin(); it != r.headers.end(); ++it){
@@ -117,16 +131,10 @@ void ResponsePost::handle(){
     }
 
     // If multipart uploads were parsed, save each uploaded FilePart into upload directory
-    const std::map<std::string, FilePart>& uploads = request.getUploads();
+    const Request::UploadMap& uploads = request.getUploads();
     if (!uploads.empty()){
-        // Determine upload directory: prefer route.upload_path, then matched root, then server root
-        std::string uploadDir;
-        if (matched && !matched->upload_path.empty()) uploadDir = matched->upload_path;
-        else if (matched && !matched->root.empty()) uploadDir = matched->root;
-        else uploadDir = request.serverConfig.root;
-
-        // Ensure uploadDir has no trailing slash
-    if (!uploadDir.empty() && uploadDir[uploadDir.size() - 1] == '/') uploadDir.erase(uploadDir.size() - 1);
+        // route.upload_path, then the route root, then the server root
+        std::string uploadDir = request.uploadDirectory();
 
         // Ensure directory exists (attempt to create if missing)
         struct stat stbuf;
@@ -137,26 +145,40 @@ void ResponsePost::handle(){
                 return;
             }
         }
+        int dirFd = open(uploadDir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            setStatus(500, "Internal Server Error");
+            body = buildDefaultBodyError(500);
+            return;
+        }
 
         // Save each upload
-        for (std::map<std::string, FilePart>::const_iterator it = uploads.begin(); it != uploads.end(); ++it){
+        for (Request::UploadMap::const_iterator it = uploads.begin(); it != uploads.end(); ++it){
             const FilePart &fp = it->second;
-            std::string filename = fp.filename;
-            if (filename.empty()) {
-                std::ostringstream ts;
-                ts << time(NULL);
-                filename = std::string("upload_") + ts.str();
+            std::string filename = uploadName(fp.filename);
+            bool saved;
+            if (fp.fd >= 0) {
+                // Streamed to a temporary file while the body arrived
+                saved = linkUpload(fp, dirFd, filename);
+            } else {
+                // Parsed from a buffered body
+                int fd = openat(dirFd, filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                saved = fd >= 0 && writeAll(fd, fp.content);
+                if (fd >= 0)
+                    close(fd);
             }
-            std::string outPath = uploadDir + "/" + filename;
-            std::ofstream ofs(outPath.c_str(), std::ios::out | std::ios::binary);
-            if (!ofs){
+            if (!saved){
+                close(dirFd);
                 setStatus(500, "Internal Server Error");
                 body = buildDefaultBodyError(500);
                 return;
             }
-            ofs << fp.content;
-            ofs.close();
+            // The file is created in the upload directory, not under the
+            // target; a cached "not found" for its name must go
+            if (openFiles)
+                openFiles->forget(uploadDir + "/" + filename);
         }
+        close(dirFd);
 
         setStatus(201, "Created");
         body = std::string("Files uploaded successfully.");
@@ -165,10 +187,13 @@ void ResponsePost::handle(){
     }
 
     // Fallback: write raw request body into the target file (append mode)
-    std::ofstream ofs(fsPath.c_str(), std::ios::out | std::ios::binary | std::ios::app);
-    if (!ofs){ setStatus(500, "Internal Server Error"); body = buildDefaultBodyError(500); return; }
-    ofs << request.body;
-    ofs.close();
+    int fd = RootDirectories::openBeneath(ctx.rootFd, relPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0){ setStatus(500, "Internal Server Error"); body = buildDefaultBodyError(500); return; }
+    bool written = writeAll(fd, request.body);
+    close(fd);
+    if (!written){ setStatus(500, "Internal Server Error"); body = buildDefaultBodyError(500); return; }
+    if (openFiles)
+        openFiles->forget(ctx.fsPath);
 
     setStatus(201, "Created");
     body = std::string("Resource created or appended.");
@@ -4,7 +4,7 @@
 
 class ResponsePost : public ResponseBase {
 public:
-    ResponsePost(Request& request);
+    ResponsePost(Request& request, FileCache* cache = NULL, OpenFileCache* openFiles = NULL);
     virtual ~ResponsePost();
 protected:
     virtual void handle();